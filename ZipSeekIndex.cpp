@@ -0,0 +1,310 @@
+#include <string.h>
+
+#include <algorithm>
+#include <istream>
+#include <ostream>
+
+#include "MyLog.h"
+
+#include "minizip/zlib.h"
+
+#include "ZipSeekIndex.h"
+
+#define SEEK_INDEX_MAGIC        "ZIDX"
+#define SEEK_INDEX_VERSION      1
+
+#define WINSIZE                 32768       // deflate最大窗口
+#define CHUNK                   16384       // 每次读取的压缩数据
+
+namespace
+{
+
+void putValue(std::ostream &os, uint64_t value, int bytes)
+{
+    char buf[8];
+    for (int i = 0; i < bytes; ++i) {
+        buf[i] = char(value & 0xff);
+        value >>= 8;
+    }
+    os.write(buf, bytes);
+}
+
+bool getValue(std::istream &is, uint64_t &value, int bytes)
+{
+    unsigned char buf[8];
+    if (!is.read((char *)buf, bytes)) {
+        return false;
+    }
+
+    value = 0;
+    for (int i = bytes - 1; i >= 0; --i) {
+        value = (value << 8) | buf[i];
+    }
+    return true;
+}
+
+} /* namespace */
+
+ZipSeekIndex::ZipSeekIndex() : m_span(SEEK_INDEX_SPAN)
+{
+    // 开头的访问点
+    Point point = { 0, 0, 0, std::string() };
+    m_points.push_back(point);
+}
+
+int ZipSeekIndex::build(const ReadCallback &reader, uint64_t compressedSize, uint64_t span)
+{
+    std::vector<Point> points;
+    points.push_back(m_points.front());
+
+    z_stream stream = z_stream();
+    int zResult = inflateInit2(&stream, -MAX_WBITS);
+    if (zResult != Z_OK) {
+        LOG_ERROR("Failed to init inflate stream. ZLib LOG_ERROR: %d", zResult);
+        return -1;
+    }
+
+    // 使用Z_BLOCK在每个deflate块结束时返回, 解压窗口循环使用
+    unsigned char input[CHUNK];
+    unsigned char window[WINSIZE];
+    uint64_t totalIn = 0;
+    uint64_t totalOut = 0;
+    uint64_t last = 0;
+    uint64_t readOffset = 0;
+    stream.avail_out = 0;
+    do
+    {
+        size_t readSize = size_t(std::min<uint64_t>(CHUNK, compressedSize - readOffset));
+        long readResult = readSize > 0 ? reader(readOffset, (char *)input, readSize) : 0;
+        if (readResult <= 0) {
+            LOG_ERROR("Failed to read compressed data at %llu.", (unsigned long long)readOffset);
+            zResult = Z_DATA_ERROR;
+            break;
+        }
+        readOffset += uint64_t(readResult);
+        stream.avail_in = uInt(readResult);
+        stream.next_in = input;
+
+        do
+        {
+            if (0 == stream.avail_out) {
+                stream.avail_out = WINSIZE;
+                stream.next_out = window;
+            }
+
+            totalIn += stream.avail_in;
+            totalOut += stream.avail_out;
+            zResult = inflate(&stream, Z_BLOCK);
+            totalIn -= stream.avail_in;
+            totalOut -= stream.avail_out;
+            if (zResult == Z_NEED_DICT)
+                zResult = Z_DATA_ERROR;
+            if (zResult == Z_MEM_ERROR || zResult == Z_DATA_ERROR)
+                break;
+            if (zResult == Z_STREAM_END)
+                break;
+
+            // Z_BLOCK在最后一块结束时返回Z_OK, 输入已读完, 作为解压完成
+            if ((stream.data_type & 128) && (stream.data_type & 64)) {
+                zResult = Z_STREAM_END;
+                break;
+            }
+
+            // 块结束且不是最后一块时记录访问点
+            if ((stream.data_type & 128) && !(stream.data_type & 64) && totalOut - last > span) {
+                Point point;
+                point.out = totalOut;
+                point.in = totalIn;
+                point.bits = stream.data_type & 7;
+                point.window.reserve(WINSIZE);
+                size_t left = stream.avail_out;
+                if (left) {
+                    point.window.append((const char *)window + WINSIZE - left, left);
+                }
+                if (left < WINSIZE) {
+                    point.window.append((const char *)window, WINSIZE - left);
+                }
+                points.push_back(point);
+                last = totalOut;
+            }
+        } while (0 != stream.avail_in || 0 == stream.avail_out);     // 输入读完时解压窗口满可能还有输出
+    } while (zResult != Z_STREAM_END && zResult != Z_MEM_ERROR && zResult != Z_DATA_ERROR);
+
+    inflateEnd(&stream);
+    if (zResult != Z_STREAM_END) {
+        LOG_ERROR("Failed to inflate data for seek index. ZLib LOG_ERROR: %d", zResult);
+        return -1;
+    }
+
+    m_points.swap(points);
+    m_span = span;
+    return 0;
+}
+
+int ZipSeekIndex::extract(const ReadCallback &reader, uint64_t compressedSize, uint64_t offset, uint64_t size, std::ostream &os) const
+{
+    if (0 == size) {
+        return 0;
+    }
+
+    // 找到offset之前最近的访问点
+    auto it = std::upper_bound(m_points.begin(), m_points.end(), offset,
+        [](uint64_t value, const Point &point) { return value < point.out; });
+    const Point &here = *(--it);
+
+    z_stream stream = z_stream();
+    int zResult = inflateInit2(&stream, -MAX_WBITS);
+    if (zResult != Z_OK) {
+        LOG_ERROR("Failed to init inflate stream. ZLib LOG_ERROR: %d", zResult);
+        return -1;
+    }
+
+    unsigned char input[CHUNK];
+    unsigned char output[WINSIZE];
+    uint64_t readOffset = here.in - (here.bits ? 1 : 0);
+    if (here.bits) {
+        char byte = 0;
+        if (reader(readOffset, &byte, 1) != 1) {
+            inflateEnd(&stream);
+            LOG_ERROR("Failed to read compressed data at %llu.", (unsigned long long)readOffset);
+            return -1;
+        }
+        readOffset += 1;
+        inflatePrime(&stream, here.bits, (unsigned char)byte >> (8 - here.bits));
+    }
+    if (!here.window.empty()) {
+        inflateSetDictionary(&stream, (const Bytef *)here.window.data(), uInt(here.window.size()));
+    }
+
+    // 跳过访问点到offset之间的数据, 然后输出size字节
+    uint64_t skip = offset - here.out;
+    uint64_t left = size;
+    bool pending = false;
+    while (left > 0)
+    {
+        if (0 == stream.avail_in && !pending) {
+            size_t readSize = size_t(std::min<uint64_t>(CHUNK, compressedSize - readOffset));
+            long readResult = readSize > 0 ? reader(readOffset, (char *)input, readSize) : 0;
+            if (readResult <= 0) {
+                LOG_ERROR("Failed to read compressed data at %llu.", (unsigned long long)readOffset);
+                zResult = Z_DATA_ERROR;
+                break;
+            }
+            readOffset += uint64_t(readResult);
+            stream.avail_in = uInt(readResult);
+            stream.next_in = input;
+        }
+
+        stream.next_out = output;
+        stream.avail_out = WINSIZE;
+        zResult = inflate(&stream, Z_NO_FLUSH);
+        if (zResult == Z_NEED_DICT)
+            zResult = Z_DATA_ERROR;
+        if (zResult == Z_MEM_ERROR || zResult == Z_DATA_ERROR)
+            break;
+
+        pending = (0 == stream.avail_out);
+        uint64_t have = WINSIZE - stream.avail_out;
+        uint64_t discard = std::min(skip, have);
+        skip -= discard;
+        uint64_t copy = std::min(left, have - discard);
+        if (copy > 0) {
+            os.write((const char *)output + discard, std::streamsize(copy));
+            if (os.fail()) {
+                LOG_ERROR("Failed to write %llu bytes to stream.", (unsigned long long)copy);
+                zResult = Z_ERRNO;
+                break;
+            }
+            left -= copy;
+        }
+
+        if (zResult == Z_STREAM_END)
+            break;
+    }
+
+    inflateEnd(&stream);
+    if (left > 0) {
+        LOG_ERROR("Failed to inflate range, %llu bytes left. ZLib LOG_ERROR: %d", (unsigned long long)left, zResult);
+        return -1;
+    }
+
+    return 0;
+}
+
+int ZipSeekIndex::save(std::ostream &os, uint64_t key) const
+{
+    os.write(SEEK_INDEX_MAGIC, 4);
+    putValue(os, SEEK_INDEX_VERSION, 4);
+    putValue(os, key, 8);
+    putValue(os, m_span, 8);
+    putValue(os, m_points.size(), 8);
+    for (const auto &point : m_points) {
+        putValue(os, point.out, 8);
+        putValue(os, point.in, 8);
+        putValue(os, uint64_t(point.bits), 4);
+        putValue(os, point.window.size(), 4);
+        os.write(point.window.data(), std::streamsize(point.window.size()));
+    }
+
+    if (os.fail()) {
+        LOG_ERROR("Failed to write seek index.");
+        return -1;
+    }
+    return 0;
+}
+
+int ZipSeekIndex::load(std::istream &is, uint64_t key)
+{
+    char magic[4] = { 0 };
+    uint64_t version = 0;
+    uint64_t indexKey = 0;
+    uint64_t span = 0;
+    uint64_t count = 0;
+    if (!is.read(magic, 4) || 0 != memcmp(magic, SEEK_INDEX_MAGIC, 4)
+            || !getValue(is, version, 4) || SEEK_INDEX_VERSION != version
+            || !getValue(is, indexKey, 8) || !getValue(is, span, 8) || !getValue(is, count, 8)) {
+        LOG_ERROR("Invalid seek index header.");
+        return -1;
+    }
+
+    if (indexKey != key) {
+        LOG_ERROR("Seek index does not match file.");
+        return -1;
+    }
+
+    std::vector<Point> points;
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        Point point;
+        uint64_t bits = 0;
+        uint64_t windowSize = 0;
+        if (!getValue(is, point.out, 8) || !getValue(is, point.in, 8)
+                || !getValue(is, bits, 4) || bits > 7
+                || !getValue(is, windowSize, 4) || windowSize > WINSIZE) {
+            LOG_ERROR("Invalid seek index point %llu.", (unsigned long long)i);
+            return -1;
+        }
+
+        point.bits = int(bits);
+        point.window.resize(size_t(windowSize));
+        if (windowSize > 0 && !is.read(&point.window[0], std::streamsize(windowSize))) {
+            LOG_ERROR("Invalid seek index point %llu.", (unsigned long long)i);
+            return -1;
+        }
+
+        if (!points.empty() && point.out <= points.back().out) {
+            LOG_ERROR("Seek index points out of order.");
+            return -1;
+        }
+        points.push_back(point);
+    }
+
+    if (points.empty() || 0 != points.front().out) {
+        LOG_ERROR("Seek index has no start point.");
+        return -1;
+    }
+
+    m_points.swap(points);
+    m_span = span;
+    return 0;
+}
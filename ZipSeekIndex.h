@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#define SEEK_INDEX_SPAN         (1024 * 1024)       // 默认每1M解压数据一个访问点
+
+/**
+ * @brief raw deflate数据的随机访问索引(参考zlib examples/zran.c)
+ * @note
+ * 每隔span字节解压数据在deflate块边界记录一个访问点: 解压偏移、压缩偏移、
+ * 剩余bit数以及之前32K的解压窗口, 读取任意位置时从最近的访问点开始解压。
+ * 没有建立索引时只有开头一个访问点, 等同于从头解压。
+ */
+class ZipSeekIndex
+{
+public:
+    // 读取压缩数据回调, offset为相对压缩数据开头的偏移, 返回读取字节数, 失败返回-1
+    typedef std::function<long(uint64_t offset, char *buf, size_t size)> ReadCallback;
+
+public:
+    ZipSeekIndex();
+
+    /**
+     * @brief 解压全部数据建立索引
+     * @param [IN] reader           压缩数据读取回调
+     * @param [IN] compressedSize   压缩数据长度
+     * @param [IN] span             访问点间隔(解压数据字节)
+     * @return int
+     */
+    int build(const ReadCallback &reader, uint64_t compressedSize, uint64_t span = SEEK_INDEX_SPAN);
+
+    /**
+     * @brief 解压[offset, offset + size)数据到输出流
+     * @return int
+     */
+    int extract(const ReadCallback &reader, uint64_t compressedSize, uint64_t offset, uint64_t size, std::ostream &os) const;
+
+    /**
+     * @brief 保存/读取索引, key用于校验索引是否属于当前文件(如crc和大小)
+     * @return int
+     */
+    int save(std::ostream &os, uint64_t key) const;
+    int load(std::istream &is, uint64_t key);
+
+    bool empty() const { return m_points.size() <= 1; }
+
+private:
+    struct Point
+    {
+        uint64_t out;               // 解压数据偏移
+        uint64_t in;                // 压缩数据偏移
+        int bits;                   // in之前一个字节中属于当前块的bit数
+        std::string window;         // 之前32K解压数据
+    };
+
+    std::vector<Point> m_points;
+    uint64_t m_span;
+};
@@ -2,29 +2,900 @@
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "minizip/zip.h"
 #include "minizip/unzip.h"
+#include "minizip/iomem.h"
+
+#ifdef _WIN32
+#include "minizip/iowin32.h"
+#endif
+
+#include "MyLog.h"
+
+#include "File.h"
+#include "ZipSerialize.h"
+#include "ZipSeekIndex.h"
+#include "ZipStreamWriter.h"
+
+namespace
+{
+
+// 只读映射文件, 按块顺序读取时可释放已处理的页面, 常驻内存不随文件大小增长
+class MappedFile
+{
+public:
+    MappedFile() : m_data(nullptr), m_size(0), m_released(0) {}
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (m_data) munmap(m_data, m_size);
+#endif
+    }
+
+    int open(const std::string &path)
+    {
+#ifdef _WIN32
+        (void)path;
+        return -1;
+#else
+        int fd = ::open(MyUtilityLib::File::encodeName(path).c_str(), O_RDONLY);
+        if (fd < 0) {
+            return -1;
+        }
+
+        struct stat st;
+        if (0 != fstat(fd, &st)) {
+            ::close(fd);
+            return -1;
+        }
+
+        m_size = size_t(st.st_size);
+        if (m_size > 0) {
+            void *addr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (MAP_FAILED == addr) {
+                ::close(fd);
+                m_size = 0;
+                return -1;
+            }
+            m_data = (char *)addr;
+            madvise(m_data, m_size, MADV_SEQUENTIAL);
+        }
+
+        ::close(fd);
+        return 0;
+#endif
+    }
+
+    const char *data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    // 释放[0, pos)中已读取的页面
+    void release(size_t pos)
+    {
+#ifndef _WIN32
+        const size_t releaseSize = 64 * 1024 * 1024;
+        size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+        pos = pos / pageSize * pageSize;
+        if (m_data && pos >= m_released + releaseSize) {
+            madvise(m_data + m_released, pos - m_released, MADV_DONTNEED);
+            m_released = pos;
+        }
+#else
+        (void)pos;
+#endif
+    }
+
+private:
+    DISABLE_COPY(MappedFile);
+
+    char *m_data;
+    size_t m_size;
+    size_t m_released;
+};
+
+//
+// 按内容选择压缩方式(COMPRESS_FLAG_AUTO)
+//
+#define AUTO_SAMPLE_SIZE        (64 * 1024)     // 采样大小, 使用最快级别试压缩
+#define AUTO_STORE_RATIO        0.95            // 采样压缩率高于此值不压缩
+#define AUTO_FAST_RATIO         0.80            // 采样压缩率高于此值使用最快级别
+#define AUTO_BEST_RATIO         0.30            // 采样压缩率低于此值使用最高级别
+
+// 已经压缩过的格式, 不再压缩
+const char *const STORE_EXTENSIONS[] = {
+    "jpg", "jpeg", "png", "gif", "webp", "mp3", "mp4", "avi", "mkv",
+    "zip", "gz", "tgz", "bz2", "xz", "7z", "rar", "jar", "docx", "xlsx", "pptx", "ofd"
+};
+
+int compressLevel(ZipSerialize::TAG_COMPRESS_FLAG_E flags)
+{
+    if (flags & ZipSerialize::COMPRESS_FLAG_DONTCOMPRESS)
+        return Z_NO_COMPRESSION;
+    if (flags & ZipSerialize::COMPRESS_FLAG_FAST)
+        return Z_BEST_SPEED;
+    if (flags & ZipSerialize::COMPRESS_FLAG_BEST)
+        return Z_BEST_COMPRESSION;
+    return Z_DEFAULT_COMPRESSION;
+}
+
+/**
+ * @brief 根据扩展名和开头数据的试压缩结果选择压缩方式
+ * @param [IN] path             文件路径
+ * @param [IN] data             文件数据
+ * @param [IN] size             文件大小
+ * @param [OUT] sampleRatio     采样压缩率(压缩后/压缩前)
+ * @return 压缩方式
+ */
+ZipSerialize::TAG_COMPRESS_FLAG_E selectCompressFlag(const std::string &path, const char *data, size_t size, double &sampleRatio)
+{
+    sampleRatio = 1.0;
+    std::string extension = MyUtilityLib::File::fileExtension(path);
+    for (const char *storeExtension : STORE_EXTENSIONS) {
+        if (extension == storeExtension) {
+            return ZipSerialize::COMPRESS_FLAG_DONTCOMPRESS;
+        }
+    }
+
+    size_t sampleSize = std::min<size_t>(size, AUTO_SAMPLE_SIZE);
+    if (0 == sampleSize) {
+        return ZipSerialize::COMPRESS_FLAG_DONTCOMPRESS;
+    }
+
+    z_stream stream = z_stream();
+    if (Z_OK != deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY)) {
+        return ZipSerialize::COMPRESS_FLAG_COMPRESS;
+    }
+
+    std::string out(deflateBound(&stream, uLong(sampleSize)), 0);
+    stream.next_in = (Bytef *)data;
+    stream.avail_in = uInt(sampleSize);
+    stream.next_out = (Bytef *)&out[0];
+    stream.avail_out = uInt(out.size());
+    int zResult = deflate(&stream, Z_FINISH);
+    sampleRatio = double(stream.total_out) / double(sampleSize);
+    deflateEnd(&stream);
+    if (Z_STREAM_END != zResult) {
+        return ZipSerialize::COMPRESS_FLAG_COMPRESS;
+    }
+
+    if (sampleRatio > AUTO_STORE_RATIO)
+        return ZipSerialize::COMPRESS_FLAG_DONTCOMPRESS;
+    if (sampleRatio > AUTO_FAST_RATIO)
+        return ZipSerialize::COMPRESS_FLAG_FAST;
+    if (sampleRatio < AUTO_BEST_RATIO)
+        return ZipSerialize::COMPRESS_FLAG_BEST;
+    return ZipSerialize::COMPRESS_FLAG_COMPRESS;
+}
+
+// 多线程压缩时单个文件的压缩结果
+struct DeflateEntry
+{
+    std::string fileFullPath;
+    std::string zipFileName;
+    tm time = tm();
+    size_t size = 0;
+    ZipSerialize::TAG_COMPRESS_FLAG_E flags = ZipSerialize::COMPRESS_FLAG_COMPRESS;
+    double sampleRatio = 0;
+
+    std::string data;               // raw deflate数据
+    uLong crc = 0;
+    int dataType = Z_BINARY;        // deflate检测的数据类型, 写入central header内部属性
+    int result = 0;
+    bool done = false;
+};
+
+/**
+ * @brief 读取文件并deflate压缩, 参数与addFile中zipOpenNewFileInZip4一致以保证输出相同
+ * @param [IN|OUT] entry
+ * @return int
+ * @note COMPRESS_FLAG_AUTO时先选择压缩方式, 选择不压缩时不生成数据
+ */
+int deflateFile(DeflateEntry &entry)
+{
+    MappedFile mappedFile;
+    if (0 != mappedFile.open(entry.fileFullPath)) {
+        LOG_ERROR("Failed to map file[%s].", entry.fileFullPath.c_str());
+        return -1;
+    }
+
+    if (entry.flags & ZipSerialize::COMPRESS_FLAG_AUTO) {
+        entry.flags = selectCompressFlag(entry.fileFullPath, mappedFile.data(), mappedFile.size(), entry.sampleRatio);
+    }
+    if (entry.flags & ZipSerialize::COMPRESS_FLAG_DONTCOMPRESS) {
+        return 0;
+    }
+
+    z_stream stream = z_stream();
+    int zResult = deflateInit2(&stream, compressLevel(entry.flags), Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+    if (zResult != Z_OK) {
+        LOG_ERROR("Failed to init deflate stream. ZLib LOG_ERROR: %d", zResult);
+        return -1;
+    }
+
+    entry.data.resize(deflateBound(&stream, uLong(mappedFile.size())));
+    stream.next_out = (Bytef *)&entry.data[0];
+    stream.avail_out = uInt(entry.data.size());
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    const size_t blockSize = 1024 * 1024;
+    size_t pos = 0;
+    do
+    {
+        size_t len = std::min(blockSize, mappedFile.size() - pos);
+        const Bytef *block = (const Bytef *)mappedFile.data() + pos;
+        crc = crc32(crc, block, uInt(len));
+        pos += len;
+
+        // deflateBound保证输出缓冲区足够, 一次调用即可消耗全部输入
+        stream.next_in = (Bytef *)block;
+        stream.avail_in = uInt(len);
+        zResult = deflate(&stream, pos < mappedFile.size() ? Z_NO_FLUSH : Z_FINISH);
+        mappedFile.release(pos);
+    } while (zResult == Z_OK && pos < mappedFile.size());
+
+    if (zResult != Z_STREAM_END) {
+        deflateEnd(&stream);
+        LOG_ERROR("Failed to deflate file[%s]. ZLib LOG_ERROR: %d", entry.fileFullPath.c_str(), zResult);
+        return -1;
+    }
+
+    entry.data.resize(stream.total_out);
+    entry.size = stream.total_in;
+    entry.crc = crc;
+    entry.dataType = stream.data_type;
+    deflateEnd(&stream);
+    return 0;
+}
+
+// tm转换为dos日期, 与minizip的zip64local_TmzDateToDosDate一致
+uLong tmToDosDate(const tm &time)
+{
+    uLong year = uLong(time.tm_year);
+    if (year >= 1980)
+        year -= 1980;
+    else if (year >= 80)
+        year -= 80;
+
+    return uLong(((time.tm_mday) + (32 * (time.tm_mon + 1)) + (512 * year)) << 16) |
+        ((time.tm_sec / 2) + (32 * time.tm_min) + (2048 * uLong(time.tm_hour)));
+}
+
+// 目录同步清单中的文件信息
+struct ManifestEntry
+{
+    unsigned long long size;
+    unsigned long long mtime;       // 修改时间yyyymmddhhmmss
+    uLong crc;
+};
+
+#define MANIFEST_HEADER     "ZIPSYNC 1"
+
+unsigned long long manifestTime(const tm &time)
+{
+    return (unsigned long long)(time.tm_year + 1900) * 10000000000ULL + (unsigned long long)(time.tm_mon + 1) * 100000000ULL
+        + (unsigned long long)time.tm_mday * 1000000ULL + (unsigned long long)time.tm_hour * 10000ULL
+        + (unsigned long long)time.tm_min * 100ULL + (unsigned long long)time.tm_sec;
+}
+
+/**
+ * @brief 计算文件内容crc32
+ * @return int
+ */
+int fileCrc(const std::string &path, uLong &crc)
+{
+    crc = crc32(0L, Z_NULL, 0);
+    MappedFile mappedFile;
+    if (0 == mappedFile.open(path)) {
+        const size_t blockSize = 1024 * 1024;
+        for (size_t pos = 0; pos < mappedFile.size(); pos += blockSize)
+        {
+            size_t len = std::min(blockSize, mappedFile.size() - pos);
+            crc = crc32(crc, (const Bytef *)mappedFile.data() + pos, uInt(len));
+            mappedFile.release(pos + len);
+        }
+        return 0;
+    }
+
+    std::ifstream fileStream(MyUtilityLib::File::encodeName(path).c_str(), std::ifstream::binary);
+    if (!fileStream || !fileStream.is_open()) {
+        LOG_ERROR("Failed to open ifstream for path[%s].", path.c_str());
+        return -1;
+    }
+
+    char buf[10240];
+    while (fileStream.read(buf, sizeof(buf)) || fileStream.gcount() > 0)
+    {
+        crc = crc32(crc, (const Bytef *)buf, uInt(fileStream.gcount()));
+    }
+    return 0;
+}
+
+/**
+ * @brief 读取目录同步清单, 每行: 大小 修改时间 crc 文件名
+ * @return int 清单不存在或格式错误返回-1
+ */
+int loadManifest(const std::string &path, std::map<std::string, ManifestEntry> &manifest)
+{
+    manifest.clear();
+    std::ifstream is(MyUtilityLib::File::encodeName(path).c_str());
+    std::string line;
+    if (!is.is_open() || !std::getline(is, line) || line != MANIFEST_HEADER) {
+        return -1;
+    }
+
+    while (std::getline(is, line))
+    {
+        std::istringstream lineStream(line);
+        ManifestEntry entry;
+        std::string name;
+        if (!(lineStream >> entry.size >> entry.mtime >> std::hex >> entry.crc) || lineStream.get() != '\t'
+                || !std::getline(lineStream, name) || name.empty()) {
+            LOG_ERROR("Invalid manifest line: %s.", line.c_str());
+            manifest.clear();
+            return -1;
+        }
+        manifest[name] = entry;
+    }
+
+    return 0;
+}
+
+int saveManifest(const std::string &path, const std::map<std::string, ManifestEntry> &manifest)
+{
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream os(MyUtilityLib::File::encodeName(tmpPath).c_str(), std::ofstream::trunc);
+        os << MANIFEST_HEADER << '\n';
+        for (const auto &item : manifest) {
+            os << item.second.size << '\t' << item.second.mtime << '\t' << std::hex << item.second.crc << std::dec
+               << '\t' << item.first << '\n';
+        }
+        if (!os.flush()) {
+            LOG_ERROR("Failed to write manifest[%s].", tmpPath.c_str());
+            return -1;
+        }
+    }
+
+#ifdef _WIN32
+    std::remove(MyUtilityLib::File::encodeName(path).c_str());
+#endif
+    if (0 != std::rename(MyUtilityLib::File::encodeName(tmpPath).c_str(), MyUtilityLib::File::encodeName(path).c_str())) {
+        LOG_ERROR("Failed to rename manifest[%s].", tmpPath.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 解压unzip当前文件到输出流
+ * @param [IN] open         已定位到文件的unzip句柄
+ * @param [IN] password     解压密码
+ * @param [IN] file         zip中文件名, 用于日志
+ * @param [OUT] os          输出流
+ * @param [IN] offset       从解压数据offset处开始输出, 之前的数据丢弃
+ * @param [IN] size         最多输出size字节
+ * @return int
+ */
+int readCurrentFile(unzFile open, const char *password, const std::string &file, std::ostream &os,
+                    ZPOS64_T offset = 0, ZPOS64_T size = ZPOS64_T(-1))
+{
+    int unzResult = unzOpenCurrentFilePassword(open, password);
+    if(unzResult != UNZ_OK) {
+        LOG_ERROR("Failed to open file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
+        return unzResult;
+    }
+
+    double currentStreamSize = 0;
+    char buf[10240];
+    while (size > 0)
+    {
+        unzResult = unzReadCurrentFile(open, buf, 10240);
+        if(unzResult == UNZ_EOF)
+            break;
+        if(unzResult <= UNZ_EOF)
+        {
+            unzCloseCurrentFile(open);
+            LOG_ERROR("Failed to read bytes from current file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
+            return -1;
+        }
+
+        ZPOS64_T have = ZPOS64_T(unzResult);
+        ZPOS64_T discard = std::min(offset, have);
+        offset -= discard;
+        ZPOS64_T len = std::min(size, have - discard);
+        if (0 == len)
+            continue;
+        currentStreamSize += double(len);
+        size -= len;
+
+        os.write(buf + discard, std::streamsize(len));
+        if(os.fail())
+        {
+            unzCloseCurrentFile(open);
+            LOG_ERROR("Failed to write file '%s' data to stream. Stream size: %f", file.c_str(), currentStreamSize);
+            return -1;
+        }
+    }
+
+    unzResult = unzCloseCurrentFile(open);
+    if(unzResult != UNZ_OK) {
+        LOG_ERROR("Failed to close current file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
+        return unzResult;
+    }
+
+    return 0;
+}
+
+} /* namespace */
+
+// central directory中的文件信息
+struct ZipEntryInfo
+{
+    ZPOS64_T offset;                // central directory偏移, 用于unzSetOffset64
+    ZPOS64_T compressedSize;
+    ZPOS64_T uncompressedSize;
+    uLong crc;
+    uLong commentSize;
+    uLong flag;
+    uLong method;
+    tm_unz time;
+};
+
+class ZipSerializePrivate
+{
+public:
+    zlib_filefunc64_def pzlib_filefunc;
+    std::string path;
+    zipFile create;
+    unzFile open;
+    const char *password;
+
+    ourmemory_t mem;                // 内存zip
+    std::string *outBuf;            // 内存zip输出
+    std::unique_ptr<ZipStreamWriter> stream;                    // 流式输出zip
+
+    // 打开时解析一次central directory, 按文件名直接定位
+    std::vector<std::string> names;                             // zip中文件, 保持原顺序
+    std::unordered_map<std::string, ZipEntryInfo> index;        // {文件名, 文件信息}
+    std::unordered_set<std::string> addedNames;                 // 本次添加的文件
+    std::unordered_map<std::string, ZipSeekIndex> seekIndex;    // {文件名, 随机访问索引}
+
+    int buildIndex();
+    int openPath(bool writable);
+    unzFile openReader(ourmemory_t &readerMem, zlib_filefunc64_def &readerFilefunc) const;
+    bool exists(const std::string &name) const;
+    int locate(const std::string &name, ZipEntryInfo &entryInfo);
+    int readRaw(const std::string &name, const std::function<int(const ZipEntryInfo&, const ZipSeekIndex::ReadCallback&)> &func);
+    int copyEntry(const std::string &name);
+    bool writable() const { return create || stream; }
+    int close();
+    int openNewFile(const std::string &containerPath, const ZipSerialize::Properties &prop, ZipSerialize::TAG_COMPRESS_FLAG_E flags);
+    int writeNewFile(const char *data, unsigned int size);
+    void abortNewFile();
+    int closeNewFile(const std::string &containerPath, unsigned long *compressedSize = nullptr);
+    int addRawFile(const DeflateEntry &entry, const ZipSerialize::Properties &prop, unsigned long *compressedSize = nullptr);
+};
+
+/**
+ * 遍历central directory建立文件名索引
+ */
+int ZipSerializePrivate::buildIndex()
+{
+    names.clear();
+    index.clear();
+
+    unz_global_info64 globalInfo;
+    int unzResult = unzGetGlobalInfo64(open, &globalInfo);
+    if(unzResult != UNZ_OK) {
+        LOG_ERROR("Failed to get global info of ZIP container. ZLib LOG_ERROR: %d", unzResult);
+        return unzResult;
+    }
+
+    names.reserve(size_t(globalInfo.number_entry));
+    index.reserve(size_t(globalInfo.number_entry));
+    std::string fileName;
+    for (unzResult = unzGoToFirstFile(open); unzResult == UNZ_OK; unzResult = unzGoToNextFile(open))
+    {
+        unz_file_info64 fileInfo;
+        unzResult = unzGetCurrentFileInfo64(open, &fileInfo, 0, 0, 0, 0, 0, 0);
+        if(unzResult != UNZ_OK) {
+            LOG_ERROR("Failed to get info of the current file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
+            return unzResult;
+        }
+
+        fileName.assign(fileInfo.size_filename, 0);
+        unzResult = unzGetCurrentFileInfo64(open, &fileInfo, &fileName[0], uLong(fileName.size()), 0, 0, 0, 0);
+        if(unzResult != UNZ_OK) {
+            LOG_ERROR("Failed to get filename of the current file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
+            return unzResult;
+        }
+
+        ZipEntryInfo entryInfo = { unzGetOffset64(open), fileInfo.compressed_size, fileInfo.uncompressed_size,
+            fileInfo.crc, fileInfo.size_file_comment, fileInfo.flag, fileInfo.compression_method, fileInfo.tmu_date };
+        if (index.emplace(fileName, entryInfo).second) {
+            names.push_back(fileName);
+        }
+    }
+
+    if(unzResult != UNZ_END_OF_LIST_OF_FILE) {
+        LOG_ERROR("Failed to go to the next file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
+        return unzResult;
+    }
+
+    return 0;
+}
+
+/**
+ * 打开zip文件, 已存在时读取central directory并以添加方式打开
+ */
+int ZipSerializePrivate::openPath(bool writable)
+{
+    int append = APPEND_STATUS_CREATE;                          // 默认创建zip方式
+    if(MyUtilityLib::File::fileExists(path)) {                  // zip文件已存在
+        LOG_DEBUG("Zip file[%s] exist, now add and open zip.", path.c_str());
+        append = APPEND_STATUS_ADDINZIP;                        // zip已存在改为添加方式
+
+        // 解压缩zip文件
+        open = unzOpen2_64((char*)MyUtilityLib::File::encodeName(path).c_str(), &pzlib_filefunc);
+        if(!open) {
+            LOG_ERROR("Failed to open ZIP file '%s'.", path.c_str());
+            return -1;
+        }
+
+        if (0 != buildIndex()) {
+            LOG_ERROR("Failed to read central directory of ZIP file '%s'.", path.c_str());
+            unzClose(open);
+            open = 0;
+            return -1;
+        }
+    }
+
+    if (!writable) {
+        return 0;
+    }
+
+    // zip文件存在添加、不存在创建
+    create = zipOpen2_64((char *)MyUtilityLib::File::encodeName(path).c_str(), append, 0, &pzlib_filefunc);
+    if(!create) {
+        LOG_ERROR("Failed to create ZIP file '%s'.", path.c_str());
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * 打开独立的unzip句柄, 供多线程读取
+ * 内存zip共享只读数据, 每个句柄使用自己的读取位置
+ */
+unzFile ZipSerializePrivate::openReader(ourmemory_t &readerMem, zlib_filefunc64_def &readerFilefunc) const
+{
+    if (mem.base && !mem.grow) {
+        readerMem = mem;
+        fill_memory_filefunc64(&readerFilefunc, &readerMem);
+        return unzOpen2_64("", &readerFilefunc);
+    }
+
+    readerFilefunc = pzlib_filefunc;
+    return unzOpen2_64((char*)MyUtilityLib::File::encodeName(path).c_str(), &readerFilefunc);
+}
+
+/**
+ * 文件是否在zip中或者已添加, 区分大小写
+ */
+bool ZipSerializePrivate::exists(const std::string &name) const
+{
+    return index.count(name) > 0 || addedNames.count(name) > 0;
+}
+
+/**
+ * 定位到zip中文件, 成为unzip当前文件
+ */
+int ZipSerializePrivate::locate(const std::string &name, ZipEntryInfo &entryInfo)
+{
+    auto it = index.find(name);
+    if (it == index.end()) {
+        return UNZ_END_OF_LIST_OF_FILE;
+    }
+
+    entryInfo = it->second;
+    return unzSetOffset64(open, entryInfo.offset);
+}
+
+/**
+ * 定位文件压缩数据, 通过独立的读取流按压缩数据偏移读取
+ */
+int ZipSerializePrivate::readRaw(const std::string &name, const std::function<int(const ZipEntryInfo&, const ZipSeekIndex::ReadCallback&)> &func)
+{
+    ZipEntryInfo entryInfo;
+    int unzResult = locate(name, entryInfo);
+    if(unzResult != UNZ_OK) {
+        LOG_ERROR("Failed to open file[%s] inside ZIP container. ZLib LOG_ERROR: %d", name.c_str(), unzResult);
+        return unzResult;
+    }
+
+    // raw方式打开得到压缩数据在zip中的位置(跳过本地文件头)
+    unzResult = unzOpenCurrentFile2(open, nullptr, nullptr, 1);
+    if(unzResult != UNZ_OK) {
+        LOG_ERROR("Failed to open file[%s] inside ZIP container. ZLib LOG_ERROR: %d", name.c_str(), unzResult);
+        return unzResult;
+    }
+    ZPOS64_T dataOffset = unzGetCurrentFileZStreamPos64(open);
+    unzCloseCurrentFile(open);
+
+    ourmemory_t readerMem;
+    zlib_filefunc64_def readerFilefunc;
+    voidpf stream = nullptr;
+    if (mem.base && !mem.grow) {
+        readerMem = mem;
+        fill_memory_filefunc64(&readerFilefunc, &readerMem);
+        stream = readerFilefunc.zopen64_file(readerFilefunc.opaque, "", ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_EXISTING);
+    } else {
+        readerFilefunc = pzlib_filefunc;
+        stream = readerFilefunc.zopen64_file(readerFilefunc.opaque, MyUtilityLib::File::encodeName(path).c_str(),
+                                             ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_EXISTING);
+    }
+    if (!stream) {
+        LOG_ERROR("Failed to open ZIP container for raw read.");
+        return -1;
+    }
+
+    ZipSeekIndex::ReadCallback reader = [&](uint64_t offset, char *buf, size_t size) -> long {
+        if (offset + size > entryInfo.compressedSize
+                || 0 != readerFilefunc.zseek64_file(readerFilefunc.opaque, stream, dataOffset + offset, ZLIB_FILEFUNC_SEEK_SET)) {
+            return -1;
+        }
+        return long(readerFilefunc.zread_file(readerFilefunc.opaque, stream, buf, uLong(size)));
+    };
+
+    int result = func(entryInfo, reader);
+    readerFilefunc.zclose_file(readerFilefunc.opaque, stream);
+    return result;
+}
+
+/**
+ * 不解压直接拷贝zip中文件的压缩数据到create, 保留时间、属性、注释和加密头
+ */
+int ZipSerializePrivate::copyEntry(const std::string &name)
+{
+    ZipEntryInfo entryInfo;
+    int unzResult = locate(name, entryInfo);
+    if(unzResult != UNZ_OK) {
+        LOG_ERROR("Failed to open file[%s] inside ZIP container. ZLib LOG_ERROR: %d", name.c_str(), unzResult);
+        return unzResult;
+    }
+
+    unz_file_info64 fileInfo;
+    std::string comment(entryInfo.commentSize, 0);
+    unzResult = unzGetCurrentFileInfo64(open, &fileInfo, 0, 0, 0, 0, comment.empty() ? 0 : &comment[0], uLong(comment.size()));
+    if(unzResult != UNZ_OK) {
+        LOG_ERROR("Failed to get info of file[%s] inside ZIP container. ZLib LOG_ERROR: %d", name.c_str(), unzResult);
+        return unzResult;
+    }
+
+    // 通用标志bit 1-2记录的压缩级别
+    static const int levels[] = { Z_DEFAULT_COMPRESSION, Z_BEST_COMPRESSION, 2, Z_BEST_SPEED };
+    int level = Z_DEFLATED == entryInfo.method ? levels[(fileInfo.flag >> 1) & 3] : 0;
+    int zip64 = entryInfo.uncompressedSize >= 0xffffffff || entryInfo.compressedSize >= 0xffffffff;
+    zip_fileinfo info = { tm_zip(), fileInfo.dosDate, fileInfo.internal_fa, fileInfo.external_fa };
+    int zipResult = zipOpenNewFileInZip4_64(create, name.c_str(), &info, 0, 0, 0, 0, comment.c_str(),
+        int(entryInfo.method), level, 1, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY, nullptr, 0,
+        fileInfo.version, fileInfo.flag & (1 | 2048), zip64);
+    if(zipResult != ZIP_OK) {
+        LOG_ERROR("Failed to create new file inside ZIP container. ZLib LOG_ERROR: %d", zipResult);
+        return -1;
+    }
+
+    int iRet = readRaw(name, [&](const ZipEntryInfo &, const ZipSeekIndex::ReadCallback &reader) -> int {
+        char buf[65536];
+        for (uint64_t pos = 0; pos < entryInfo.compressedSize; )
+        {
+            long readResult = reader(pos, buf, size_t(std::min<uint64_t>(sizeof(buf), entryInfo.compressedSize - pos)));
+            if (readResult <= 0 || ZIP_OK != zipWriteInFileInZip(create, buf, unsigned(readResult))) {
+                LOG_ERROR("Failed to copy file[%s] at %llu.", name.c_str(), (unsigned long long)pos);
+                return -1;
+            }
+            pos += uint64_t(readResult);
+        }
+        return 0;
+    });
+
+    zipResult = zipCloseFileInZipRaw64(create, entryInfo.uncompressedSize, entryInfo.crc);
+    if(0 != iRet || zipResult != ZIP_OK) {
+        LOG_ERROR("Failed to close current file inside ZIP container. ZLib LOG_ERROR: %d", zipResult);
+        return -1;
+    }
+
+    addedNames.insert(name);
+    return 0;
+}
+
+/**
+ * 关闭zip, 内存zip拷贝到输出缓冲区
+ */
+int ZipSerializePrivate::close()
+{
+    int zipResult = ZIP_OK;
+    if (stream) {
+        zipResult = stream->finish();
+        stream.reset();
+    }
+
+    if (create) {
+        zipResult = zipClose(create, nullptr);
+        create = 0;
+    }
+
+    if (outBuf && mem.grow) {
+        if (zipResult == ZIP_OK) {
+            outBuf->assign(mem.base ? mem.base : "", size_t(mem.limit));
+        }
+        free(mem.base);
+        mem = ourmemory_t();
+    }
 
-#ifdef _WIN32
-#include "minizip/iowin32.h"
-#endif
+    return zipResult;
+}
 
-#include "MyLog.h"
+/**
+ * 在zip中创建新文件, 之后使用zipWriteInFileInZip写入数据
+ */
+int ZipSerializePrivate::openNewFile(const std::string &containerPath, const ZipSerialize::Properties &prop, ZipSerialize::TAG_COMPRESS_FLAG_E flags)
+{
+    if(!writable()) {
+        LOG_ERROR("Zip file is not open");
+        return -1;
+    }
 
-#include "File.h"
-#include "ZipSerialize.h"
+    // 判断文件是否已存在
+    if (exists(containerPath)) {
+        LOG_ERROR("File[%s] exists.", containerPath.c_str());
+        return -1;
+    }
 
-class ZipSerializePrivate
+    LOG_DEBUG("ZipSerialize::addFile(%s)", containerPath.c_str());
+    zip_fileinfo info = {
+        { uInt(prop.time.tm_sec), uInt(prop.time.tm_min), uInt(prop.time.tm_hour),
+          uInt(prop.time.tm_mday), uInt(prop.time.tm_mon), uInt(prop.time.tm_year) },
+        0, 0, 0 };
+
+    // Create new file inside ZIP container.
+    // 2048 general purpose bit 11 for unicode
+    int compression = flags & ZipSerialize::COMPRESS_FLAG_DONTCOMPRESS ? Z_NULL : Z_DEFLATED;
+    int level = compressLevel(flags);
+    if (stream) {
+        return stream->openEntry(containerPath, prop.comment, tmToDosDate(prop.time), compression, level);
+    }
+
+    int zipResult = zipOpenNewFileInZip4(create, containerPath.c_str(),
+        &info, 0, 0, 0, 0, prop.comment.c_str(), compression, level, 0,
+        -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY, password, 0, 0, 2048);
+    if(zipResult != ZIP_OK) {
+        LOG_ERROR("Failed to create new file inside ZIP container. ZLib LOG_ERROR: %d", zipResult);
+        return -1;
+    }
+
+    return 0;
+}
+
+int ZipSerializePrivate::writeNewFile(const char *data, unsigned int size)
 {
-public:
-    zlib_filefunc64_def pzlib_filefunc;
-    std::string path;
-    zipFile create;
-    unzFile open;
-    const char *password;
-};
+    int zipResult = stream ? stream->writeEntry(data, size) : zipWriteInFileInZip(create, data, size);
+    if(zipResult != ZIP_OK) {
+        LOG_ERROR("Failed to write bytes to current file inside ZIP container. ZLib LOG_ERROR: %d", zipResult);
+        return -1;
+    }
+
+    return 0;
+}
+
+void ZipSerializePrivate::abortNewFile()
+{
+    if (stream) {
+        stream->closeEntry();
+    } else {
+        zipCloseFileInZip(create);
+    }
+}
+
+int ZipSerializePrivate::closeNewFile(const std::string &containerPath, unsigned long *compressedSize)
+{
+    int zipResult = stream ? stream->closeEntry() : zipCloseFileInZip(create);
+    if(zipResult != ZIP_OK) {
+        LOG_ERROR("Failed to close current file inside ZIP container. ZLib LOG_ERROR: %d", zipResult);
+        return -1;
+    }
+
+    if (compressedSize) {
+        ZPOS64_T size = 0;
+        if (stream) {
+            size = stream->lastCompressedSize();
+        } else {
+            zipGetLastFileSize(create, &size, nullptr);
+        }
+        *compressedSize = (unsigned long)size;
+    }
+
+    addedNames.insert(containerPath);
+    return 0;
+}
+
+/**
+ * 写入已deflate压缩的数据到zip, 不再重复压缩
+ */
+int ZipSerializePrivate::addRawFile(const DeflateEntry &entry, const ZipSerialize::Properties &prop, unsigned long *compressedSize)
+{
+    LOG_DEBUG("ZipSerializePrivate::addRawFile(%s)", entry.zipFileName.c_str());
+    int level = compressLevel(entry.flags);
+    if (stream) {
+        int iRet = stream->addRawEntry(entry.zipFileName, prop.comment, tmToDosDate(prop.time), level,
+            entry.data.data(), entry.data.size(), entry.size, entry.crc, Z_TEXT == entry.dataType);
+        if (0 != iRet) {
+            LOG_ERROR("Failed to write file[%s] to zip stream.", entry.zipFileName.c_str());
+            return -1;
+        }
+
+        if (compressedSize) *compressedSize = (unsigned long)entry.data.size();
+        addedNames.insert(entry.zipFileName);
+        return 0;
+    }
+
+    zip_fileinfo info = {
+        { uInt(prop.time.tm_sec), uInt(prop.time.tm_min), uInt(prop.time.tm_hour),
+          uInt(prop.time.tm_mday), uInt(prop.time.tm_mon), uInt(prop.time.tm_year) },
+        0, uLong(Z_TEXT == entry.dataType ? Z_TEXT : 0), 0 };
+
+    int zipResult = zipOpenNewFileInZip4(create, entry.zipFileName.c_str(),
+        &info, 0, 0, 0, 0, prop.comment.c_str(), Z_DEFLATED, level, 1,
+        -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY, password, entry.crc, 0, 2048);
+    if(zipResult != ZIP_OK) {
+        LOG_ERROR("Failed to create new file inside ZIP container. ZLib LOG_ERROR: %d", zipResult);
+        return -1;
+    }
+
+    const size_t chunkSize = 1 << 30;
+    for (size_t pos = 0; pos < entry.data.size(); pos += chunkSize)
+    {
+        unsigned int len = (unsigned int)std::min(chunkSize, entry.data.size() - pos);
+        zipResult = zipWriteInFileInZip(create, entry.data.data() + pos, len);
+        if(zipResult != ZIP_OK) {
+            zipCloseFileInZipRaw64(create, entry.size, entry.crc);
+            LOG_ERROR("Failed to write bytes to current file inside ZIP container. ZLib LOG_ERROR: %d", zipResult);
+            return -1;
+        }
+    }
+
+    zipResult = zipCloseFileInZipRaw64(create, entry.size, entry.crc);
+    if(zipResult != ZIP_OK) {
+        LOG_ERROR("Failed to close current file inside ZIP container. ZLib LOG_ERROR: %d", zipResult);
+        return -1;
+    }
+
+    if (compressedSize) {
+        ZPOS64_T size = 0;
+        zipGetLastFileSize(create, &size, nullptr);
+        *compressedSize = (unsigned long)size;
+    }
+
+    addedNames.insert(entry.zipFileName);
+    return 0;
+}
 
 /**
  * Initializes ZIP file serializer.
@@ -47,26 +918,118 @@ ZipSerialize::ZipSerialize(const std::string& path, const char *password) noexce
     d->create = 0;
     d->open = 0;
     d->password = password;
+    d->mem = ourmemory_t();
+    d->outBuf = nullptr;
 
-    int append = APPEND_STATUS_CREATE;                          // 默认创建zip方式
-    if(MyUtilityLib::File::fileExists(path)) {                  // zip文件已存在
-        LOG_DEBUG("Zip file[%s] exist, now add and open zip.", path.c_str());
-        append = APPEND_STATUS_ADDINZIP;                        // zip已存在改为添加方式
+    // zip文件存在添加、不存在创建
+    d->openPath(true);
+}
 
-        // 解压缩zip文件
-        d->open = unzOpen2_64((char*)MyUtilityLib::File::encodeName(d->path).c_str(), &d->pzlib_filefunc);
-        if(!d->open) {
-            LOG_ERROR("Failed to open ZIP file '%s'.", d->path.c_str());
-            return;
-        }
+/**
+ * Initializes read-only ZIP serializer over an in-memory archive.
+ *
+ * @param data
+ * @param size
+ */
+ZipSerialize::ZipSerialize(const char *data, size_t size, const char *password) noexcept
+{
+    d = new ZipSerializePrivate;
+    if (nullptr == d) {
+        return;
     }
 
-    // zip文件存在添加、不存在创建
-    d->create = zipOpen2_64((char *)MyUtilityLib::File::encodeName(d->path).c_str(), append, 0, &d->pzlib_filefunc);
+    d->create = 0;
+    d->open = 0;
+    d->password = password;
+    d->mem = ourmemory_t();
+    d->mem.base = const_cast<char *>(data);
+    d->mem.size = size;
+    d->mem.grow = 0;
+    d->outBuf = nullptr;
+    fill_memory_filefunc64(&d->pzlib_filefunc, &d->mem);
+
+    if (nullptr == data || 0 == size) {
+        LOG_ERROR("Zip buffer is empty.");
+        return;
+    }
+
+    d->open = unzOpen2_64("", &d->pzlib_filefunc);
+    if(!d->open) {
+        LOG_ERROR("Failed to open ZIP buffer, size: %lu.", (unsigned long)size);
+        return;
+    }
+
+    if (0 != d->buildIndex()) {
+        LOG_ERROR("Failed to read central directory of ZIP buffer.");
+        unzClose(d->open);
+        d->open = 0;
+        return;
+    }
+}
+
+/**
+ * Initializes ZIP serializer that creates the archive in memory.
+ *
+ * @param outBuf
+ */
+ZipSerialize::ZipSerialize(std::string *outBuf, const char *password) noexcept
+{
+    d = new ZipSerializePrivate;
+    if (nullptr == d) {
+        return;
+    }
+
+    d->create = 0;
+    d->open = 0;
+    d->password = password;
+    d->mem = ourmemory_t();
+    d->mem.grow = 1;
+    d->outBuf = outBuf;
+    fill_memory_filefunc64(&d->pzlib_filefunc, &d->mem);
+
+    if (nullptr == outBuf) {
+        LOG_ERROR("Zip output buffer is null.");
+        return;
+    }
+
+    d->create = zipOpen2_64("", APPEND_STATUS_CREATE, 0, &d->pzlib_filefunc);
     if(!d->create) {
-        LOG_ERROR("Failed to create ZIP file '%s'.", d->path.c_str());
+        LOG_ERROR("Failed to create ZIP buffer.");
+        return;
+    }
+}
+
+/**
+ * Initializes ZIP serializer that streams the archive to a write callback.
+ *
+ * @param writer
+ */
+ZipSerialize::ZipSerialize(const WriteCallback &writer) noexcept
+{
+    d = new ZipSerializePrivate;
+    if (nullptr == d) {
         return;
     }
+
+    d->create = 0;
+    d->open = 0;
+    d->password = nullptr;
+    d->mem = ourmemory_t();
+    d->outBuf = nullptr;
+    d->stream.reset(new ZipStreamWriter(writer));
+}
+
+/**
+ * Initializes ZIP serializer that streams the archive to an output stream.
+ *
+ * @param os
+ */
+ZipSerialize::ZipSerialize(std::ostream &os) noexcept
+    : ZipSerialize(WriteCallback([&os](const char *data, size_t size) {
+        os.write(data, size);
+        return !os.fail();
+    }))
+{
 }
 
 /**
@@ -76,7 +1039,7 @@ ZipSerialize::ZipSerialize(const std::string& path, const char *password) noexce
  */
 ZipSerialize::~ZipSerialize() noexcept
 {
-    if(d && d->create) zipClose(d->create, 0);
+    if(d) d->close();
     if(d && d->open) unzClose(d->open);
     delete d;
     d = nullptr;
@@ -84,7 +1047,7 @@ ZipSerialize::~ZipSerialize() noexcept
 
 ZipSerialize::operator bool() const noexcept
 {
-    return (d && d->create != nullptr) || (d && d->open != nullptr);
+    return (d && d->writable()) || (d && d->open != nullptr);
 }
 
 /**
@@ -101,33 +1064,7 @@ std::vector<std::string> ZipSerialize::list() const
         return std::vector<std::string>();
     }
 
-    int unzResult = unzGoToFirstFile(d->open);
-    std::vector<std::string> list;
-    do
-    {
-        if(unzResult != UNZ_OK) {
-            LOG_ERROR("Failed to go to the next file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
-            return std::vector<std::string>();
-        }
-
-        unz_file_info64 fileInfo;
-        unzResult = unzGetCurrentFileInfo64(d->open, &fileInfo, 0, 0, 0, 0, 0, 0);
-        if(unzResult != UNZ_OK) {
-            LOG_ERROR("Failed to get filename of the current file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
-            return std::vector<std::string>();
-        }
-
-        std::string fileName(fileInfo.size_filename, 0);
-        unzResult = unzGetCurrentFileInfo64(d->open, &fileInfo, &fileName[0], uLong(fileName.size()), 0, 0, 0, 0);
-        if(unzResult != UNZ_OK) {
-            LOG_ERROR("Failed to get filename of the current file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
-            return std::vector<std::string>();
-        }
-
-        list.push_back(fileName);
-    } while((unzResult = unzGoToNextFile(d->open)) != UNZ_END_OF_LIST_OF_FILE);
-
-    return list;
+    return d->names;
 }
 
 /**
@@ -151,49 +1088,152 @@ int ZipSerialize::extract(const std::string &file, std::ostream &os) const
         return -1;
     }
 
-    int unzResult = unzLocateFile(d->open, file.c_str(), 0);
+    ZipEntryInfo entryInfo;
+    int unzResult = d->locate(file, entryInfo);
     if(unzResult != UNZ_OK) {
         LOG_ERROR("Failed to open file[%s] inside ZIP container. ZLib LOG_ERROR: %d", file.c_str(), unzResult);
         return unzResult;
     }
 
-    unzResult = unzOpenCurrentFilePassword(d->open, d->password);
-    if(unzResult != UNZ_OK) {
-        LOG_ERROR("Failed to open file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
-        return unzResult;
+    return readCurrentFile(d->open, d->password, file, os);
+}
+
+/**
+ * 索引校验值, 文件内容改变后索引失效
+ */
+static uint64_t seekIndexKey(const ZipEntryInfo &info)
+{
+    return (uint64_t(info.crc) << 32) ^ uint64_t(info.uncompressedSize) ^ (uint64_t(info.compressedSize) << 16);
+}
+
+int ZipSerialize::buildSeekIndex(const std::string &file, unsigned long span)
+{
+    if(!d || !d->open) {
+        LOG_ERROR("Zip file is not open");
+        return -1;
     }
 
-    double currentStreamSize = 0;
-    char buf[10240];
-    for( ;; )
-    {
-        unzResult = unzReadCurrentFile(d->open, buf, 10240);
-        if(unzResult == UNZ_EOF)
-            break;
-        if(unzResult <= UNZ_EOF)
-        {
-            unzCloseCurrentFile(d->open);
-            LOG_ERROR("Failed to read bytes from current file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
+    return d->readRaw(file, [&](const ZipEntryInfo &info, const ZipSeekIndex::ReadCallback &reader) -> int {
+        if (Z_DEFLATED != info.method || (info.flag & 1)) {
+            LOG_ERROR("File[%s] is not deflated or is encrypted, can not build seek index.", file.c_str());
             return -1;
         }
-        currentStreamSize += unzResult;
 
-        os.write(buf, unzResult);
-        if(os.fail())
-        {
-            unzCloseCurrentFile(d->open);
-            LOG_ERROR("Failed to write file '%s' data to stream. Stream size: %f", file.c_str(), currentStreamSize);
+        ZipSeekIndex seekIndex;
+        if (0 != seekIndex.build(reader, info.compressedSize, span)) {
+            LOG_ERROR("Failed to build seek index for file[%s].", file.c_str());
             return -1;
         }
+
+        d->seekIndex[file] = std::move(seekIndex);
+        return 0;
+    });
+}
+
+int ZipSerialize::saveSeekIndex(const std::string &file, std::ostream &os) const
+{
+    if(!d || !d->open) {
+        LOG_ERROR("Zip file is not open");
+        return -1;
+    }
+
+    auto indexIt = d->seekIndex.find(file);
+    auto infoIt = d->index.find(file);
+    if (indexIt == d->seekIndex.end() || infoIt == d->index.end()) {
+        LOG_ERROR("No seek index for file[%s].", file.c_str());
+        return -1;
+    }
+
+    return indexIt->second.save(os, seekIndexKey(infoIt->second));
+}
+
+int ZipSerialize::loadSeekIndex(const std::string &file, std::istream &is)
+{
+    if(!d || !d->open) {
+        LOG_ERROR("Zip file is not open");
+        return -1;
+    }
+
+    auto it = d->index.find(file);
+    if (it == d->index.end()) {
+        LOG_ERROR("Failed to open file[%s] inside ZIP container.", file.c_str());
+        return -1;
+    }
+
+    ZipSeekIndex seekIndex;
+    if (0 != seekIndex.load(is, seekIndexKey(it->second))) {
+        LOG_ERROR("Failed to load seek index for file[%s].", file.c_str());
+        return -1;
+    }
+
+    d->seekIndex[file] = std::move(seekIndex);
+    return 0;
+}
+
+/**
+ * Extracts part of a file, stored files are read directly, deflated files are
+ * inflated from the nearest seek point, encrypted files are inflated from start.
+ */
+int ZipSerialize::extractRange(const std::string &file, unsigned long long offset, unsigned long long size, std::ostream &os) const
+{
+    LOG_DEBUG("ZipSerializePrivate::extractRange(%s, %llu, %llu)", file.c_str(), offset, size);
+    if(!d || !d->open) {
+        LOG_ERROR("Zip file is not open");
+        return -1;
+    }
+
+    auto it = d->index.find(file);
+    if(it == d->index.end()) {
+        LOG_ERROR("Failed to open file[%s] inside ZIP container.", file.c_str());
+        return -1;
+    }
+
+    const ZipEntryInfo &info = it->second;
+    if (offset > info.uncompressedSize) {
+        LOG_ERROR("Offset %llu out of file[%s] size %llu.", offset, file.c_str(), (unsigned long long)info.uncompressedSize);
+        return -1;
+    }
+    size = std::min<unsigned long long>(size, info.uncompressedSize - offset);
+    if (0 == size) {
+        return 0;
+    }
+
+    if ((info.flag & 1) || (0 != info.method && Z_DEFLATED != info.method)) {
+        ZipEntryInfo entryInfo;
+        int unzResult = d->locate(file, entryInfo);
+        if(unzResult != UNZ_OK) {
+            LOG_ERROR("Failed to open file[%s] inside ZIP container. ZLib LOG_ERROR: %d", file.c_str(), unzResult);
+            return unzResult;
+        }
+        return readCurrentFile(d->open, d->password, file, os, offset, size);
     }
 
-    unzResult = unzCloseCurrentFile(d->open);
-    if(unzResult != UNZ_OK) {
-        LOG_ERROR("Failed to close current file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
-        return unzResult;
-    }
+    auto indexIt = d->seekIndex.find(file);
+    return d->readRaw(file, [&](const ZipEntryInfo &entryInfo, const ZipSeekIndex::ReadCallback &reader) -> int {
+        if (Z_DEFLATED == entryInfo.method) {
+            static const ZipSeekIndex startIndex;
+            const ZipSeekIndex &seekIndex = indexIt != d->seekIndex.end() ? indexIt->second : startIndex;
+            return seekIndex.extract(reader, entryInfo.compressedSize, offset, size, os);
+        }
 
-    return 0;
+        // 存储方式直接读取
+        char buf[10240];
+        for (unsigned long long pos = offset, end = offset + size; pos < end; )
+        {
+            long readResult = reader(pos, buf, size_t(std::min<unsigned long long>(sizeof(buf), end - pos)));
+            if (readResult <= 0) {
+                LOG_ERROR("Failed to read file[%s] at %llu.", file.c_str(), pos);
+                return -1;
+            }
+            os.write(buf, readResult);
+            if (os.fail()) {
+                LOG_ERROR("Failed to write file '%s' data to stream.", file.c_str());
+                return -1;
+            }
+            pos += (unsigned long long)readResult;
+        }
+        return 0;
+    });
 }
 
 /**
@@ -207,64 +1247,116 @@ int ZipSerialize::extract(const std::string &file, std::ostream &os) const
  */
 int ZipSerialize::addFile(const std::string& containerPath, std::istream &is, const Properties &prop, TAG_COMPRESS_FLAG_E flags)
 {
-    if(!d || !d->create) {
-        LOG_ERROR("Zip file is not open");
+    int zipResult = d ? d->openNewFile(containerPath, prop, flags) : -1;
+    if(zipResult != ZIP_OK) {
         return -1;
     }
 
-    int iRet = -1;
+    is.clear();
+    is.seekg(0);
+    char buf[10240];
+    while( is )
+    {
+        is.read(buf, 10240);
+        if(is.gcount() <= 0)
+            break;
 
-    // 判断文件是否已存在
-    if (NULL != d->open) {
-        iRet = unzLocateFile(d->open, containerPath.c_str(), 0);
-        if(iRet == UNZ_OK) {
-            LOG_ERROR("File[%s] exists.", containerPath.c_str());
+        if(0 != d->writeNewFile(buf, (unsigned int)is.gcount()))
+        {
+            d->abortNewFile();
             return -1;
         }
     }
 
-    LOG_DEBUG("ZipSerialize::addFile(%s)", containerPath.c_str());
-    zip_fileinfo info = {
-        { uInt(prop.time.tm_sec), uInt(prop.time.tm_min), uInt(prop.time.tm_hour),
-          uInt(prop.time.tm_mday), uInt(prop.time.tm_mon), uInt(prop.time.tm_year) },
-        0, 0, 0 };
+    return d->closeNewFile(containerPath);
+}
 
-    // Create new file inside ZIP container.
-    // 2048 general purpose bit 11 for unicode
-    int compression = flags & COMPRESS_FLAG_DONTCOMPRESS ? Z_NULL : Z_DEFLATED;
-    int level = flags & COMPRESS_FLAG_DONTCOMPRESS ? Z_NO_COMPRESSION : Z_DEFAULT_COMPRESSION;
-    int zipResult = zipOpenNewFileInZip4(d->create, containerPath.c_str(),
-        &info, 0, 0, 0, 0, prop.comment.c_str(), compression, level, 0,
-        -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY, d->password, 0, 0, 2048);
+/**
+ * Add new file to ZIP container from a memory block, the data is passed to the
+ * compressor in large blocks without intermediate copies.
+ *
+ * @param containerPath file path inside ZIP file.
+ * @param data file content.
+ * @param size file content size.
+ */
+int ZipSerialize::addFile(const std::string &containerPath, const char *data, size_t size, const Properties &prop, TAG_COMPRESS_FLAG_E flags)
+{
+    int zipResult = d ? d->openNewFile(containerPath, prop, flags) : -1;
     if(zipResult != ZIP_OK) {
-        LOG_ERROR("Failed to create new file inside ZIP container. ZLib LOG_ERROR: %d", zipResult);
         return -1;
     }
 
-    is.clear();
-    is.seekg(0);
-    char buf[10240];
-    while( is )
+    const size_t blockSize = 1024 * 1024;
+    for (size_t pos = 0; pos < size; pos += blockSize)
     {
-        is.read(buf, 10240);
-        if(is.gcount() <= 0)
-            break;
-
-        zipResult = zipWriteInFileInZip(d->create, buf, (unsigned int)is.gcount());
-        if(zipResult != ZIP_OK)
+        size_t len = std::min(blockSize, size - pos);
+        if(0 != d->writeNewFile(data + pos, (unsigned int)len))
         {
-            zipCloseFileInZip(d->create);
-            LOG_ERROR("Failed to write bytes to current file inside ZIP container. ZLib LOG_ERROR: %d", zipResult);
+            d->abortNewFile();
+            return -1;
+        }
+    }
+
+    return d->closeNewFile(containerPath);
+}
+
+/**
+ * Add new file to ZIP container from a memory-mapped file.
+ * COMPRESS_FLAG_AUTO selects the compression from the file extension and a sample of the data.
+ */
+int ZipSerialize::addMappedFile(const std::string &containerPath, const std::string &fileFullPath, const Properties &prop, TAG_COMPRESS_FLAG_E flags, CompressReport *report)
+{
+    CompressReport fileReport = { containerPath, flags, prop.size, 0, 0 };
+    MappedFile mappedFile;
+    if (0 != mappedFile.open(fileFullPath)) {
+        // 无法映射时使用文件流
+        std::ifstream fileStream(MyUtilityLib::File::encodeName(fileFullPath).c_str(), std::ifstream::binary);
+        if (!fileStream || !fileStream.is_open()) {
+            LOG_ERROR("Failed to open ifstream for path[%s].", fileFullPath.c_str());
             return -1;
         }
+        if (flags & COMPRESS_FLAG_AUTO) {
+            flags = COMPRESS_FLAG_COMPRESS;
+        }
+        if (report) {
+            fileReport.flag = flags;
+            *report = fileReport;
+        }
+        return addFile(containerPath, fileStream, prop, flags);
+    }
+
+    if (flags & COMPRESS_FLAG_AUTO) {
+        flags = selectCompressFlag(fileFullPath, mappedFile.data(), mappedFile.size(), fileReport.sampleRatio);
+        fileReport.flag = flags;
     }
 
-    zipResult = zipCloseFileInZip(d->create);
+    int zipResult = d ? d->openNewFile(containerPath, prop, flags) : -1;
     if(zipResult != ZIP_OK) {
-        LOG_ERROR("Failed to close current file inside ZIP container. ZLib LOG_ERROR: %d", zipResult);
         return -1;
     }
 
+    const size_t blockSize = 1024 * 1024;
+    for (size_t pos = 0; pos < mappedFile.size(); pos += blockSize)
+    {
+        size_t len = std::min(blockSize, mappedFile.size() - pos);
+        if(0 != d->writeNewFile(mappedFile.data() + pos, (unsigned int)len))
+        {
+            d->abortNewFile();
+            return -1;
+        }
+        mappedFile.release(pos + len);
+    }
+
+    zipResult = d->closeNewFile(containerPath, &fileReport.compressedSize);
+    if (0 != zipResult) {
+        return zipResult;
+    }
+
+    LOG_DEBUG("File[%s] compress flag: %d, size: %lu, compressed size: %lu.", containerPath.c_str(),
+        int(fileReport.flag), fileReport.size, fileReport.compressedSize);
+    if (report) {
+        *report = fileReport;
+    }
     return 0;
 }
 
@@ -275,35 +1367,36 @@ int ZipSerialize::properties(const std::string &file, ZipSerialize::Properties &
         return -1;
     }
 
-    int unzResult = unzLocateFile(d->open, file.c_str(), 0);
-    if(unzResult != UNZ_OK) {
-        LOG_ERROR("Failed to open file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
-        return -1;
-    }
-
-    unz_file_info64 info;
-    unzResult = unzGetCurrentFileInfo64(d->open, &info, 0, 0, 0, 0, 0, 0);
-    if(unzResult != UNZ_OK) {
-        LOG_ERROR("Failed to get filename of the current file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
+    auto it = d->index.find(file);
+    if(it == d->index.end()) {
+        LOG_ERROR("Failed to open file[%s] inside ZIP container.", file.c_str());
         return -1;
     }
 
-    tm time = { int(info.tmu_date.tm_sec), int(info.tmu_date.tm_min), int(info.tmu_date.tm_hour),
-            int(info.tmu_date.tm_mday), int(info.tmu_date.tm_mon), int(info.tmu_date.tm_year), 0, 0, 0
+    const ZipEntryInfo &info = it->second;
+    tm time = { int(info.time.tm_sec), int(info.time.tm_min), int(info.time.tm_hour),
+            int(info.time.tm_mday), int(info.time.tm_mon), int(info.time.tm_year), 0, 0, 0
 #ifndef _WIN32
              , 0, 0
 #endif
     };
 
     prop.time = time;
-    prop.size = info.uncompressed_size;
+    prop.size = info.uncompressedSize;
 
-    if(info.size_file_comment == 0) {
+    if(info.commentSize == 0) {
         return 0;
     }
 
-    prop.comment.resize(info.size_file_comment);
-    unzResult = unzGetCurrentFileInfo64(d->open, &info, 0, 0, 0, 0, &prop.comment[0], uLong(prop.comment.size()));
+    int unzResult = unzSetOffset64(d->open, info.offset);
+    if(unzResult != UNZ_OK) {
+        LOG_ERROR("Failed to open file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
+        return -1;
+    }
+
+    unz_file_info64 fileInfo;
+    prop.comment.resize(info.commentSize);
+    unzResult = unzGetCurrentFileInfo64(d->open, &fileInfo, 0, 0, 0, 0, &prop.comment[0], uLong(prop.comment.size()));
     if(unzResult != UNZ_OK) {
         LOG_ERROR("Failed to get filename of the current file inside ZIP container. ZLib LOG_ERROR: %d", unzResult);
         return -1;
@@ -322,14 +1415,13 @@ int ZipSerialize::properties(const std::string &file, ZipSerialize::Properties &
  */
 int ZipSerialize::save()
 {
-    if(!d || !d->create) {
+    if(!d || !d->writable()) {
         LOG_ERROR("Zip file is not open");
         return -1;
     }
 
     LOG_DEBUG("ZipSerialize::close()");
-    int zipResult = zipClose(d->create, nullptr);
-    d->create = 0;
+    int zipResult = d->close();
     if(zipResult != ZIP_OK) {
         LOG_ERROR("Failed to close ZIP file. ZLib LOG_ERROR: %d", zipResult);
         return -1;
@@ -363,14 +1455,231 @@ int ZipSerialize::addFileByPath(const std::string &fileFullPath)
     return 0;
 }
 
-int ZipSerialize::addFileListByPath(const std::vector<std::string> &fileFullPathList, const std::string &rootDir)
+/**
+ * Synchronizes the archive with a directory. Unchanged files keep their compressed data,
+ * new and changed files are compressed, files removed from the directory are dropped.
+ */
+int ZipSerialize::syncDirectory(const std::string &dir, const std::string &manifestPath, TAG_COMPRESS_FLAG_E flags, SyncReport *report)
 {
+    if(!d || d->path.empty() || d->mem.base || d->stream) {
+        LOG_ERROR("Zip file is not open or not a zip file on disk.");
+        return -1;
+    }
+
+    std::vector<std::string> fileFullPathList;
+    if(!MyUtilityLib::File::directoryExists(dir) || 0 != MyUtilityLib::File::listFiles(dir, fileFullPathList, 1)) {
+        LOG_ERROR("Failed to list directory[%s].", dir.c_str());
+        return -1;
+    }
+
+    // zip和清单在目录中时不添加
+    std::string manifestFile = manifestPath.empty() ? d->path + ".manifest" : manifestPath;
+    std::string tmpPath = d->path + ".sync";
+    fileFullPathList.erase(std::remove_if(fileFullPathList.begin(), fileFullPathList.end(), [&](const std::string &file) {
+        return file == d->path || file == manifestFile || file == tmpPath || file == manifestFile + ".tmp";
+    }), fileFullPathList.end());
+
+    std::vector<std::string> zipFileNames;
+    int iRet = zipFileNameList(fileFullPathList, dir, zipFileNames, false);
+    if (0 != iRet) {
+        return iRet;
+    }
+
+    // 提交已添加的文件, 重新读取zip; 新建的空zip直接删除
+    bool created = !d->open && d->addedNames.empty();
+    d->close();
+    if (created) {
+        MyUtilityLib::File::removeFile(d->path);
+    }
+    if (d->open) {
+        unzClose(d->open);
+        d->open = 0;
+    }
+    d->seekIndex.clear();
+    d->addedNames.clear();
+    d->index.clear();
+    d->names.clear();
+    if (0 != d->openPath(false)) {
+        return -1;
+    }
+
+    std::map<std::string, ManifestEntry> manifest;
+    if (0 != loadManifest(manifestFile, manifest)) {
+        LOG_DEBUG("Manifest[%s] not found, compare file content with zip.", manifestFile.c_str());
+    }
+
+    //
+    // 大小和修改时间与清单一致、crc与zip一致的文件未改变;
+    // 只有修改时间改变的文件计算crc与zip比较
+    //
+    SyncReport syncReport;
+    syncReport.unchanged = 0;
+    std::vector<bool> keep(zipFileNames.size(), false);
+    std::vector<ManifestEntry> entries(zipFileNames.size());
+    std::unordered_set<std::string> present;
+    for (size_t i = 0; i < zipFileNames.size(); ++i)
+    {
+        const std::string &name = zipFileNames[i];
+        present.insert(name);
+        entries[i].size = MyUtilityLib::File::fileSize(fileFullPathList[i]);
+        entries[i].mtime = manifestTime(*MyUtilityLib::File::modifiedTime(fileFullPathList[i]));
+        entries[i].crc = 0;
+
+        auto it = d->index.find(name);
+        if (it == d->index.end()) {
+            syncReport.added.push_back(name);
+            continue;
+        }
+
+        const ZipEntryInfo &info = it->second;
+        if (entries[i].size == info.uncompressedSize && (0 == info.method || Z_DEFLATED == info.method)) {
+            auto m = manifest.find(name);
+            if (m != manifest.end() && m->second.size == entries[i].size && m->second.mtime == entries[i].mtime && m->second.crc == info.crc) {
+                keep[i] = true;
+            } else {
+                uLong crc = 0;
+                keep[i] = 0 == fileCrc(fileFullPathList[i], crc) && crc == info.crc;
+            }
+        }
+
+        if (keep[i]) {
+            ++syncReport.unchanged;
+        } else {
+            syncReport.updated.push_back(name);
+        }
+    }
+
+    // 目录项不在文件列表中, 不参与比较
+    std::vector<std::string> dirNames;
+    for (const auto &name : d->names) {
+        if ('/' == name[name.size() - 1]) {
+            dirNames.push_back(name);
+        } else if (!present.count(name)) {
+            syncReport.removed.push_back(name);
+        }
+    }
+
+    //
+    // 只有新增文件时以添加方式打开原zip, 只压缩新文件;
+    // 有修改或删除时生成新zip: 未改变的文件和目录项拷贝压缩数据, 其余文件重新压缩, 完成后替换原zip
+    //
+    bool rewrite = !syncReport.updated.empty() || !syncReport.removed.empty() || !d->open;
+    if (!rewrite && !syncReport.added.empty()) {
+        d->create = zipOpen2_64((char *)MyUtilityLib::File::encodeName(d->path).c_str(), APPEND_STATUS_ADDINZIP, 0, &d->pzlib_filefunc);
+        if (!d->create) {
+            LOG_ERROR("Failed to open ZIP file '%s'.", d->path.c_str());
+            return -1;
+        }
+
+        for (size_t i = 0; i < zipFileNames.size() && 0 == iRet; ++i)
+        {
+            if (!keep[i]) {
+                ZipSerialize::Properties prop = { "", *MyUtilityLib::File::modifiedTime(fileFullPathList[i]), (unsigned long)entries[i].size };
+                iRet = addMappedFile(zipFileNames[i], fileFullPathList[i], prop, flags);
+            }
+        }
+
+        int zipResult = zipClose(d->create, nullptr);
+        d->create = 0;
+        unzClose(d->open);
+        d->open = 0;
+        d->index.clear();
+        d->names.clear();
+        d->addedNames.clear();
+        if (0 != iRet || ZIP_OK != zipResult) {
+            LOG_ERROR("Failed to sync directory[%s] to zip[%s].", dir.c_str(), d->path.c_str());
+            d->openPath(true);
+            return -1;
+        }
+    } else if (rewrite) {
+        d->create = zipOpen2_64((char *)MyUtilityLib::File::encodeName(tmpPath).c_str(), APPEND_STATUS_CREATE, 0, &d->pzlib_filefunc);
+        if (!d->create) {
+            LOG_ERROR("Failed to create ZIP file '%s'.", tmpPath.c_str());
+            return -1;
+        }
+
+        for (size_t i = 0; i < zipFileNames.size() && 0 == iRet; ++i)
+        {
+            if (keep[i]) {
+                iRet = d->copyEntry(zipFileNames[i]);
+                continue;
+            }
+
+            // 旧文件不再参与重名检查
+            d->index.erase(zipFileNames[i]);
+            ZipSerialize::Properties prop = { "", *MyUtilityLib::File::modifiedTime(fileFullPathList[i]), (unsigned long)entries[i].size };
+            iRet = addMappedFile(zipFileNames[i], fileFullPathList[i], prop, flags);
+        }
+
+        for (size_t i = 0; i < dirNames.size() && 0 == iRet; ++i) {
+            iRet = d->copyEntry(dirNames[i]);
+        }
+
+        int zipResult = zipClose(d->create, nullptr);
+        d->create = 0;
+        if (d->open) {
+            unzClose(d->open);
+            d->open = 0;
+        }
+
+        bool replaced = 0 == iRet && ZIP_OK == zipResult;
+#ifdef _WIN32
+        replaced = replaced && (!MyUtilityLib::File::fileExists(d->path) || MyUtilityLib::File::removeFile(d->path));
+#endif
+        replaced = replaced && 0 == std::rename(MyUtilityLib::File::encodeName(tmpPath).c_str(), MyUtilityLib::File::encodeName(d->path).c_str());
+        if (!replaced) {
+            LOG_ERROR("Failed to sync directory[%s] to zip[%s].", dir.c_str(), d->path.c_str());
+            std::remove(MyUtilityLib::File::encodeName(tmpPath).c_str());
+            d->index.clear();
+            d->names.clear();
+            d->addedNames.clear();
+            d->openPath(true);
+            return -1;
+        }
 
+        d->index.clear();
+        d->names.clear();
+        d->addedNames.clear();
+    } else if (d->open) {
+        unzClose(d->open);
+        d->open = 0;
+    }
+
+    // 重新打开zip, 可以继续添加文件
+    if (0 != d->openPath(true)) {
+        return -1;
+    }
+
+    manifest.clear();
+    for (size_t i = 0; i < zipFileNames.size(); ++i) {
+        auto it = d->index.find(zipFileNames[i]);
+        if (it != d->index.end()) {
+            entries[i].crc = it->second.crc;
+            manifest[zipFileNames[i]] = entries[i];
+        }
+    }
+    if (0 != saveManifest(manifestFile, manifest)) {
+        return -1;
+    }
+
+    LOG_DEBUG("Sync directory[%s]: added %lu, updated %lu, removed %lu, unchanged %lu.", dir.c_str(),
+        (unsigned long)syncReport.added.size(), (unsigned long)syncReport.updated.size(),
+        (unsigned long)syncReport.removed.size(), (unsigned long)syncReport.unchanged);
+    if (report) {
+        *report = syncReport;
+    }
+    return 0;
+}
+
+int ZipSerialize::zipFileNameList(const std::vector<std::string> &fileFullPathList, const std::string &rootDir, std::vector<std::string> &zipFileNames,
+                                  bool checkExists) const
+{
     //
     // 设置添加zip的文件名
     //
-    std::map<std::string, std::string> zipFileNameMap;          // {文件路径，存入zip文件名}
-    for (auto fileFullPath : fileFullPathList)
+    zipFileNames.clear();
+    zipFileNames.reserve(fileFullPathList.size());
+    for (const auto &fileFullPath : fileFullPathList)
     {
         if(fileFullPath.empty() || !MyUtilityLib::File::fileExists(fileFullPath)) {
             LOG_ERROR("Document file '%s' empty or does not exist.", fileFullPath.c_str());
@@ -391,58 +1700,184 @@ int ZipSerialize::addFileListByPath(const std::vector<std::string> &fileFullPath
             zipFileName = zipFileName.substr(1);
         }
 
-        zipFileNameMap[fileFullPath] = zipFileName;
+        zipFileNames.push_back(zipFileName);
     }
 
     //
-    // 判断文件是否已存在zip中
+    // 判断文件是否已存在zip中或者列表中重名
     // 若存在返回失败
     //
-    std::vector<std::string> fileList = this->list();
-    for(auto file : zipFileNameMap) {
-        LOG_DEBUG("file %s.", file.second.c_str());
-        if (fileList.end() != std::find(fileList.begin(), fileList.end(), file.second)) {
+    std::unordered_set<std::string> nameSet;
+    nameSet.reserve(zipFileNames.size());
+    for(const auto &file : zipFileNames) {
+        LOG_DEBUG("file %s.", file.c_str());
+        if ((checkExists && d && d->exists(file)) || !nameSet.insert(file).second) {
             // 文件已存在，返回失败
-            LOG_ERROR("File[%s] exist in zip.", file.second.c_str());
+            LOG_ERROR("File[%s] exist in zip.", file.c_str());
             return ERR_FILE_EXIST_ZIP;
         }
     }
 
+    return 0;
+}
+
+int ZipSerialize::addFileListByPath(const std::vector<std::string> &fileFullPathList, const std::string &rootDir,
+                                    TAG_COMPRESS_FLAG_E flags, std::vector<CompressReport> *report)
+{
+    std::vector<std::string> zipFileNames;
+    int iRet = zipFileNameList(fileFullPathList, rootDir, zipFileNames);
+    if (0 != iRet) {
+        return iRet;
+    }
+
     //
     // 添加文件到zip
     //
-    for (auto fileFullPath : fileFullPathList)
+    for (size_t i = 0; i < fileFullPathList.size(); ++i)
     {
+        const std::string &fileFullPath = fileFullPathList[i];
+
         // zip属性
         tm *filetime = MyUtilityLib::File::modifiedTime(fileFullPath);
         ZipSerialize::Properties prop = { "", *filetime, MyUtilityLib::File::fileSize(fileFullPath) };
 
-        // 输入文件流
-        std::ifstream fileStream(MyUtilityLib::File::encodeName(fileFullPath).c_str(), std::ifstream::binary);
-        if (!fileStream || !fileStream.is_open()) {
-            LOG_ERROR("Failed to open ifstream for path[%s].", fileFullPath.c_str());
-            return -1;
+        // 映射文件直接压缩, 不再拷贝到内存流
+        CompressReport fileReport;
+        iRet = addMappedFile(zipFileNames[i], fileFullPath, prop, flags, &fileReport);
+        if (0 != iRet) {
+            LOG_ERROR("Failed to add file[%s] to zip.", fileFullPath.c_str());
+            return iRet;
+        }
+
+        if (report) {
+            report->push_back(fileReport);
+        }
+    }
+
+    return 0;
+}
+
+int ZipSerialize::addFileListByPathParallel(const std::vector<std::string> &fileFullPathList, const std::string &rootDir, unsigned int threadNum,
+                                            TAG_COMPRESS_FLAG_E flags, std::vector<CompressReport> *report)
+{
+    if(!d || !d->writable()) {
+        LOG_ERROR("Zip file is not open");
+        return -1;
+    }
+
+    std::vector<std::string> zipFileNames;
+    int iRet = zipFileNameList(fileFullPathList, rootDir, zipFileNames);
+    if (0 != iRet) {
+        return iRet;
+    }
+
+    if (0 == threadNum) {
+        threadNum = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threadNum = std::min<size_t>(threadNum, fileFullPathList.size());
+
+    std::vector<DeflateEntry> entries(fileFullPathList.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        entries[i].fileFullPath = fileFullPathList[i];
+        entries[i].zipFileName = zipFileNames[i];
+        entries[i].time = *MyUtilityLib::File::modifiedTime(fileFullPathList[i]);
+        entries[i].size = MyUtilityLib::File::fileSize(fileFullPathList[i]);
+        entries[i].flags = flags;
+    }
+
+    //
+    // 工作线程按顺序领取文件压缩, 最多领先写入线程window个文件, 限制内存占用
+    //
+    const size_t window = threadNum * 2;
+    size_t next = 0;
+    size_t written = 0;
+    bool abort = false;
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    auto worker = [&]() {
+        for (;;)
+        {
+            size_t index = 0;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&]() { return abort || next >= entries.size() || next < written + window; });
+                if (abort || next >= entries.size()) {
+                    return;
+                }
+                index = next++;
+            }
+
+            DeflateEntry &entry = entries[index];
+            int result = 0;
+            if (entry.size <= MAX_MEM_FILE) {
+                result = deflateFile(entry);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                entry.result = result;
+                entry.done = true;
+            }
+            cond.notify_all();
         }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadNum);
+    for (unsigned int i = 0; i < threadNum; ++i) {
+        threads.emplace_back(worker);
+    }
 
-        int iRet = -1;
-        if(prop.size > MAX_MEM_FILE)
+    //
+    // 按列表顺序写入zip
+    //
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        DeflateEntry &entry = entries[i];
         {
-            iRet = addFile(zipFileNameMap[fileFullPath], fileStream, prop, COMPRESS_FLAG_COMPRESS);
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]() { return entry.done; });
+        }
+
+        ZipSerialize::Properties prop = { "", entry.time, entry.size };
+        CompressReport fileReport = { entry.zipFileName, entry.flags, entry.size, 0, entry.sampleRatio };
+        if (0 != entry.result) {
+            LOG_ERROR("Failed to deflate file[%s].", entry.fileFullPath.c_str());
+            iRet = entry.result;
+        } else if (entry.size > MAX_MEM_FILE || (entry.flags & COMPRESS_FLAG_DONTCOMPRESS)) {
+            // 大文件在写入线程中流式压缩, 不压缩的文件直接存储
+            iRet = addMappedFile(entry.zipFileName, entry.fileFullPath, prop, entry.flags, &fileReport);
+            if (!(entry.flags & COMPRESS_FLAG_AUTO) && entry.size <= MAX_MEM_FILE) {
+                fileReport.sampleRatio = entry.sampleRatio;             // 压缩方式已在工作线程选择, 保留采样压缩率
+            }
+        } else {
+            iRet = d->addRawFile(entry, prop, &fileReport.compressedSize);
+        }
+
+        if (0 == iRet && report) {
+            report->push_back(fileReport);
         }
-        else
+
         {
-            std::stringstream dataStream;
-            dataStream << fileStream.rdbuf();;
-            iRet = addFile(zipFileNameMap[fileFullPath], dataStream, prop, COMPRESS_FLAG_COMPRESS);
+            std::lock_guard<std::mutex> lock(mutex);
+            std::string().swap(entry.data);
+            ++written;
+            abort = (0 != iRet);
         }
+        cond.notify_all();
 
         if (0 != iRet) {
-            LOG_ERROR("Failed to add file[%s] to zip.", fileFullPath.c_str());
-            return iRet;
+            LOG_ERROR("Failed to add file[%s] to zip.", entry.fileFullPath.c_str());
+            break;
         }
     }
 
-    return 0;
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    return iRet;
 }
 
 int ZipSerialize::extractAllFile(const std::string &dstPath)
@@ -471,3 +1906,98 @@ int ZipSerialize::extractAllFile(const std::string &dstPath)
 
     return 0;
 }
+
+int ZipSerialize::extractAllFileParallel(const std::string &dstPath, unsigned int threadNum)
+{
+    if(!d || !d->open) {
+        LOG_ERROR("Zip file is not open");
+        return -1;
+    }
+
+    const std::vector<std::string> &fileList = d->names;
+    if (fileList.empty()) {
+        LOG_ERROR("Failed to get file list.");
+        return -1;
+    }
+
+    //
+    // 先统一创建目录, 目录项('/'结尾)只创建目录
+    //
+    std::unordered_set<std::string> dirSet;
+    std::vector<size_t> fileIndexList;
+    fileIndexList.reserve(fileList.size());
+    for (size_t i = 0; i < fileList.size(); ++i) {
+        const std::string &file = fileList[i];
+        std::string filePath(dstPath + "/" + MyUtilityLib::File::encodeName(file));
+        if (file[file.size() - 1] == '/') {
+            dirSet.insert(filePath);
+        } else {
+            dirSet.insert(MyUtilityLib::File::directory(filePath));
+            fileIndexList.push_back(i);
+        }
+    }
+
+    for (const auto &dir : dirSet) {
+        if (0 != MyUtilityLib::File::createDirectory(dir)) {
+            LOG_ERROR("Failed to create directory[%s].", dir.c_str());
+            return -1;
+        }
+    }
+
+    if (0 == threadNum) {
+        threadNum = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threadNum = std::min<size_t>(threadNum, fileIndexList.size());
+
+    //
+    // 每个线程使用独立的unzip句柄, 按central directory偏移直接定位文件
+    //
+    std::atomic<size_t> next(0);
+    std::atomic<int> result(0);
+    auto worker = [&]() {
+        ourmemory_t readerMem;
+        zlib_filefunc64_def readerFilefunc;
+        unzFile reader = d->openReader(readerMem, readerFilefunc);
+        if (!reader) {
+            LOG_ERROR("Failed to open ZIP file '%s'.", d->path.c_str());
+            result = -1;
+            return;
+        }
+
+        size_t i = 0;
+        while (0 == result && (i = next++) < fileIndexList.size())
+        {
+            const std::string &file = fileList[fileIndexList[i]];
+            int iRet = unzSetOffset64(reader, d->index.at(file).offset);
+            if (UNZ_OK == iRet) {
+                std::string filePath(dstPath + "/" + MyUtilityLib::File::encodeName(file));
+                std::ofstream ofs(filePath, std::ofstream::binary);
+                if (!ofs || !ofs.is_open()) {
+                    LOG_ERROR("Failed to ofstream file[%s].", filePath.c_str());
+                    iRet = -1;
+                } else {
+                    iRet = readCurrentFile(reader, d->password, file, ofs);
+                }
+            }
+
+            if (0 != iRet) {
+                LOG_ERROR("Failed to extract file: %s.", file.c_str());
+                int expected = 0;
+                result.compare_exchange_strong(expected, iRet);
+            }
+        }
+
+        unzClose(reader);
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadNum);
+    for (unsigned int i = 0; i < threadNum; ++i) {
+        threads.emplace_back(worker);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    return result;
+}
@@ -2,11 +2,15 @@
 
 #include <time.h>
 
+#include <functional>
+#include <iosfwd>
 #include <string>
 #include <vector>
 
 #include "Exports.h"
 
+#include "ZipSeekIndex.h"
+
 #define MAX_MEM_FILE 200 * 1024 * 1024
 
 #define ERR_FILE_EXIST_ZIP      100             // 要添加的文件已经在zip中、重名了
@@ -17,30 +21,166 @@ class ZipSerialize
 public:
     struct Properties { std::string comment; tm time; unsigned long size; };
 
+    // 流式zip输出回调, 返回false表示输出失败
+    typedef std::function<bool(const char *data, size_t size)> WriteCallback;
+
     // 压缩方式
     enum TAG_COMPRESS_FLAG_E {
         COMPRESS_FLAG_COMPRESS     = 0,
         COMPRESS_FLAG_DONTCOMPRESS = 1,
+        COMPRESS_FLAG_FAST         = 2,         // 最快压缩级别
+        COMPRESS_FLAG_BEST         = 4,         // 最高压缩级别
+        COMPRESS_FLAG_AUTO         = 8,         // 按扩展名和采样试压缩结果选择以上方式, 只用于按路径添加文件
 
         COMPRESS_FLAG_MAX          = 0xFF
     };
 
+    // 按路径添加文件时每个文件的压缩结果
+    struct CompressReport
+    {
+        std::string file;                   // zip中文件名
+        TAG_COMPRESS_FLAG_E flag;           // 实际使用的压缩方式
+        unsigned long size;                 // 原始大小
+        unsigned long compressedSize;       // 压缩后大小
+        double sampleRatio;                 // COMPRESS_FLAG_AUTO采样压缩率
+    };
+
+    // 目录同步结果
+    struct SyncReport
+    {
+        std::vector<std::string> added;     // 新增的文件
+        std::vector<std::string> updated;   // 内容改变重新压缩的文件
+        std::vector<std::string> removed;   // 目录中已删除、从zip中去掉的文件
+        size_t unchanged;                   // 未改变、直接拷贝压缩数据的文件数
+    };
+
 public:
     ZipSerialize(const std::string &path, const char *password = nullptr) noexcept;
+
+    /**
+     * @brief 从内存读取zip, 只读方式, 不能添加文件
+     * @param [IN] data         zip数据, 对象析构前必须有效
+     * @param [IN] size         zip数据长度
+     * @param [IN] password     解压密码, 没有密码传nullptr
+     */
+    ZipSerialize(const char *data, size_t size, const char *password) noexcept;
+
+    /**
+     * @brief 在内存中创建zip
+     * @param [OUT] outBuf      save()或者析构后保存生成的zip数据
+     * @param [IN] password     压缩密码
+     */
+    ZipSerialize(std::string *outBuf, const char *password = nullptr) noexcept;
+
+    /**
+     * @brief 流式生成zip, 只追加输出, 适用于不可seek的输出(如mg_send_chunk)
+     * @param [IN] writer       输出回调
+     * @note
+     * 文件使用data descriptor记录crc和大小, 不压缩的文件使用deflate存储块, save()或析构时输出central directory;
+     * 不支持密码, 不能list/extract
+     */
+    explicit ZipSerialize(const WriteCallback &writer) noexcept;
+    explicit ZipSerialize(std::ostream &os) noexcept;
     ~ZipSerialize() noexcept;
     operator bool() const noexcept;
 
     std::vector<std::string> list() const;
     int extract(const std::string &file, std::ostream &os) const;
+
+    /**
+     * @brief 解压文件中[offset, offset + size)部分到输出流
+     * @param [IN] file         zip中文件名
+     * @param [IN] offset       解压数据偏移
+     * @param [IN] size         长度, 超过文件结尾时截断
+     * @param [OUT] os          输出流
+     * @return int
+     * @note
+     * 存储方式直接按偏移读取; deflate压缩从buildSeekIndex/loadSeekIndex建立的
+     * 最近访问点开始解压, 没有索引时从头解压; 加密文件从头解压并丢弃offset之前的数据
+     */
+    int extractRange(const std::string &file, unsigned long long offset, unsigned long long size, std::ostream &os) const;
+
+    /**
+     * @brief 为deflate压缩的文件建立随机访问索引, 每span字节解压数据一个访问点(保存32K窗口)
+     * @param [IN] file         zip中文件名, 不支持加密文件
+     * @param [IN] span         访问点间隔
+     * @return int
+     */
+    int buildSeekIndex(const std::string &file, unsigned long span = SEEK_INDEX_SPAN);
+
+    /**
+     * @brief 保存/读取文件的随机访问索引, 可以作为zip外的附属文件, 文件内容改变后读取失败
+     * @return int
+     */
+    int saveSeekIndex(const std::string &file, std::ostream &os) const;
+    int loadSeekIndex(const std::string &file, std::istream &is);
+
     int addFile(const std::string &containerPath, std::istream &is, const Properties &prop, TAG_COMPRESS_FLAG_E flags = COMPRESS_FLAG_COMPRESS);
+    int addFile(const std::string &containerPath, const char *data, size_t size, const Properties &prop, TAG_COMPRESS_FLAG_E flags = COMPRESS_FLAG_COMPRESS);
     int properties(const std::string &file, Properties &prop) const;
     int save();
 
     int addFileByPath(const std::string &fileFullPath);
-    int addFileListByPath(const std::vector<std::string> &fileFullPathList, const std::string &rootDir = "");
+
+    /**
+     * @brief 增量同步目录到zip, 用于定期刷新大目录的归档
+     * @param [IN] dir              目录, zip中保存相对路径
+     * @param [IN] manifestPath     同步清单路径, 为空时使用zip路径 + ".manifest"
+     * @param [IN] flags            新增和改变的文件的压缩方式
+     * @param [OUT] report          同步结果, 不需要时传nullptr
+     * @return int
+     * @note
+     * 清单记录每个文件的(路径, 大小, 修改时间, crc), 大小和修改时间与清单一致的文件不读取内容,
+     * 只有修改时间改变的文件计算crc与zip比较; 未改变的文件直接拷贝压缩数据, 不重新压缩。
+     * 只有新增文件时以添加方式打开原zip写入新文件; 有修改或删除时写入临时zip再替换原zip(重写central directory),
+     * 没有改变时不修改zip。zip中不在目录中的文件会被删除, 目录项('/'结尾)保留; 只支持磁盘上的zip文件
+     */
+    int syncDirectory(const std::string &dir, const std::string &manifestPath = "",
+                      TAG_COMPRESS_FLAG_E flags = COMPRESS_FLAG_COMPRESS, SyncReport *report = nullptr);
+
+    /**
+     * @brief 添加文件列表到zip
+     * @param [IN] fileFullPathList     文件路径列表
+     * @param [IN] rootDir              根目录, 为空时zip中只保存文件名
+     * @param [IN] flags                压缩方式, COMPRESS_FLAG_AUTO按文件内容选择
+     * @param [OUT] report              每个文件的压缩方式和压缩后大小, 不需要时传nullptr
+     * @return int
+     */
+    int addFileListByPath(const std::vector<std::string> &fileFullPathList, const std::string &rootDir = "",
+                          TAG_COMPRESS_FLAG_E flags = COMPRESS_FLAG_COMPRESS, std::vector<CompressReport> *report = nullptr);
+
+    /**
+     * @brief 多线程压缩添加文件列表到zip
+     * @param [IN] fileFullPathList     文件路径列表
+     * @param [IN] rootDir              根目录, 为空时zip中只保存文件名
+     * @param [IN] threadNum            压缩线程数, 0: 使用CPU核数
+     * @param [IN] flags                压缩方式, COMPRESS_FLAG_AUTO在工作线程中按文件内容选择
+     * @param [OUT] report              每个文件的压缩方式和压缩后大小, 不需要时传nullptr
+     * @return int
+     * @note
+     * 工作线程各自deflate压缩并计算CRC32, 再按列表顺序以raw方式写入zip,
+     * 相同顺序下输出与addFileListByPath一致; 超过MAX_MEM_FILE的文件在写入线程中压缩, 避免缓存整个压缩结果
+     */
+    int addFileListByPathParallel(const std::vector<std::string> &fileFullPathList, const std::string &rootDir = "", unsigned int threadNum = 0,
+                                  TAG_COMPRESS_FLAG_E flags = COMPRESS_FLAG_COMPRESS, std::vector<CompressReport> *report = nullptr);
     int extractAllFile(const std::string &dstPath);
 
+    /**
+     * @brief 多线程解压zip中所有文件到目录
+     * @param [IN] dstPath      解压目录
+     * @param [IN] threadNum    解压线程数, 0: 使用CPU核数
+     * @return int
+     * @note
+     * 预先创建全部目录, 每个线程打开独立的unzip句柄按索引偏移定位文件
+     */
+    int extractAllFileParallel(const std::string &dstPath, unsigned int threadNum = 0);
+
 private:
+    int addMappedFile(const std::string &containerPath, const std::string &fileFullPath, const Properties &prop,
+                      TAG_COMPRESS_FLAG_E flags, CompressReport *report = nullptr);
+    int zipFileNameList(const std::vector<std::string> &fileFullPathList, const std::string &rootDir, std::vector<std::string> &zipFileNames,
+                        bool checkExists = true) const;
+
     DISABLE_COPY(ZipSerialize);
     ZipSerializePrivate *d;
 };
@@ -0,0 +1,416 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include "MyLog.h"
+
+#include "minizip/zip.h"
+
+#include "ZipStreamWriter.h"
+
+#define STREAM_BUFFER_SIZE          (64 * 1024)
+
+#define LOCAL_HEADER_MAGIC          0x04034b50
+#define DATA_DESCRIPTOR_MAGIC       0x08074b50
+#define CENTRAL_HEADER_MAGIC        0x02014b50
+#define ZIP64_END_MAGIC             0x06064b50
+#define ZIP64_LOCATOR_MAGIC         0x07064b50
+#define END_HEADER_MAGIC            0x06054b50
+
+#define FLAG_DATA_DESCRIPTOR        0x0008
+#define FLAG_UTF8                   0x0800
+
+#define VERSION_DEFAULT             20
+#define VERSION_ZIP64               45
+
+#define MAX_UINT16                  0xffff
+#define MAX_UINT32                  0xffffffffULL
+
+namespace
+{
+
+// zip中整数都是little-endian
+void putValue(std::string &buf, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i) {
+        buf.push_back(char(value & 0xff));
+        value >>= 8;
+    }
+}
+
+} /* namespace */
+
+ZipStreamWriter::ZipStreamWriter(const WriteCallback &writer)
+    : m_writer(writer), m_offset(0), m_stream(), m_inEntry(false), m_streamInit(false), m_finished(false), m_error(false)
+{
+    m_buf.reserve(STREAM_BUFFER_SIZE);
+}
+
+ZipStreamWriter::~ZipStreamWriter()
+{
+    if (m_streamInit) {
+        deflateEnd(&m_stream);
+    }
+}
+
+int ZipStreamWriter::output(const void *data, size_t size)
+{
+    if (m_error) {
+        return -1;
+    }
+
+    const char *p = (const char *)data;
+    m_offset += size;
+    while (size > 0)
+    {
+        size_t len = std::min(size, STREAM_BUFFER_SIZE - m_buf.size());
+        m_buf.insert(m_buf.end(), p, p + len);
+        p += len;
+        size -= len;
+
+        if (m_buf.size() >= STREAM_BUFFER_SIZE && 0 != flush()) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int ZipStreamWriter::flush()
+{
+    if (m_error) {
+        return -1;
+    }
+
+    if (!m_buf.empty()) {
+        if (!m_writer || !m_writer(m_buf.data(), m_buf.size())) {
+            LOG_ERROR("Failed to write %lu bytes to zip stream.", (unsigned long)m_buf.size());
+            m_error = true;
+            return -1;
+        }
+        m_buf.clear();
+    }
+
+    return 0;
+}
+
+int ZipStreamWriter::writeLocalHeader(Entry &entry, int level, bool zip64)
+{
+    entry.zip64 = zip64;
+    entry.flag = FLAG_DATA_DESCRIPTOR | FLAG_UTF8;
+    if (Z_DEFLATED == entry.method) {
+        // 与minizip相同的压缩级别标志
+        if (level == 8 || level == 9)
+            entry.flag |= 2;
+        if (level == 2)
+            entry.flag |= 4;
+        if (level == 1)
+            entry.flag |= 6;
+    }
+    entry.offset = m_offset;
+
+    // zip64: 流式读取(unzip -、Java ZipInputStream)按本地文件头的zip64 extra决定data descriptor中大小的宽度,
+    // 大小未知时写入大小为0的zip64 extra, data descriptor使用8字节大小
+    std::string extra;
+    if (zip64) {
+        putValue(extra, 0x0001, 2);
+        putValue(extra, 16, 2);
+        putValue(extra, 0, 8);
+        putValue(extra, 0, 8);
+    }
+
+    // crc和大小为0, 实际值在data descriptor中
+    std::string header;
+    header.reserve(30 + entry.name.size() + extra.size());
+    putValue(header, LOCAL_HEADER_MAGIC, 4);
+    putValue(header, zip64 ? VERSION_ZIP64 : VERSION_DEFAULT, 2);
+    putValue(header, entry.flag, 2);
+    putValue(header, entry.method, 2);
+    putValue(header, entry.dosDate, 4);
+    putValue(header, 0, 4);
+    putValue(header, 0, 4);
+    putValue(header, 0, 4);
+    putValue(header, entry.name.size(), 2);
+    putValue(header, extra.size(), 2);
+    header += entry.name;
+    header += extra;
+    return output(header.data(), header.size());
+}
+
+int ZipStreamWriter::writeDataDescriptor(const Entry &entry)
+{
+    std::string descriptor;
+    putValue(descriptor, DATA_DESCRIPTOR_MAGIC, 4);
+    putValue(descriptor, entry.crc, 4);
+    if (entry.zip64) {
+        // zip64 data descriptor, 与本地文件头一致
+        putValue(descriptor, entry.compressedSize, 8);
+        putValue(descriptor, entry.uncompressedSize, 8);
+    } else {
+        putValue(descriptor, entry.compressedSize, 4);
+        putValue(descriptor, entry.uncompressedSize, 4);
+    }
+    return output(descriptor.data(), descriptor.size());
+}
+
+int ZipStreamWriter::openEntry(const std::string &name, const std::string &comment, uLong dosDate, int method, int level)
+{
+    if (m_finished || m_inEntry || m_error) {
+        LOG_ERROR("Zip stream can not add file[%s].", name.c_str());
+        return -1;
+    }
+
+    if (name.size() > MAX_UINT16 || comment.size() > MAX_UINT16) {
+        LOG_ERROR("File name or comment of [%s] too long.", name.c_str());
+        return -1;
+    }
+
+    Entry entry = Entry();
+    entry.name = name;
+    entry.comment = comment;
+    entry.dosDate = dosDate;
+    entry.method = Z_DEFLATED;
+    entry.crc = crc32(0L, Z_NULL, 0);
+
+    // 存储方式使用data descriptor时流式读取无法确定数据结尾(Java ZipInputStream拒绝),
+    // 大小未知时改为不压缩级别的deflate, 输出deflate存储块
+    if (Z_DEFLATED != method) {
+        level = Z_NO_COMPRESSION;
+    }
+
+    m_stream = z_stream();
+    int zResult = deflateInit2(&m_stream, level, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+    if (zResult != Z_OK) {
+        LOG_ERROR("Failed to init deflate stream. ZLib LOG_ERROR: %d", zResult);
+        return -1;
+    }
+    m_streamInit = true;
+
+    m_entries.push_back(entry);
+    m_inEntry = true;
+
+    // 大小未知, 可能超过4G
+    return writeLocalHeader(m_entries.back(), level, true);
+}
+
+int ZipStreamWriter::writeEntry(const char *data, size_t size)
+{
+    if (!m_inEntry || m_error) {
+        return -1;
+    }
+
+    Entry &entry = m_entries.back();
+    entry.uncompressedSize += size;
+    while (size > 0)
+    {
+        uInt len = uInt(std::min<size_t>(size, 1024 * 1024 * 1024));
+        entry.crc = crc32(entry.crc, (const Bytef *)data, len);
+
+        char buf[STREAM_BUFFER_SIZE];
+        m_stream.next_in = (Bytef *)data;
+        m_stream.avail_in = len;
+        do
+        {
+            m_stream.next_out = (Bytef *)buf;
+            m_stream.avail_out = sizeof(buf);
+            int zResult = deflate(&m_stream, Z_NO_FLUSH);
+            if (zResult != Z_OK && zResult != Z_BUF_ERROR) {
+                LOG_ERROR("Failed to deflate file[%s]. ZLib LOG_ERROR: %d", entry.name.c_str(), zResult);
+                return -1;
+            }
+
+            size_t have = sizeof(buf) - m_stream.avail_out;
+            entry.compressedSize += have;
+            if (0 != output(buf, have)) {
+                return -1;
+            }
+        } while (0 != m_stream.avail_in || 0 == m_stream.avail_out);
+
+        data += len;
+        size -= len;
+    }
+
+    return 0;
+}
+
+int ZipStreamWriter::closeEntry()
+{
+    if (!m_inEntry) {
+        return -1;
+    }
+
+    m_inEntry = false;
+    Entry &entry = m_entries.back();
+    char buf[STREAM_BUFFER_SIZE];
+    int zResult = Z_OK;
+    m_stream.next_in = Z_NULL;
+    m_stream.avail_in = 0;
+    do
+    {
+        m_stream.next_out = (Bytef *)buf;
+        m_stream.avail_out = sizeof(buf);
+        zResult = deflate(&m_stream, Z_FINISH);
+        if (zResult != Z_OK && zResult != Z_STREAM_END) {
+            LOG_ERROR("Failed to deflate file[%s]. ZLib LOG_ERROR: %d", entry.name.c_str(), zResult);
+            break;
+        }
+
+        size_t have = sizeof(buf) - m_stream.avail_out;
+        entry.compressedSize += have;
+        if (0 != output(buf, have)) {
+            zResult = Z_ERRNO;
+            break;
+        }
+    } while (zResult != Z_STREAM_END);
+
+    if (Z_TEXT == m_stream.data_type) {
+        entry.internalAttr = Z_TEXT;
+    }
+    deflateEnd(&m_stream);
+    m_streamInit = false;
+
+    if (zResult != Z_STREAM_END) {
+        m_error = true;
+        return -1;
+    }
+
+    if (0 != writeDataDescriptor(entry)) {
+        return -1;
+    }
+
+    // 每个文件结束后输出, 接收方尽早拿到数据
+    return flush();
+}
+
+int ZipStreamWriter::addRawEntry(const std::string &name, const std::string &comment, uLong dosDate, int level,
+                                 const char *data, size_t size, uint64_t uncompressedSize, uLong crc, bool text)
+{
+    if (m_finished || m_inEntry || m_error) {
+        LOG_ERROR("Zip stream can not add file[%s].", name.c_str());
+        return -1;
+    }
+
+    if (name.size() > MAX_UINT16 || comment.size() > MAX_UINT16) {
+        LOG_ERROR("File name or comment of [%s] too long.", name.c_str());
+        return -1;
+    }
+
+    Entry entry = Entry();
+    entry.name = name;
+    entry.comment = comment;
+    entry.dosDate = dosDate;
+    entry.method = Z_DEFLATED;
+    entry.internalAttr = text ? Z_TEXT : 0;
+    entry.crc = crc;
+    entry.compressedSize = size;
+    entry.uncompressedSize = uncompressedSize;
+    m_entries.push_back(entry);
+
+    bool zip64 = entry.compressedSize >= MAX_UINT32 || entry.uncompressedSize >= MAX_UINT32;
+    if (0 != writeLocalHeader(m_entries.back(), level, zip64) || 0 != output(data, size)
+            || 0 != writeDataDescriptor(m_entries.back())) {
+        return -1;
+    }
+
+    return flush();
+}
+
+int ZipStreamWriter::finish()
+{
+    if (m_finished) {
+        return 0;
+    }
+
+    if (m_inEntry && 0 != closeEntry()) {
+        return -1;
+    }
+    m_finished = true;
+
+    //
+    // central directory
+    //
+    uint64_t centralOffset = m_offset;
+    for (const auto &entry : m_entries)
+    {
+        std::string zip64Extra;
+        if (entry.uncompressedSize >= MAX_UINT32)
+            putValue(zip64Extra, entry.uncompressedSize, 8);
+        if (entry.compressedSize >= MAX_UINT32)
+            putValue(zip64Extra, entry.compressedSize, 8);
+        if (entry.offset >= MAX_UINT32)
+            putValue(zip64Extra, entry.offset, 8);
+
+        std::string extra;
+        if (!zip64Extra.empty()) {
+            putValue(extra, 0x0001, 2);
+            putValue(extra, zip64Extra.size(), 2);
+            extra += zip64Extra;
+        }
+
+        uint16_t version = uint16_t(extra.empty() && !entry.zip64 ? VERSION_DEFAULT : VERSION_ZIP64);
+        std::string header;
+        header.reserve(46 + entry.name.size() + extra.size() + entry.comment.size());
+        putValue(header, CENTRAL_HEADER_MAGIC, 4);
+        putValue(header, version, 2);                                           // version made by
+        putValue(header, version, 2);                                           // version needed
+        putValue(header, entry.flag, 2);
+        putValue(header, entry.method, 2);
+        putValue(header, entry.dosDate, 4);
+        putValue(header, entry.crc, 4);
+        putValue(header, std::min<uint64_t>(entry.compressedSize, MAX_UINT32), 4);
+        putValue(header, std::min<uint64_t>(entry.uncompressedSize, MAX_UINT32), 4);
+        putValue(header, entry.name.size(), 2);
+        putValue(header, extra.size(), 2);
+        putValue(header, entry.comment.size(), 2);
+        putValue(header, 0, 2);                                                 // disk number
+        putValue(header, entry.internalAttr, 2);
+        putValue(header, 0, 4);                                                 // external attributes
+        putValue(header, std::min<uint64_t>(entry.offset, MAX_UINT32), 4);
+        header += entry.name;
+        header += extra;
+        header += entry.comment;
+        if (0 != output(header.data(), header.size())) {
+            return -1;
+        }
+    }
+
+    uint64_t centralSize = m_offset - centralOffset;
+    uint64_t entryNum = m_entries.size();
+
+    //
+    // zip64 end of central directory
+    //
+    std::string end;
+    if (entryNum >= MAX_UINT16 || centralSize >= MAX_UINT32 || centralOffset >= MAX_UINT32) {
+        uint64_t zip64EndOffset = m_offset;
+        putValue(end, ZIP64_END_MAGIC, 4);
+        putValue(end, 44, 8);                   // 记录剩余长度
+        putValue(end, VERSION_ZIP64, 2);
+        putValue(end, VERSION_ZIP64, 2);
+        putValue(end, 0, 4);
+        putValue(end, 0, 4);
+        putValue(end, entryNum, 8);
+        putValue(end, entryNum, 8);
+        putValue(end, centralSize, 8);
+        putValue(end, centralOffset, 8);
+
+        putValue(end, ZIP64_LOCATOR_MAGIC, 4);
+        putValue(end, 0, 4);
+        putValue(end, zip64EndOffset, 8);
+        putValue(end, 1, 4);
+    }
+
+    putValue(end, END_HEADER_MAGIC, 4);
+    putValue(end, 0, 2);
+    putValue(end, 0, 2);
+    putValue(end, std::min<uint64_t>(entryNum, MAX_UINT16), 2);
+    putValue(end, std::min<uint64_t>(entryNum, MAX_UINT16), 2);
+    putValue(end, std::min<uint64_t>(centralSize, MAX_UINT32), 4);
+    putValue(end, std::min<uint64_t>(centralOffset, MAX_UINT32), 4);
+    putValue(end, 0, 2);                        // zip注释长度
+    if (0 != output(end.data(), end.size())) {
+        return -1;
+    }
+
+    return flush();
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "minizip/zlib.h"
+
+#include "Exports.h"
+
+/**
+ * @brief 只追加写入的zip生成器, 用于不可seek的输出(http chunk、管道等)
+ * @note
+ * 本地文件头设置data descriptor标志(bit 3), crc和大小写在文件数据之后,
+ * 所有文件写完后输出central directory, 超过4G的文件和偏移使用zip64记录。
+ * 大小未知的文件(openEntry)本地文件头带zip64 extra, data descriptor使用8字节大小,
+ * 流式读取时按本地文件头即可确定data descriptor格式。
+ * 流式读取只能按deflate结尾确定数据长度, 所有文件都使用deflate, 要求存储时使用不压缩级别(deflate存储块)。
+ * 内存中只保存每个文件的central directory信息, 与zip总大小无关。
+ */
+class ZipStreamWriter
+{
+public:
+    // 输出回调, 返回false表示输出失败
+    typedef std::function<bool(const char *data, size_t size)> WriteCallback;
+
+public:
+    explicit ZipStreamWriter(const WriteCallback &writer);
+    ~ZipStreamWriter();
+
+    /**
+     * @brief 开始写入新文件
+     * @param [IN] name         zip中文件名(utf-8)
+     * @param [IN] comment      文件注释
+     * @param [IN] dosDate      dos格式修改时间
+     * @param [IN] method       0: 存储(使用不压缩级别的deflate), Z_DEFLATED: deflate压缩
+     * @param [IN] level        压缩级别
+     * @return int
+     */
+    int openEntry(const std::string &name, const std::string &comment, uLong dosDate, int method, int level);
+    int writeEntry(const char *data, size_t size);
+    int closeEntry();
+
+    /**
+     * @brief 写入已经deflate压缩的文件数据
+     * @param [IN] data             raw deflate数据
+     * @param [IN] size             raw deflate数据长度
+     * @param [IN] uncompressedSize 原始数据长度
+     * @param [IN] crc              原始数据crc32
+     * @param [IN] text             deflate检测为文本数据
+     * @return int
+     */
+    int addRawEntry(const std::string &name, const std::string &comment, uLong dosDate, int level,
+                    const char *data, size_t size, uint64_t uncompressedSize, uLong crc, bool text);
+
+    /**
+     * @brief 输出central directory, 之后不能再添加文件
+     * @return int
+     */
+    int finish();
+
+    // 最后一个文件的压缩后大小
+    uint64_t lastCompressedSize() const { return m_entries.empty() ? 0 : m_entries.back().compressedSize; }
+
+private:
+    DISABLE_COPY(ZipStreamWriter);
+
+    struct Entry
+    {
+        std::string name;
+        std::string comment;
+        uLong dosDate;
+        uint16_t flag;
+        uint16_t method;
+        uint16_t internalAttr;
+        uLong crc;
+        uint64_t compressedSize;
+        uint64_t uncompressedSize;
+        uint64_t offset;                // 本地文件头偏移
+        bool zip64;                     // 本地文件头有zip64 extra, data descriptor使用8字节大小
+    };
+
+    int writeLocalHeader(Entry &entry, int level, bool zip64);
+    int writeDataDescriptor(const Entry &entry);
+    int output(const void *data, size_t size);
+    int flush();
+
+    WriteCallback m_writer;
+    std::vector<Entry> m_entries;
+    std::vector<char> m_buf;            // 输出缓冲
+    uint64_t m_offset;                  // 已输出字节数
+    z_stream m_stream;
+    bool m_inEntry;
+    bool m_streamInit;
+    bool m_finished;
+    bool m_error;
+};
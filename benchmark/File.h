@@ -0,0 +1,18 @@
+#pragma once
+
+#include "file_utility.h"
+
+namespace MyUtilityLib
+{
+
+/**
+ * 基准程序单独编译../ZipSerialize.cpp, 使用utility/file_utility.h提供MyUtilityLib::File
+ * 非Windows平台文件名不需要转换编码
+ */
+class File : public util::File
+{
+    public:
+    static std::string encodeName(const std::string &fileName) { return fileName; }
+};
+
+} /* namespace MyUtilityLib */
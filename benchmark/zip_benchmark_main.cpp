@@ -0,0 +1,392 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ZipSerialize.h"
+#include "file_utility.h"
+
+/**
+ * ZipSerialize性能基准
+ * 生成合成数据(大量小文件、大文件、不可压缩数据、文本), 按每种压缩级别测试
+ * addFileListByPath、extract、extractAllFile、list, 每项结果输出一行json到标准输出
+ * 默认大文件256MB, GB级测试使用-b 2048
+ */
+
+// 版本信息
+const char *verbose = "1.0.0";
+
+const char *main_optstring = "d:b:w:hv";
+
+const struct option main_longopts[] = {
+    {"dir",      required_argument, NULL, 'd'},
+    {"big",      required_argument, NULL, 'b'},
+    {"workload", required_argument, NULL, 'w'},
+    {"help",     no_argument,       NULL, 'h'},
+    {"version",  no_argument,       NULL, 'v'},
+    {NULL,       0,                 NULL, 0}
+};
+
+static void usage()
+{
+    std::cout << "Usage: zip_benchmark [-d <work_dir>] [-b <big_file_mb>] [-w <workload>] [-h] [-v]" << std::endl;
+    std::cout << "-d --dir work directory for generated data, default /tmp/zip_benchmark." << std::endl;
+    std::cout << "-b --big size of each big file in MB, default 256, other workloads scale with it." << std::endl;
+    std::cout << "-w --workload only run one workload: tiny, text, random, big." << std::endl;
+    std::cout << "-h --help help info." << std::endl;
+    std::cout << "-v --version version info." << std::endl;
+}
+
+namespace
+{
+
+// 测试数据
+struct Workload
+{
+    std::string name;
+    std::string dir;                    // 数据目录
+    std::vector<std::string> files;
+    uint64_t bytes;                     // 原始数据总大小
+};
+
+// 压缩级别
+struct Level
+{
+    const char *name;
+    ZipSerialize::TAG_COMPRESS_FLAG_E flag;
+};
+
+const Level LEVELS[] = {
+    { "store",   ZipSerialize::COMPRESS_FLAG_DONTCOMPRESS },
+    { "fast",    ZipSerialize::COMPRESS_FLAG_FAST },
+    { "default", ZipSerialize::COMPRESS_FLAG_COMPRESS },
+    { "best",    ZipSerialize::COMPRESS_FLAG_BEST },
+};
+
+// 固定种子的伪随机数, 每次生成相同数据
+class Random
+{
+public:
+    explicit Random(uint64_t seed) : m_state(seed * 6364136223846793005ULL + 1442695040888963407ULL) {}
+
+    uint64_t next()
+    {
+        m_state ^= m_state >> 12;
+        m_state ^= m_state << 25;
+        m_state ^= m_state >> 27;
+        return m_state * 2685821657736338717ULL;
+    }
+
+private:
+    uint64_t m_state;
+};
+
+const char *WORDS[] = {
+    "the", "zip", "serialize", "document", "archive", "central", "directory", "offset", "stream", "deflate",
+    "contract", "invoice", "signature", "certificate", "page", "image", "seal", "number", "date", "amount",
+    "customer", "account", "bank", "payment", "total", "record", "version", "status", "error", "success",
+};
+
+// 生成size字节文本或随机数据
+void generate(Random &random, bool text, size_t size, std::string &buf)
+{
+    buf.clear();
+    buf.reserve(size);
+    const size_t wordCount = sizeof(WORDS) / sizeof(WORDS[0]);
+    while (buf.size() < size)
+    {
+        uint64_t value = random.next();
+        if (text) {
+            buf.append(WORDS[value % wordCount]);
+            buf.push_back(0 == (value >> 32) % 12 ? '\n' : ' ');
+        } else {
+            buf.append((const char *)&value, sizeof(value));
+        }
+    }
+    buf.resize(size);
+}
+
+// 生成文件, 已存在且大小一致时不重新生成
+int generateFile(const std::string &path, uint64_t seed, bool text, uint64_t size)
+{
+    if (util::File::fileExists(path) && util::File::fileSize(path) == size) {
+        return 0;
+    }
+
+    util::File::createDirectory(util::File::directory(path));
+    std::ofstream ofs(path.c_str(), std::ofstream::binary | std::ofstream::trunc);
+    if (!ofs.is_open()) {
+        std::cerr << "Failed to create file " << path << std::endl;
+        return -1;
+    }
+
+    Random random(seed);
+    std::string buf;
+    const uint64_t blockSize = 1024 * 1024;
+    for (uint64_t pos = 0; pos < size; pos += blockSize)
+    {
+        generate(random, text, size_t(std::min(blockSize, size - pos)), buf);
+        if (!ofs.write(buf.data(), std::streamsize(buf.size()))) {
+            std::cerr << "Failed to write file " << path << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int addWorkloadFile(Workload &workload, const std::string &name, uint64_t seed, bool text, uint64_t size)
+{
+    std::string path = workload.dir + "/" + name;
+    if (0 != generateFile(path, seed, text, size)) {
+        return -1;
+    }
+    workload.files.push_back(path);
+    workload.bytes += size;
+    return 0;
+}
+
+/**
+ * @brief 生成测试数据
+ * @param [IN] name         tiny: 大量小文件, text: 文本, random: 不可压缩数据, big: 大文件
+ * @param [IN] bigMb        大文件MB大小
+ * @return int
+ */
+int makeWorkload(const std::string &workDir, const std::string &name, uint64_t bigMb, Workload &workload)
+{
+    const uint64_t MB = 1024 * 1024;
+    workload.name = name;
+    workload.dir = workDir + "/data/" + name;
+    workload.files.clear();
+    workload.bytes = 0;
+
+    std::cerr << "Generating workload " << name << "..." << std::endl;
+    int iRet = 0;
+    if ("tiny" == name) {
+        // 每1M大文件对应10个小文件, 最少2000个
+        uint64_t count = std::max<uint64_t>(2000, bigMb * 10);
+        for (uint64_t i = 0; i < count && 0 == iRet; ++i) {
+            std::string file = "d" + std::to_string(i % 100) + "/f" + std::to_string(i) + ".txt";
+            iRet = addWorkloadFile(workload, file, i, true, 512 + (i * 7919) % 3584);
+        }
+    } else if ("text" == name) {
+        for (uint64_t i = 0; i < 32 && 0 == iRet; ++i) {
+            iRet = addWorkloadFile(workload, "t" + std::to_string(i) + ".txt", 100000 + i, true, std::max<uint64_t>(1, bigMb / 256) * MB);
+        }
+    } else if ("random" == name) {
+        for (uint64_t i = 0; i < 4 && 0 == iRet; ++i) {
+            iRet = addWorkloadFile(workload, "r" + std::to_string(i) + ".bin", 200000 + i, false, std::max<uint64_t>(1, bigMb / 8) * MB);
+        }
+    } else if ("big" == name) {
+        for (uint64_t i = 0; i < 2 && 0 == iRet; ++i) {
+            iRet = addWorkloadFile(workload, "b" + std::to_string(i) + ".txt", 300000 + i, true, bigMb * MB);
+        }
+    } else {
+        std::cerr << "Unknown workload " << name << std::endl;
+        return -1;
+    }
+
+    return iRet;
+}
+
+// 丢弃输出, 只统计字节数
+class NullBuf : public std::streambuf
+{
+public:
+    NullBuf() : m_bytes(0) {}
+    uint64_t bytes() const { return m_bytes; }
+
+protected:
+    std::streamsize xsputn(const char *, std::streamsize n) override { m_bytes += uint64_t(n); return n; }
+    int_type overflow(int_type c) override { ++m_bytes; return traits_type::not_eof(c); }
+
+private:
+    uint64_t m_bytes;
+};
+
+// 重置进程峰值内存(linux 4.0+), 不支持时峰值为进程启动以来的最大值
+void resetPeakRss()
+{
+    FILE *fp = fopen("/proc/self/clear_refs", "w");
+    if (fp) {
+        fputs("5", fp);
+        fclose(fp);
+    }
+}
+
+long peakRssKb()
+{
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (fp) {
+        char line[256];
+        long value = -1;
+        while (fgets(line, sizeof(line), fp)) {
+            if (0 == strncmp(line, "VmHWM:", 6)) {
+                value = atol(line + 6);
+                break;
+            }
+        }
+        fclose(fp);
+        if (value >= 0) {
+            return value;
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/**
+ * @brief 执行并计时一项测试, 输出一行json
+ * @param [IN] func     测试函数, 返回0成功
+ * @return int
+ */
+int measure(const Workload &workload, const Level &level, const char *op, uint64_t entries, uint64_t bytes,
+            const std::string &zipPath, const std::function<int()> &func)
+{
+    resetPeakRss();
+    auto start = std::chrono::steady_clock::now();
+    int iRet = func();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    long rss = peakRssKb();
+    if (0 != iRet) {
+        std::cerr << "Failed to run " << op << " on workload " << workload.name << " level " << level.name << ": " << iRet << std::endl;
+    }
+
+    seconds = std::max(seconds, 1e-9);
+    char line[512];
+    snprintf(line, sizeof(line),
+             "{\"workload\":\"%s\",\"level\":\"%s\",\"op\":\"%s\",\"ok\":%s,\"entries\":%llu,\"bytes\":%llu,"
+             "\"zip_bytes\":%llu,\"seconds\":%.6f,\"mb_per_s\":%.3f,\"entries_per_s\":%.3f,\"peak_rss_kb\":%ld}",
+             workload.name.c_str(), level.name, op, 0 == iRet ? "true" : "false",
+             (unsigned long long)entries, (unsigned long long)bytes,
+             (unsigned long long)util::File::fileSize(zipPath), seconds,
+             double(bytes) / (1024.0 * 1024.0) / seconds, double(entries) / seconds, rss);
+    std::cout << line << std::endl;
+    return iRet;
+}
+
+int runWorkload(const std::string &workDir, const Workload &workload)
+{
+    int failed = 0;
+    for (const auto &level : LEVELS)
+    {
+        std::string zipPath = workDir + "/" + workload.name + "_" + level.name + ".zip";
+        std::string extractDir = workDir + "/extract";
+        remove(zipPath.c_str());
+
+        uint64_t entries = workload.files.size();
+        failed |= measure(workload, level, "add", entries, workload.bytes, zipPath, [&]() -> int {
+            ZipSerialize zip(zipPath);
+            int iRet = zip.addFileListByPath(workload.files, workload.dir, level.flag);
+            return 0 != iRet ? iRet : zip.save();
+        });
+
+        failed |= measure(workload, level, "list", entries, 0, zipPath, [&]() -> int {
+            ZipSerialize zip(zipPath);
+            return zip.list().size() == entries ? 0 : -1;
+        });
+
+        failed |= measure(workload, level, "extract", entries, workload.bytes, zipPath, [&]() -> int {
+            ZipSerialize zip(zipPath);
+            NullBuf nullBuf;
+            std::ostream os(&nullBuf);
+            for (const auto &file : zip.list()) {
+                int iRet = zip.extract(file, os);
+                if (0 != iRet) {
+                    return iRet;
+                }
+            }
+            return nullBuf.bytes() == workload.bytes ? 0 : -1;
+        });
+
+        std::string command = "rm -rf '" + extractDir + "'";
+        failed |= system(command.c_str());
+        failed |= measure(workload, level, "extractAllFile", entries, workload.bytes, zipPath, [&]() -> int {
+            ZipSerialize zip(zipPath);
+            return zip.extractAllFile(extractDir);
+        });
+        failed |= system(command.c_str());
+        remove(zipPath.c_str());
+    }
+
+    return failed ? -1 : 0;
+}
+
+} /* namespace */
+
+int main(int argc, char *argv[])
+{
+    std::string workDir = "/tmp/zip_benchmark";
+    uint64_t bigMb = 256;
+    std::vector<std::string> workloads = { "tiny", "text", "random", "big" };
+
+    int opt = 0;
+    while ((opt = getopt_long(argc, argv, main_optstring, main_longopts, NULL)) != -1) {
+        switch ((opt))
+        {
+            case 'd':
+            {
+                workDir = optarg;
+                break;
+            }
+            case 'b':
+            {
+                bigMb = strtoull(optarg, NULL, 10);
+                break;
+            }
+            case 'w':
+            {
+                workloads.assign(1, optarg);
+                break;
+            }
+            case 'h':
+            {
+                usage();
+                return 0;
+            }
+            case 'v':
+            {
+                std::cout << verbose << std::endl;
+                return 0;
+            }
+            default:
+            {
+                usage();
+                return -1;
+            }
+        }
+    }
+
+    if (0 == bigMb) {
+        usage();
+        return -1;
+    }
+
+    int nRet = 0;
+    for (const auto &name : workloads)
+    {
+        Workload workload;
+        if (0 != makeWorkload(workDir, name, bigMb, workload)) {
+            return -1;
+        }
+
+        if (0 != runWorkload(workDir, workload)) {
+            nRet = -1;
+        }
+    }
+
+    return nRet;
+}
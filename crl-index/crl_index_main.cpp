@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <getopt.h>
+
+#include <iostream>
+#include <string>
+
+#include <openssl/bn.h>
+#include <openssl/x509.h>
+
+#include "encrypt_utility.h"
+
+/**
+ * 吊销索引工具
+ * 编译crl为mmap共享的吊销索引文件(CRL_BuildIndex), 查看索引信息、查询序列号
+ */
+
+// 版本信息
+const char *verbose = "1.0.0";
+
+const char *main_optstring = "c:r:f:o:i:s:hv";
+
+const struct option main_longopts[] = {
+    {"crl",     required_argument, NULL, 'c'},
+    {"root",    required_argument, NULL, 'r'},
+    {"format",  required_argument, NULL, 'f'},
+    {"output",  required_argument, NULL, 'o'},
+    {"index",   required_argument, NULL, 'i'},
+    {"serial",  required_argument, NULL, 's'},
+    {"help",    no_argument,       NULL, 'h'},
+    {"version", no_argument,       NULL, 'v'},
+    {NULL,      0,                 NULL, 0}
+};
+
+static void usage()
+{
+    std::cout << "Usage: crl_index -c <crl> -o <index> [-r <root_cert>] [-f <format>]" << std::endl;
+    std::cout << "       crl_index -i <index> [-s <serial>]" << std::endl;
+    std::cout << "-c --crl crl file to compile." << std::endl;
+    std::cout << "-r --root root cert, check crl signature before compiling." << std::endl;
+    std::cout << "-f --format crl and root cert format: PEM, ASN1, default PEM." << std::endl;
+    std::cout << "-o --output index file to write." << std::endl;
+    std::cout << "-i --index index file to show or query." << std::endl;
+    std::cout << "-s --serial hex serial number to look up, exit 1 if revoked." << std::endl;
+    std::cout << "-h --help help info." << std::endl;
+    std::cout << "-v --version version info." << std::endl;
+}
+
+static std::string utcString(time_t t)
+{
+    char buf[32] = {0};
+    struct tm tm;
+    if (0 == t || NULL == gmtime_r(&t, &tm)) {
+        return "-";
+    }
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%SZ", &tm);
+    return buf;
+}
+
+static int showIndex(const std::string &indexPath, const std::string &serialHex)
+{
+    encryptUtil::CrlIndex index;
+    if (0 != index.open(indexPath.c_str())) {
+        std::cerr << "Failed to open index: " << indexPath << std::endl;
+        return -1;
+    }
+
+    if (serialHex.empty()) {
+        std::cout << "crl number: " << index.crlNumber() << std::endl;
+        std::cout << "last update: " << utcString(index.lastUpdate()) << std::endl;
+        std::cout << "next update: " << utcString(index.nextUpdate()) << std::endl;
+        std::cout << "revoked: " << index.count() << std::endl;
+        return 0;
+    }
+
+    BIGNUM *bn = NULL;
+    if (0 == BN_hex2bn(&bn, serialHex.c_str())) {
+        std::cerr << "Invalid serial: " << serialHex << std::endl;
+        return -1;
+    }
+    ASN1_INTEGER *serial = BN_to_ASN1_INTEGER(bn, NULL);
+    BN_free(bn);
+
+    bool revoked = false;
+    time_t revokeTime = 0;
+    int iRet = index.isRevoked(serial, revoked, &revokeTime);
+    ASN1_INTEGER_free(serial);
+    if (0 != iRet) {
+        return -1;
+    }
+
+    if (revoked) {
+        std::cout << serialHex << " revoked at " << utcString(revokeTime) << std::endl;
+        return 1;
+    }
+
+    std::cout << serialHex << " not revoked" << std::endl;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string crlPath;
+    std::string rootCertPath;
+    std::string format = "PEM";
+    std::string outputPath;
+    std::string indexPath;
+    std::string serialHex;
+
+    int opt = 0;
+    while ((opt = getopt_long(argc, argv, main_optstring, main_longopts, NULL)) != -1) {
+        switch ((opt))
+        {
+            case 'c':
+            {
+                crlPath = optarg;
+                break;
+            }
+            case 'r':
+            {
+                rootCertPath = optarg;
+                break;
+            }
+            case 'f':
+            {
+                format = optarg;
+                break;
+            }
+            case 'o':
+            {
+                outputPath = optarg;
+                break;
+            }
+            case 'i':
+            {
+                indexPath = optarg;
+                break;
+            }
+            case 's':
+            {
+                serialHex = optarg;
+                break;
+            }
+            case 'h':
+            {
+                usage();
+                return 0;
+            }
+            case 'v':
+            {
+                std::cout << verbose << std::endl;
+                return 0;
+            }
+            default:
+            {
+                usage();
+                return -1;
+            }
+        }
+    }
+
+    if (!indexPath.empty()) {
+        return showIndex(indexPath, serialHex);
+    }
+
+    if (crlPath.empty() || outputPath.empty()) {
+        usage();
+        return -1;
+    }
+
+    if (0 != encryptUtil::CRL_BuildIndexFromPath(crlPath.c_str(), outputPath.c_str(),
+                                                 rootCertPath.empty() ? NULL : rootCertPath.c_str(),
+                                                 format.c_str())) {
+        std::cerr << "Failed to build index from crl: " << crlPath << std::endl;
+        return -1;
+    }
+
+    return showIndex(outputPath, "");
+}
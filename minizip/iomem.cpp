@@ -0,0 +1,152 @@
+/* iomem.c -- IO base function header for compress/uncompress .zip
+     files using memory buffers instead of files
+     part of the MiniZip project - ( http://www.winimage.com/zLibDll/minizip.html )
+
+     For more info read MiniZip_info.txt
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zlib.h"
+#include "ioapi.h"
+#include "iomem.h"
+
+#ifndef IOMEM_BUFFERSIZE
+#define IOMEM_BUFFERSIZE (64 * 1024)
+#endif
+
+static voidpf  ZCALLBACK fopen_mem_func OF((voidpf opaque, const void* filename, int mode));
+static uLong   ZCALLBACK fread_mem_func OF((voidpf opaque, voidpf stream, void* buf, uLong size));
+static uLong   ZCALLBACK fwrite_mem_func OF((voidpf opaque, voidpf stream, const void* buf, uLong size));
+static ZPOS64_T ZCALLBACK ftell_mem_func OF((voidpf opaque, voidpf stream));
+static long    ZCALLBACK fseek_mem_func OF((voidpf opaque, voidpf stream, ZPOS64_T offset, int origin));
+static int     ZCALLBACK fclose_mem_func OF((voidpf opaque, voidpf stream));
+static int     ZCALLBACK ferror_mem_func OF((voidpf opaque, voidpf stream));
+
+static voidpf ZCALLBACK fopen_mem_func (voidpf opaque, const void* filename, int mode)
+{
+    ourmemory_t *mem = (ourmemory_t *)opaque;
+    if (mem == NULL)
+        return NULL;
+
+    if (mode & ZLIB_FILEFUNC_MODE_CREATE)
+        mem->limit = 0;             /* When writing we start with 0 bytes written */
+    else
+        mem->limit = mem->size;
+
+    mem->cur_offset = 0;
+    return mem;
+}
+
+static uLong ZCALLBACK fread_mem_func (voidpf opaque, voidpf stream, void* buf, uLong size)
+{
+    ourmemory_t *mem = (ourmemory_t *)stream;
+
+    if (mem->cur_offset >= mem->limit)
+        return 0;
+
+    if (size > mem->limit - mem->cur_offset)
+        size = (uLong)(mem->limit - mem->cur_offset);
+
+    memcpy(buf, mem->base + mem->cur_offset, size);
+    mem->cur_offset += size;
+    return size;
+}
+
+static uLong ZCALLBACK fwrite_mem_func (voidpf opaque, voidpf stream, const void* buf, uLong size)
+{
+    ourmemory_t *mem = (ourmemory_t *)stream;
+    ZPOS64_T end = mem->cur_offset + size;
+
+    if (end > mem->size)
+    {
+        ZPOS64_T newsize;
+        char *newbase;
+
+        if (!mem->grow)
+        {
+            if (mem->cur_offset >= mem->size)
+                return 0;
+            size = (uLong)(mem->size - mem->cur_offset);
+            end = mem->size;
+        }
+        else
+        {
+            /* Grow geometrically so that many small writes stay amortized O(1) */
+            newsize = mem->size ? mem->size : IOMEM_BUFFERSIZE;
+            while (newsize < end)
+                newsize *= 2;
+
+            newbase = (char *)realloc(mem->base, (size_t)newsize);
+            if (newbase == NULL)
+                return 0;
+
+            mem->base = newbase;
+            mem->size = newsize;
+        }
+    }
+
+    memcpy(mem->base + mem->cur_offset, buf, size);
+    mem->cur_offset = end;
+    if (mem->cur_offset > mem->limit)
+        mem->limit = mem->cur_offset;
+
+    return size;
+}
+
+static ZPOS64_T ZCALLBACK ftell_mem_func (voidpf opaque, voidpf stream)
+{
+    ourmemory_t *mem = (ourmemory_t *)stream;
+    return mem->cur_offset;
+}
+
+static long ZCALLBACK fseek_mem_func (voidpf opaque, voidpf stream, ZPOS64_T offset, int origin)
+{
+    ourmemory_t *mem = (ourmemory_t *)stream;
+    ZPOS64_T new_pos;
+    switch (origin)
+    {
+    case ZLIB_FILEFUNC_SEEK_CUR :
+        new_pos = mem->cur_offset + offset;
+        break;
+    case ZLIB_FILEFUNC_SEEK_END :
+        new_pos = mem->limit + offset;
+        break;
+    case ZLIB_FILEFUNC_SEEK_SET :
+        new_pos = offset;
+        break;
+    default: return -1;
+    }
+
+    if (new_pos > mem->size && !mem->grow)
+        return 1;               /* Failed to seek that far */
+
+    mem->cur_offset = new_pos;
+    return 0;
+}
+
+static int ZCALLBACK fclose_mem_func (voidpf opaque, voidpf stream)
+{
+    /* The memory is owned by the caller */
+    return 0;
+}
+
+static int ZCALLBACK ferror_mem_func (voidpf opaque, voidpf stream)
+{
+    /* We never return errors */
+    return 0;
+}
+
+void fill_memory_filefunc64 (zlib_filefunc64_def* pzlib_filefunc_def, ourmemory_t *ourmem)
+{
+    pzlib_filefunc_def->zopen64_file = fopen_mem_func;
+    pzlib_filefunc_def->zread_file = fread_mem_func;
+    pzlib_filefunc_def->zwrite_file = fwrite_mem_func;
+    pzlib_filefunc_def->ztell64_file = ftell_mem_func;
+    pzlib_filefunc_def->zseek64_file = fseek_mem_func;
+    pzlib_filefunc_def->zclose_file = fclose_mem_func;
+    pzlib_filefunc_def->zerror_file = ferror_mem_func;
+    pzlib_filefunc_def->opaque = ourmem;
+}
@@ -0,0 +1,38 @@
+/* iomem.h -- IO base function header for compress/uncompress .zip
+     files using memory buffers instead of files
+     part of the MiniZip project - ( http://www.winimage.com/zLibDll/minizip.html )
+
+     For more info read MiniZip_info.txt
+
+*/
+
+#ifndef _ZLIBIOMEM_H
+#define _ZLIBIOMEM_H
+
+#include "ioapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ourmemory_s {
+    char *base;             /* Base of the region of memory we're using */
+    ZPOS64_T size;          /* Size of the region of memory we're using */
+    ZPOS64_T limit;         /* Furthest we've written */
+    ZPOS64_T cur_offset;    /* Current offset in the area */
+    int grow;               /* Growable memory buffer, base is allocated with malloc/realloc */
+} ourmemory_t;
+
+/*
+  Read mode: set base/size to the archive buffer and grow to 0, the buffer is never modified.
+  Write mode: set base to NULL, size to 0 and grow to 1, the buffer is allocated on demand
+  and the archive is [base, base + limit) after zipClose. The caller frees base with free().
+  The filename passed to zipOpen2_64/unzOpen2_64 is ignored.
+*/
+void fill_memory_filefunc64 OF((zlib_filefunc64_def* pzlib_filefunc_def, ourmemory_t *ourmem));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1883,6 +1883,30 @@ int Write_GlobalComment(zip64_internal* zi, const char* global_comment)
   return err;
 }
 
+extern int ZEXPORT zipGetLastFileSize (zipFile file, ZPOS64_T* compressed_size, ZPOS64_T* uncompressed_size)
+{
+    zip64_internal* zi;
+
+    if (file == NULL)
+        return ZIP_PARAMERROR;
+    zi = (zip64_internal*)file;
+
+    if (zi->in_opened_file_inzip == 1)
+        return ZIP_PARAMERROR;
+
+    if (compressed_size != NULL)
+    {
+        *compressed_size = zi->ci.totalCompressedData;
+#    ifndef NOCRYPT
+        *compressed_size += zi->ci.crypt_header_size;
+#    endif
+    }
+    if (uncompressed_size != NULL)
+        *uncompressed_size = zi->ci.raw ? 0 : zi->ci.totalUncompressedData;
+
+    return ZIP_OK;
+}
+
 extern int ZEXPORT zipClose (zipFile file, const char* global_comment)
 {
     zip64_internal* zi;
@@ -330,6 +330,15 @@ extern int ZEXPORT zipCloseFileInZipRaw64 OF((zipFile file,
   uncompressed_size and crc32 are value for the uncompressed size
 */
 
+extern int ZEXPORT zipGetLastFileSize OF((zipFile file,
+                                          ZPOS64_T* compressed_size,
+                                          ZPOS64_T* uncompressed_size));
+/*
+  Get the sizes of the file closed by the last zipCloseFileInZip call,
+    compressed_size includes the encryption header
+  For raw files uncompressed_size is not known and 0 is returned
+*/
+
 extern int ZEXPORT zipClose OF((zipFile file,
                 const char* global_comment));
 /*
@@ -0,0 +1,56 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "encrypt_utility.h"
+
+/**
+ * SM4_DAO批量接口回归测试
+ * 调用返回后立即释放输入, 工作线程池中晚开始的任务不能再访问(ASan检查use-after-free)
+ */
+
+#define TEST_ROUNDS         2000
+#define TEST_BATCH_SIZE     17          // 两个粒度多一条, 工作线程常在调用方处理完后才开始
+#define TEST_THREADS        4
+
+int main()
+{
+    encryptUtil::SM4_DAO_batch_set_threads(TEST_THREADS);
+
+    for (int round = 0; round < TEST_ROUNDS; ++round) {
+        std::vector<std::string> *inputs = new std::vector<std::string>();
+        std::vector<std::string> *passwords = new std::vector<std::string>(1, "password" + std::to_string(round % 3));
+        for (int i = 0; i < TEST_BATCH_SIZE; ++i) {
+            inputs->push_back("data " + std::to_string(round) + " " + std::to_string(i));
+        }
+
+        std::vector<std::string> encrypted;
+        std::vector<int> status;
+        int iRet = encryptUtil::SM4_DAO_encrypt_batch(*inputs, *passwords, encrypted, status);
+        std::vector<std::string> expected = *inputs;
+        std::string password = (*passwords)[0];
+        delete inputs;
+        delete passwords;
+        if (0 != iRet) {
+            std::cerr << "Failed to encrypt batch, round: " << round << std::endl;
+            return -1;
+        }
+
+        std::vector<std::string> *encryptedInputs = new std::vector<std::string>(encrypted);
+        std::vector<std::string> *decryptPasswords = new std::vector<std::string>(1, password);
+        std::vector<std::string> decrypted;
+        iRet = encryptUtil::SM4_DAO_decrypt_batch(*encryptedInputs, *decryptPasswords, decrypted, status);
+        delete encryptedInputs;
+        delete decryptPasswords;
+        if (0 != iRet || decrypted != expected) {
+            std::cerr << "Failed to decrypt batch, round: " << round << std::endl;
+            return -1;
+        }
+    }
+
+    // 让仍在排队的任务运行完, 释放后的数据被访问时ASan报错
+    encryptUtil::SM4_DAO_batch_set_threads(1);
+
+    std::cout << "sm4_dao_batch_test: ok" << std::endl;
+    return 0;
+}
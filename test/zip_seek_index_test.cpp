@@ -0,0 +1,119 @@
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "ZipSerialize.h"
+
+/**
+ * ZipSerialize随机访问索引测试
+ * 每种压缩级别建立、保存、读取索引, 从文件中间解压多个范围, 与完整解压的数据比较
+ */
+
+#define TEST_FILE_SIZE      (4 * 1024 * 1024 + 12345)
+#define TEST_SPAN           (64 * 1024)
+
+namespace
+{
+
+// 可压缩的伪随机文本, 保证生成多个deflate块
+std::string makeData(size_t size)
+{
+    static const char *WORDS[] = { "zip ", "seek ", "index ", "deflate ", "window ", "block ", "span\n", "point " };
+    std::string data;
+    data.reserve(size + 16);
+    uint64_t value = 88172645463325252ULL;
+    while (data.size() < size) {
+        value ^= value << 13;
+        value ^= value >> 7;
+        value ^= value << 17;
+        data.append(WORDS[value % 8]);
+        if (0 == value % 5) {
+            data.append(std::to_string(value % 100000));
+        }
+    }
+    data.resize(size);
+    return data;
+}
+
+int testLevel(const char *name, ZipSerialize::TAG_COMPRESS_FLAG_E flag, const std::string &data)
+{
+    std::string zipData;
+    {
+        ZipSerialize zip(&zipData);
+        time_t now = time(NULL);
+        ZipSerialize::Properties prop = { "", *localtime(&now), (unsigned long)data.size() };
+        if (0 != zip.addFile("data.txt", data.data(), data.size(), prop, flag) || 0 != zip.save()) {
+            std::cerr << name << ": failed to create zip" << std::endl;
+            return -1;
+        }
+    }
+
+    std::ostringstream indexStream;
+    {
+        ZipSerialize zip(zipData.data(), zipData.size(), nullptr);
+        std::ostringstream full;
+        if (0 != zip.extract("data.txt", full) || full.str() != data) {
+            std::cerr << name << ": full extract mismatch" << std::endl;
+            return -1;
+        }
+        if (0 != zip.buildSeekIndex("data.txt", TEST_SPAN)) {
+            std::cerr << name << ": failed to build seek index" << std::endl;
+            return -1;
+        }
+        if (0 != zip.saveSeekIndex("data.txt", indexStream)) {
+            std::cerr << name << ": failed to save seek index" << std::endl;
+            return -1;
+        }
+    }
+
+    // 每个访问点保存32K窗口, 索引只有开头访问点时说明没有建立
+    if (indexStream.str().size() < 32768) {
+        std::cerr << name << ": seek index has no access points" << std::endl;
+        return -1;
+    }
+
+    ZipSerialize zip(zipData.data(), zipData.size(), nullptr);
+    std::istringstream loadStream(indexStream.str());
+    if (0 != zip.loadSeekIndex("data.txt", loadStream)) {
+        std::cerr << name << ": failed to load seek index" << std::endl;
+        return -1;
+    }
+
+    const unsigned long long ranges[][2] = {
+        { 0, 100 },
+        { TEST_SPAN - 10, 20 },
+        { 1000000, 70000 },
+        { 2 * 1024 * 1024 + 7, 1 },
+        { 3333333, 300000 },
+        { TEST_FILE_SIZE - 50, 50 },
+        { TEST_FILE_SIZE - 50, 1000 },      // 超过结尾截断
+    };
+    for (const auto &range : ranges) {
+        std::ostringstream part;
+        if (0 != zip.extractRange("data.txt", range[0], range[1], part) || part.str() != data.substr(size_t(range[0]), size_t(range[1]))) {
+            std::cerr << name << ": range mismatch at " << range[0] << ", size " << range[1] << std::endl;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+} /* namespace */
+
+int main()
+{
+    std::string data = makeData(TEST_FILE_SIZE);
+    if (0 != testLevel("fast", ZipSerialize::COMPRESS_FLAG_FAST, data)
+        || 0 != testLevel("default", ZipSerialize::COMPRESS_FLAG_COMPRESS, data)
+        || 0 != testLevel("best", ZipSerialize::COMPRESS_FLAG_BEST, data)) {
+        return -1;
+    }
+
+    std::cout << "zip_seek_index_test: ok" << std::endl;
+    return 0;
+}
@@ -2,6 +2,21 @@
 #include <sstream>
 #include <map>
 #include<fstream>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <openssl/evp.h>
 #include <openssl/engine.h>
@@ -26,6 +41,15 @@
 #include "openssl/pkcs12.h"
 #include "openssl/opensslv.h"
 #include "openssl/ts.h"
+#include "openssl/sha.h"
+#include "openssl/hmac.h"
+#include "openssl/rand.h"
+#include "openssl/ec.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define BASE64_SIMD 1
+#include <immintrin.h>
+#endif
 
 #include "encrypt_utility.h"
 
@@ -92,106 +116,297 @@ static std::string opensslGetErrorString()
     return szErrMsg;
 }
 
-static void base64_encode(const unsigned char *src, int src_len, char *dst)
-{
-    static const char *b64 =
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    int i, j, a, b, c;
+/*
+ * Base64编解码: x86上按CPU选择AVX2/SSSE3批量处理, 剩余部分和其他平台逐组处理。
+ * 向量化算法: 编码每3字节拆成4个6位索引(乘法移位)再按范围加偏移得到字符;
+ * 解码按字符高低4位查表同时校验和求偏移, 再用乘加合并成3字节。
+ */
+static const char base64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-    for (i = j = 0; i < src_len; i += 3) {
-        a = src[i];
-        b = ((i + 1) >= src_len) ? 0 : src[i + 1];
-        c = ((i + 2) >= src_len) ? 0 : src[i + 2];
+// 字符 -> 6位值, 0xFF: 非法字符
+struct Base64DecodeTable
+{
+    unsigned char value[256];
 
-        dst[j++] = b64[a >> 2];
-        dst[j++] = b64[((a & 3) << 4) | (b >> 4)];
-        if (i + 1 < src_len) {
-            dst[j++] = b64[(b & 15) << 2 | (c >> 6)];
-        }
-        if (i + 2 < src_len) {
-            dst[j++] = b64[c & 63];
+    Base64DecodeTable()
+    {
+        memset(value, 0xFF, sizeof(value));
+        for (int i = 0; i < 64; ++i) {
+            value[(unsigned char)base64_chars[i]] = (unsigned char)i;
         }
     }
-    while (j % 4 != 0) {
-        dst[j++] = '=';
+};
+static const Base64DecodeTable base64DecodeTable;
+
+// 返回处理的输入长度, 剩余部分由调用方逐组处理
+typedef size_t (*base64_encode_func)(const unsigned char *src, size_t src_len, char *dst);
+typedef size_t (*base64_decode_func)(const unsigned char *src, size_t src_len, unsigned char *dst);
+
+#ifdef BASE64_SIMD
+#define BASE64_SSSE3_TARGET __attribute__((target("ssse3")))
+#define BASE64_AVX2_TARGET  __attribute__((target("avx2")))
+
+// 每次读16字节, 使用前12字节, 输出16字符
+BASE64_SSSE3_TARGET static size_t base64_encode_ssse3(const unsigned char *src, size_t src_len, char *dst)
+{
+    const __m128i shuffle   = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                            '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+
+    for (; i + 16 <= src_len; i += 12) {
+        __m128i in = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), shuffle);
+        __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        __m128i index = _mm_or_si128(t0, t1);
+
+        __m128i range = _mm_subs_epu8(index, _mm_set1_epi8(51));
+        range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), index), _mm_set1_epi8(13)));
+        _mm_storeu_si128((__m128i*)dst, _mm_add_epi8(_mm_shuffle_epi8(shift_lut, range), index));
+        dst += 16;
+    }
+
+    return i;
+}
+
+// 两个128位通道各处理12字节, 读28字节, 输出32字符
+BASE64_AVX2_TARGET static size_t base64_encode_avx2(const unsigned char *src, size_t src_len, char *dst)
+{
+    const __m256i shuffle   = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                               1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i shift_lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0,
+                                               'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+
+    for (; i + 28 <= src_len; i += 24) {
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src + i))),
+                                             _mm_loadu_si128((const __m128i*)(src + i + 12)), 1);
+        in = _mm256_shuffle_epi8(in, shuffle);
+        __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+        __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+        __m256i index = _mm256_or_si256(t0, t1);
+
+        __m256i range = _mm256_subs_epu8(index, _mm256_set1_epi8(51));
+        range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), index), _mm256_set1_epi8(13)));
+        _mm256_storeu_si256((__m256i*)dst, _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, range), index));
+        dst += 32;
     }
-    dst[j++] = '\0';
+
+    return i;
 }
 
-std::string Base64Encode(const char *src, size_t srcLen)
+/*
+ * 解码查表: lut_lo[低4位] & lut_hi[高4位] != 0 为非法字符('='也是非法, 留给逐组处理);
+ * lut_roll[高4位, '/'为1]是字符到6位值的偏移
+ */
+#define BASE64_LUT_LO   0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A
+#define BASE64_LUT_HI   0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+#define BASE64_LUT_ROLL 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+#define BASE64_PACK     2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+
+// 每次16字符输出12字节(写16字节), 遇到非法字符停止
+BASE64_SSSE3_TARGET static size_t base64_decode_ssse3(const unsigned char *src, size_t src_len, unsigned char *dst)
 {
-    std::string encode;
-    encode.resize(2 * srcLen);
-    base64_encode((const unsigned char*)src, srcLen, &encode[0]);
-    encode.resize(strlen(&encode[0]));
-    encode.shrink_to_fit();
+    const __m128i lut_lo   = _mm_setr_epi8(BASE64_LUT_LO);
+    const __m128i lut_hi   = _mm_setr_epi8(BASE64_LUT_HI);
+    const __m128i lut_roll = _mm_setr_epi8(BASE64_LUT_ROLL);
+    const __m128i pack     = _mm_setr_epi8(BASE64_PACK);
+    const __m128i mask     = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+
+    // 多写的4字节由后面至少8个字符的输出覆盖
+    for (; i + 16 + 8 <= src_len; i += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(in, mask));
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        if (0 != _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128()))) {
+            break;
+        }
 
-    return encode;
+        __m128i eq_2f = _mm_cmpeq_epi8(in, _mm_set1_epi8(0x2f));
+        __m128i value = _mm_add_epi8(in, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles)));
+        value = _mm_maddubs_epi16(value, _mm_set1_epi32(0x01400140));
+        value = _mm_madd_epi16(value, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi8(value, pack));
+        dst += 12;
+    }
+
+    return i;
 }
 
-static unsigned char b64reverse(char letter)
+// 每次32字符输出24字节(写32字节), 遇到非法字符停止
+BASE64_AVX2_TARGET static size_t base64_decode_avx2(const unsigned char *src, size_t src_len, unsigned char *dst)
 {
-    if ((letter >= 'A') && (letter <= 'Z')) {
-        return letter - 'A';
+    const __m256i lut_lo   = _mm256_setr_epi8(BASE64_LUT_LO, BASE64_LUT_LO);
+    const __m256i lut_hi   = _mm256_setr_epi8(BASE64_LUT_HI, BASE64_LUT_HI);
+    const __m256i lut_roll = _mm256_setr_epi8(BASE64_LUT_ROLL, BASE64_LUT_ROLL);
+    const __m256i pack     = _mm256_setr_epi8(BASE64_PACK, BASE64_PACK);
+    const __m256i permute  = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    const __m256i mask     = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+
+    // 多写的8字节由后面至少12个字符的输出覆盖
+    for (; i + 32 + 12 <= src_len; i += 32) {
+        __m256i in = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(in, mask));
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        if (!_mm256_testz_si256(lo, hi)) {
+            break;
+        }
+
+        __m256i eq_2f = _mm256_cmpeq_epi8(in, _mm256_set1_epi8(0x2f));
+        __m256i value = _mm256_add_epi8(in, _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles)));
+        value = _mm256_maddubs_epi16(value, _mm256_set1_epi32(0x01400140));
+        value = _mm256_madd_epi16(value, _mm256_set1_epi32(0x00011000));
+        value = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(value, pack), permute);
+        _mm256_storeu_si256((__m256i*)dst, value);
+        dst += 24;
     }
-    if ((letter >= 'a') && (letter <= 'z')) {
-        return letter - 'a' + 26;
+
+    return i;
+}
+
+// 0: 逐组处理, 1: SSSE3, 2: AVX2
+static int base64_cpu_level()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return 2;
     }
-    if ((letter >= '0') && (letter <= '9')) {
-        return letter - '0' + 52;
+    if (__builtin_cpu_supports("ssse3")) {
+        return 1;
     }
-    if (letter == '+') {
-        return 62;
+    return 0;
+}
+#endif
+
+// 返回编码长度, 不添加'\0'
+static size_t base64_encode(const unsigned char *src, size_t src_len, char *dst)
+{
+    size_t i = 0;
+    size_t j = 0;
+
+#ifdef BASE64_SIMD
+    static const int level = base64_cpu_level();
+    static const base64_encode_func simd = (2 == level) ? base64_encode_avx2 : (1 == level) ? base64_encode_ssse3 : NULL;
+    if (NULL != simd) {
+        i = simd(src, src_len, dst);
+        j = i / 3 * 4;
     }
-    if (letter == '/') {
-        return 63;
+#endif
+
+    for (; i + 3 <= src_len; i += 3) {
+        const unsigned int v = (src[i] << 16) | (src[i + 1] << 8) | src[i + 2];
+        dst[j++] = base64_chars[v >> 18];
+        dst[j++] = base64_chars[(v >> 12) & 63];
+        dst[j++] = base64_chars[(v >> 6) & 63];
+        dst[j++] = base64_chars[v & 63];
     }
-    if (letter == '=') {
-        return 255; /* normal end */
+
+    if (i < src_len) {
+        const unsigned int a = src[i];
+        const unsigned int b = (i + 1 < src_len) ? src[i + 1] : 0;
+        dst[j++] = base64_chars[a >> 2];
+        dst[j++] = base64_chars[((a & 3) << 4) | (b >> 4)];
+        dst[j++] = (i + 1 < src_len) ? base64_chars[(b & 15) << 2] : '=';
+        dst[j++] = '=';
     }
-    return 254; /* error */
+
+    return j;
 }
 
-static int base64_decode(const unsigned char *src, int src_len, char *dst, size_t *dst_len)
+/*
+ * 严格解码: 长度是4的倍数, 只有标准字符, '='只能出现在最后一组末尾且补位为0
+ * dst不小于src_len / 4 * 3, 成功返回0
+ */
+static int base64_decode(const unsigned char *src, size_t src_len, unsigned char *dst, size_t *dst_len)
 {
-    int i;
-    unsigned char a, b, c, d;
+    const unsigned char *t = base64DecodeTable.value;
+    size_t i = 0;
 
     *dst_len = 0;
+    if (0 != src_len % 4) {
+        return -1;
+    }
+    if (0 == src_len) {
+        return 0;
+    }
 
-    for (i = 0; i < src_len; i += 4) {
-        a = b64reverse(src[i]);
-        if (a >= 254) {
-            return i;
-        }
+    // 最后一组可能有'=', 单独处理
+    const size_t body = src_len - 4;
+    unsigned char *out = dst;
 
-        b = b64reverse(((i + 1) >= src_len) ? 0 : src[i + 1]);
-        if (b >= 254) {
-            return i + 1;
-        }
+#ifdef BASE64_SIMD
+    static const int level = base64_cpu_level();
+    static const base64_decode_func simd = (2 == level) ? base64_decode_avx2 : (1 == level) ? base64_decode_ssse3 : NULL;
+    if (NULL != simd) {
+        i = simd(src, body, dst);
+        out += i / 4 * 3;
+    }
+#endif
 
-        c = b64reverse(((i + 2) >= src_len) ? 0 : src[i + 2]);
-        if (c == 254) {
-            return i + 2;
+    for (; i < body; i += 4) {
+        const unsigned int a = t[src[i]];
+        const unsigned int b = t[src[i + 1]];
+        const unsigned int c = t[src[i + 2]];
+        const unsigned int d = t[src[i + 3]];
+        if (0 != ((a | b | c | d) & 0x80)) {
+            return -1;
         }
 
-        d = b64reverse(((i + 3) >= src_len) ? 0 : src[i + 3]);
-        if (d == 254) {
-            return i + 3;
-        }
+        const unsigned int v = (a << 18) | (b << 12) | (c << 6) | d;
+        *out++ = (unsigned char)(v >> 16);
+        *out++ = (unsigned char)(v >> 8);
+        *out++ = (unsigned char)v;
+    }
 
-        dst[(*dst_len)++] = (a << 2) + (b >> 4);
-        if (c != 255) {
-            dst[(*dst_len)++] = (b << 4) + (c >> 2);
-            if (d != 255) {
-                dst[(*dst_len)++] = (c << 6) + d;
-            }
+    const unsigned char *last = src + body;
+    const unsigned int a = t[last[0]];
+    const unsigned int b = t[last[1]];
+    if (0 != ((a | b) & 0x80)) {
+        return -1;
+    }
+    *out++ = (unsigned char)((a << 2) | (b >> 4));
+
+    if ('=' == last[2] && '=' == last[3]) {
+        if (0 != (b & 0x0F)) {
+            return -1;
+        }
+    } else if ('=' == last[3]) {
+        const unsigned int c = t[last[2]];
+        if (0 != (c & 0x80) || 0 != (c & 0x03)) {
+            return -1;
         }
+        *out++ = (unsigned char)((b << 4) | (c >> 2));
+    } else {
+        const unsigned int c = t[last[2]];
+        const unsigned int d = t[last[3]];
+        if (0 != ((c | d) & 0x80)) {
+            return -1;
+        }
+        *out++ = (unsigned char)((b << 4) | (c >> 2));
+        *out++ = (unsigned char)((c << 6) | d);
     }
 
-    // 返回已经解码的字符数
-    // 成功: i应该等于src_len
-    return i;
+    *dst_len = out - dst;
+    return 0;
+}
+
+std::string Base64Encode(const char *src, size_t srcLen)
+{
+    std::string encode;
+    encode.resize((srcLen + 2) / 3 * 4);
+    base64_encode((const unsigned char*)src, srcLen, &encode[0]);
+
+    return encode;
 }
 
 int Base64Decode(const char *src, size_t srcLen, std::string &base64Decode)
@@ -206,18 +421,183 @@ int Base64Decode(const char *src, size_t srcLen, std::string &base64Decode)
     }
 
     size_t dstLen = 0;
-    base64Decode.resize(srcLen);
-    int iRet = base64_decode((const unsigned char*)src, srcLen, &base64Decode[0], &dstLen);
-    if ((int)srcLen != iRet || 0 >= dstLen || dstLen >= srcLen) {
-        LOG_ERROR("Failed to base64 decode, iRet: {}, dstlen: {}, srclen: {}.", iRet, dstLen, srcLen);
+    base64Decode.resize(srcLen / 4 * 3);
+    int iRet = base64_decode((const unsigned char*)src, srcLen, (unsigned char*)&base64Decode[0], &dstLen);
+    if (0 != iRet) {
+        LOG_ERROR("Failed to base64 decode, srclen: {}.", srcLen);
+        base64Decode.clear();
         return -1;
     }
     base64Decode.resize(dstLen);
-    base64Decode.shrink_to_fit();
 
     return 0;
 }
 
+size_t Base64Encoder::update(const char *src, size_t srcLen, char *dst)
+{
+    const unsigned char *in = (const unsigned char*)src;
+    size_t len = 0;
+
+    // 补齐上次剩余的不足3字节
+    if (m_bufLen > 0) {
+        while (m_bufLen < 3 && srcLen > 0) {
+            m_buf[m_bufLen++] = *in++;
+            --srcLen;
+        }
+        if (m_bufLen < 3) {
+            return 0;
+        }
+        len += base64_encode(m_buf, 3, dst);
+        m_bufLen = 0;
+    }
+
+    const size_t whole = srcLen / 3 * 3;
+    len += base64_encode(in, whole, dst + len);
+
+    m_bufLen = srcLen - whole;
+    memcpy(m_buf, in + whole, m_bufLen);
+
+    return len;
+}
+
+size_t Base64Encoder::final(char *dst)
+{
+    const size_t len = base64_encode(m_buf, m_bufLen, dst);
+    m_bufLen = 0;
+    return len;
+}
+
+int Base64Decoder::update(const char *src, size_t srcLen, char *dst, size_t &dstLen)
+{
+    const unsigned char *in = (const unsigned char*)src;
+    unsigned char *out = (unsigned char*)dst;
+    size_t len = 0;
+
+    dstLen = 0;
+    if (m_finished && srcLen > 0) {
+        LOG_ERROR("Base64 data after padding.");
+        return -1;
+    }
+
+    // 补齐上次剩余的不足4字符
+    if (m_bufLen > 0) {
+        while (m_bufLen < 4 && srcLen > 0) {
+            m_buf[m_bufLen++] = *in++;
+            --srcLen;
+        }
+        if (m_bufLen < 4) {
+            return 0;
+        }
+        if (0 != base64_decode(m_buf, 4, out, &len)) {
+            LOG_ERROR("Failed to base64 decode.");
+            return -1;
+        }
+        dstLen += len;
+        m_bufLen = 0;
+        m_finished = (len < 3);
+        if (m_finished && srcLen > 0) {
+            LOG_ERROR("Base64 data after padding.");
+            return -1;
+        }
+    }
+
+    const size_t whole = srcLen / 4 * 4;
+    if (0 != base64_decode(in, whole, out + dstLen, &len)) {
+        LOG_ERROR("Failed to base64 decode.");
+        return -1;
+    }
+    dstLen += len;
+
+    // 有'='时必须是最后的数据
+    m_finished = m_finished || (len < whole / 4 * 3);
+    if (m_finished && whole < srcLen) {
+        LOG_ERROR("Base64 data after padding.");
+        return -1;
+    }
+
+    m_bufLen = srcLen - whole;
+    memcpy(m_buf, in + whole, m_bufLen);
+
+    return 0;
+}
+
+int Base64Decoder::final()
+{
+    if (0 != m_bufLen) {
+        LOG_ERROR("Incomplete base64 data, {} chars left.", m_bufLen);
+        return -1;
+    }
+
+    return 0;
+}
+
+#define BASE64_STREAM_CHUNK         (48 * 1024)
+
+int Base64Encode(std::istream &is, std::ostream &os)
+{
+    std::vector<char> in(BASE64_STREAM_CHUNK);
+    std::vector<char> out(BASE64_STREAM_CHUNK / 3 * 4 + 4);
+    Base64Encoder encoder;
+
+    while (is) {
+        is.read(&in[0], in.size());
+        const size_t n = (size_t)is.gcount();
+        if (0 == n) {
+            break;
+        }
+
+        const size_t len = encoder.update(&in[0], n, &out[0]);
+        if (!os.write(&out[0], len)) {
+            LOG_ERROR("Failed to write output stream.");
+            return -1;
+        }
+    }
+
+    if (is.bad()) {
+        LOG_ERROR("Failed to read input stream.");
+        return -1;
+    }
+
+    const size_t len = encoder.final(&out[0]);
+    if (!os.write(&out[0], len)) {
+        LOG_ERROR("Failed to write output stream.");
+        return -1;
+    }
+
+    return 0;
+}
+
+int Base64Decode(std::istream &is, std::ostream &os)
+{
+    std::vector<char> in(BASE64_STREAM_CHUNK);
+    std::vector<char> out(BASE64_STREAM_CHUNK / 4 * 3 + 3);
+    Base64Decoder decoder;
+
+    while (is) {
+        is.read(&in[0], in.size());
+        const size_t n = (size_t)is.gcount();
+        if (0 == n) {
+            break;
+        }
+
+        size_t len = 0;
+        if (0 != decoder.update(&in[0], n, &out[0], len)) {
+            return -1;
+        }
+        if (!os.write(&out[0], len)) {
+            LOG_ERROR("Failed to write output stream.");
+            return -1;
+        }
+    }
+
+    if (is.bad()) {
+        LOG_ERROR("Failed to read input stream.");
+        return -1;
+    }
+
+    return decoder.final();
+}
+
 static void add_from_bags(X509 **pX509, EVP_PKEY **pPkey, const STACK_OF(PKCS12_SAFEBAG) *bags, const char *pw);
 
 static void add_from_bag(X509 **pX509, EVP_PKEY **pPkey, PKCS12_SAFEBAG *bag, const char *pw)
@@ -466,6 +846,160 @@ void openssl_free_pfx(const openssl_x509_pkey &pfx)
     return;
 }
 
+#define PFX_CACHE_CAPACITY          256
+#define PFX_CACHE_TTL               600         // 秒
+
+/**
+ * 解析后的PFX缓存, 保存证书和私钥的引用, 命中时增加引用计数返回, 调用方仍用openssl_free_pfx释放
+ */
+class PfxCache
+{
+public:
+    PfxCache(size_t capacity, time_t ttl) : m_capacity(capacity), m_ttl(ttl), m_hits(0), m_misses(0) {}
+    ~PfxCache() { clear(); }
+
+    bool get(const std::string &key, openssl_x509_pkey &pfx)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(key);
+        if (it == m_index.end()) {
+            ++m_misses;
+            return false;
+        }
+
+        if (time(NULL) >= it->second->expire) {
+            erase(it->second);
+            ++m_misses;
+            return false;
+        }
+
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        X509_up_ref(it->second->x509);
+        EVP_PKEY_up_ref(it->second->pkey);
+        pfx.x509 = it->second->x509;
+        pfx.pkey = it->second->pkey;
+        ++m_hits;
+        return true;
+    }
+
+    void put(const std::string &key, const openssl_x509_pkey &pfx)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (0 == m_capacity || m_index.end() != m_index.find(key)) {
+            return;
+        }
+
+        X509_up_ref(pfx.x509);
+        EVP_PKEY_up_ref(pfx.pkey);
+        Entry entry = {key, pfx.x509, pfx.pkey, time(NULL) + m_ttl};
+        m_lru.push_front(entry);
+        m_index[key] = m_lru.begin();
+        evict(m_capacity);
+    }
+
+    void setLimits(size_t capacity, time_t ttl)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_capacity = capacity;
+        m_ttl = ttl;
+        evict(m_capacity);
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        evict(0);
+    }
+
+    void stats(pfx_cache_stats &stats)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        stats.hits = m_hits;
+        stats.misses = m_misses;
+        stats.size = m_lru.size();
+        stats.capacity = m_capacity;
+        stats.ttl = m_ttl;
+    }
+
+private:
+    struct Entry
+    {
+        std::string key;
+        X509 *x509;
+        EVP_PKEY *pkey;
+        time_t expire;
+    };
+    typedef std::list<Entry> LruList;
+
+    void erase(LruList::iterator it)
+    {
+        X509_free(it->x509);
+        EVP_PKEY_free(it->pkey);
+        m_index.erase(it->key);
+        m_lru.erase(it);
+    }
+
+    void evict(size_t capacity)
+    {
+        while (m_lru.size() > capacity) {
+            erase(--m_lru.end());
+        }
+    }
+
+    std::mutex m_mutex;
+    LruList m_lru;
+    std::unordered_map<std::string, LruList::iterator> m_index;
+    size_t m_capacity;
+    time_t m_ttl;
+    unsigned long long m_hits;
+    unsigned long long m_misses;
+};
+
+static PfxCache pfxCache(PFX_CACHE_CAPACITY, PFX_CACHE_TTL);
+
+void PFX_cache_stats(pfx_cache_stats &stats)
+{
+    pfxCache.stats(stats);
+}
+
+void PFX_cache_set_limits(size_t capacity, time_t ttl)
+{
+    pfxCache.setLimits(capacity, ttl);
+}
+
+void PFX_cache_clear()
+{
+    pfxCache.clear();
+}
+
+/**
+ * @brief 从内存读取pfx信息, 先查PFX解析缓存
+ * @param [IN] pfxData          pfx数据
+ * @param [IN] password         pfx密码
+ * @param [OUT] pfx             返回的证书、私钥, 用openssl_free_pfx释放
+ * @return int
+ * @note
+ */
+static int openssl_read_pfx_cached(const std::string &pfxData, const std::string &password, openssl_x509_pkey &pfx)
+{
+    memset(&pfx, 0, sizeof(pfx));
+
+    std::string key(2 * SHA256_DIGEST_LENGTH, '\0');
+    SHA256((const unsigned char*)pfxData.data(), pfxData.size(), (unsigned char*)&key[0]);
+    SHA256((const unsigned char*)password.data(), password.size(), (unsigned char*)&key[SHA256_DIGEST_LENGTH]);
+    if (pfxCache.get(key, pfx)) {
+        return 0;
+    }
+
+    int iRet = openssl_read_pfx_from_buf(pfxData.c_str(), pfxData.size(), password.c_str(), pfx);
+    if (0 != iRet) {
+        return iRet;
+    }
+
+    pfxCache.put(key, pfx);
+    return 0;
+}
+
 /**
  * @brief 转换ASN1_TIME到time_t
  * @param [IN] time
@@ -516,10 +1050,7 @@ int CheckPfxCertValid(const std::string &pfxData,
 
     // 读取PFX
     openssl_x509_pkey pfx = {0};
-    iRet = openssl_read_pfx_from_buf(&pfxData[0],
-                                     pfxData.size(),
-                                     password.c_str(),
-                                     pfx);
+    iRet = openssl_read_pfx_cached(pfxData, password, pfx);
     if (0 != iRet)
     {
         LOG_ERROR("Failed to read pfx.");
@@ -578,80 +1109,571 @@ static void SM3_KDF(const std::string &input, char output[32])
     return;
 }
 
-int SM4_DAO_decrypt(const std::string &inputEncrypt,
-                    const std::string &password,
-                    std::string &decryptOutput)
+#define SM4_DAO_CACHE_CAPACITY      64
+
+// 密码派生的iv和SM4加解密子密钥
+typedef struct
 {
-    int iRet = 0;
+    unsigned char iv[16];
+    sm4_context enc;
+    sm4_context dec;
+} sm4_dao_key;
 
-    // 两次base64解码
-    std::string base64Decode;
-    iRet = Base64Decode(inputEncrypt.c_str(), inputEncrypt.size(), base64Decode);
-    if (0 != iRet) {
-        LOG_ERROR("Failed to base64 decode: [{}]", inputEncrypt);
-        return iRet;
+static void SM4_DAO_derive_key(const std::string &password, sm4_dao_key &key)
+{
+    char output[32] = {0};
+    SM3_KDF(password, output);
+
+    // 前16字节iv, 后16字节key
+    memcpy(key.iv, output, 16);
+    sm4_setkey_enc(&key.enc, (unsigned char*)output + 16);
+    sm4_setkey_dec(&key.dec, (unsigned char*)output + 16);
+
+    OPENSSL_cleanse(output, sizeof(output));
+}
+
+/**
+ * 密码的HMAC-SHA256(进程随机密钥) -> sm4_dao_key, 少量密码覆盖大量请求时省去每次的SM3_KDF和密钥扩展
+ * 缓存key不能离线验证密码, 淘汰和清空时key与密钥一起清零
+ */
+class Sm4DaoKeyCache
+{
+public:
+    explicit Sm4DaoKeyCache(size_t capacity) : m_capacity(capacity), m_hits(0), m_misses(0)
+    {
+        // 无法生成随机密钥时不缓存
+        if (1 != RAND_bytes(m_hmacKey, sizeof(m_hmacKey))) {
+            m_capacity = 0;
+        }
     }
 
-    std::string base64Decode2;
-    iRet = Base64Decode(&base64Decode[0], base64Decode.size(), base64Decode2);
-    if (0 != iRet) {
-        LOG_ERROR("Failed to base64 decode: [{}]", base64Decode);
-        return iRet;
+    ~Sm4DaoKeyCache()
+    {
+        clear();
+        OPENSSL_cleanse(m_hmacKey, sizeof(m_hmacKey));
     }
 
-    // 解密过程
-    char output[32] = {0};
-    SM3_KDF(password, output);
+    // 密钥拷贝到key, 调用方用完后清零
+    void get(const std::string &password, sm4_dao_key &key)
+    {
+        std::string digest(SHA256_DIGEST_LENGTH, '\0');
+        unsigned int digestLen = 0;
+        HMAC(EVP_sha256(), m_hmacKey, sizeof(m_hmacKey), (const unsigned char*)password.data(), password.size(),
+             (unsigned char*)&digest[0], &digestLen);
+
+        if (!find(digest, key)) {
+            // 派生密钥时不持锁
+            SM4_DAO_derive_key(password, key);
+            insert(digest, key);
+        }
 
-    // 前16字节iv
-    char iv[16] = {0};
-    memcpy(iv, output, 16);
+        OPENSSL_cleanse(&digest[0], digest.size());
+    }
 
-    // 后16字节key
-    char key[16] = {0};
-    memcpy(key, output + 16, 16);
+    void setCapacity(size_t capacity)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_capacity = capacity;
+        evict(m_capacity);
+    }
 
-    iRet = SM4DecryptCBC(base64Decode2,
-                         key,
-                         iv,
-                         decryptOutput);
-    if (0 != iRet) {
-        LOG_ERROR("Failed to sm4 decrypt cbc: [{}].", base64Decode2);
-        return iRet;
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        evict(0);
     }
 
+    void stats(sm4_dao_cache_stats &stats)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        stats.hits = m_hits;
+        stats.misses = m_misses;
+        stats.size = m_lru.size();
+        stats.capacity = m_capacity;
+    }
+
+private:
+    bool find(const std::string &digest, sm4_dao_key &key)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(digest);
+        if (it == m_index.end()) {
+            ++m_misses;
+            return false;
+        }
+
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        key = it->second->second;
+        ++m_hits;
+        return true;
+    }
+
+    void insert(const std::string &digest, const sm4_dao_key &key)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (0 == m_capacity || m_index.end() != m_index.find(digest)) {
+            return;
+        }
+        m_lru.emplace_front(digest, key);
+        m_index[digest] = m_lru.begin();
+        evict(m_capacity);
+    }
+
+    // 淘汰最久未使用的项直到不超过capacity, 清零key和密钥
+    void evict(size_t capacity)
+    {
+        while (m_lru.size() > capacity) {
+            std::pair<std::string, sm4_dao_key> &entry = m_lru.back();
+            auto it = m_index.find(entry.first);
+            if (it != m_index.end()) {
+                // 按迭代器删除不再计算hash, 可以先清零key
+                std::string &indexKey = const_cast<std::string &>(it->first);
+                OPENSSL_cleanse(&indexKey[0], indexKey.size());
+                m_index.erase(it);
+            }
+            OPENSSL_cleanse(&entry.first[0], entry.first.size());
+            OPENSSL_cleanse(&entry.second, sizeof(entry.second));
+            m_lru.pop_back();
+        }
+    }
+
+    typedef std::list<std::pair<std::string, sm4_dao_key> > LruList;
+
+    std::mutex m_mutex;
+    LruList m_lru;
+    std::unordered_map<std::string, LruList::iterator> m_index;
+    size_t m_capacity;
+    unsigned long long m_hits;
+    unsigned long long m_misses;
+    unsigned char m_hmacKey[32];            // 进程随机HMAC密钥
+};
+
+static Sm4DaoKeyCache sm4DaoKeyCache(SM4_DAO_CACHE_CAPACITY);
+
+void SM4_DAO_cache_stats(sm4_dao_cache_stats &stats)
+{
+    sm4DaoKeyCache.stats(stats);
+}
+
+void SM4_DAO_cache_set_capacity(size_t capacity)
+{
+    sm4DaoKeyCache.setCapacity(capacity);
+}
+
+void SM4_DAO_cache_clear()
+{
+    sm4DaoKeyCache.clear();
+}
+
+// 分块大小: 16和3的公倍数, base64编码后仍是3的倍数, 各块的两次base64结果可以直接拼接
+#define SM4_DAO_CHUNK               (144 * 28)
+#define SM4_DAO_BASE64_CHUNK        (SM4_DAO_CHUNK / 3 * 4)
+#define SM4_DAO_BASE64_CHUNK2       (SM4_DAO_BASE64_CHUNK / 3 * 4)
+
+size_t SM4_DAO_encrypt_size(size_t inputLen)
+{
+    if (0 == inputLen) {
+        return 0;
+    }
+
+    const size_t cipherLen = (inputLen / 16 + 1) * 16;
+    const size_t base64Len = (cipherLen + 2) / 3 * 4;
+    return (base64Len + 2) / 3 * 4;
+}
+
+size_t SM4_DAO_decrypt_size(size_t inputLen)
+{
+    return inputLen / 4 * 3 / 4 * 3;
+}
+
+static int sm4_dao_encrypt(const sm4_dao_key &key, const char *input, size_t inputLen,
+                           char *output, size_t outputSize, size_t &outputLen)
+{
+    outputLen = 0;
+
+    const size_t encryptLen = SM4_DAO_encrypt_size(inputLen);
+    if ((0 != inputLen && (NULL == input || NULL == output)) || outputSize < encryptLen) {
+        LOG_ERROR("Null input/output or output size: {} < {}.", outputSize, encryptLen);
+        return -1;
+    }
+
+    // 与SM4EncryptCBC一致, 空数据加密结果为空
+    if (0 == inputLen) {
+        return 0;
+    }
+
+    Sm4Cipher cipher(key.enc, key.iv);
+
+    // 每块: SM4加密 -> base64 -> base64直接写入输出
+    unsigned char cipherBuf[SM4_DAO_CHUNK + 16];
+    char base64Buf[SM4_DAO_BASE64_CHUNK + 32];
+    const unsigned char *src = (const unsigned char*)input;
+    size_t pos = 0;
+    bool last = false;
+    while (!last) {
+        const size_t n = (inputLen - pos < SM4_DAO_CHUNK) ? inputLen - pos : SM4_DAO_CHUNK;
+        last = (pos + n == inputLen);
+
+        size_t cipherLen = 0;
+        size_t finalLen = 0;
+        (void)cipher.update(src + pos, n, cipherBuf, cipherLen);
+        if (last) {
+            (void)cipher.final(cipherBuf + cipherLen, finalLen);
+        }
+        pos += n;
+
+        const size_t base64Len = base64_encode(cipherBuf, cipherLen + finalLen, base64Buf);
+        outputLen += base64_encode((const unsigned char*)base64Buf, base64Len, output + outputLen);
+    }
+
+    return 0;
+}
+
+static int sm4_dao_decrypt(const sm4_dao_key &key, const char *input, size_t inputLen,
+                           char *output, size_t outputSize, size_t &outputLen)
+{
+    outputLen = 0;
+
+    if (NULL == input || 0 == inputLen || 0 != inputLen % 4) {
+        LOG_ERROR("Null input or error input len: {}.", inputLen);
+        return -1;
+    }
+
+    const size_t decryptLen = SM4_DAO_decrypt_size(inputLen);
+    if (NULL == output || outputSize < decryptLen) {
+        LOG_ERROR("Null output or output size: {} < {}.", outputSize, decryptLen);
+        return -1;
+    }
+
+    Sm4Cipher cipher(key.dec, key.iv);
+
+    // 每块: base64解码 -> base64解码 -> SM4解密直接写入输出
+    char base64Buf[SM4_DAO_BASE64_CHUNK];
+    char cipherBuf[SM4_DAO_CHUNK];
+    const unsigned char *src = (const unsigned char*)input;
+    for (size_t pos = 0; pos < inputLen; pos += SM4_DAO_BASE64_CHUNK2) {
+        const size_t n = (inputLen - pos < SM4_DAO_BASE64_CHUNK2) ? inputLen - pos : SM4_DAO_BASE64_CHUNK2;
+
+        // '='只能在最后一块
+        const bool last = (pos + n == inputLen);
+        size_t base64Len = 0;
+        if (0 != base64_decode(src + pos, n, (unsigned char*)base64Buf, &base64Len) || 0 != base64Len % 4
+            || (!last && base64Len != n / 4 * 3)) {
+            LOG_ERROR("Failed to base64 decode, pos: {}, dstlen: {}, srclen: {}.", pos, base64Len, n);
+            return -1;
+        }
+
+        size_t cipherLen = 0;
+        if (0 != base64_decode((const unsigned char*)base64Buf, base64Len, (unsigned char*)cipherBuf, &cipherLen)
+            || 0 == cipherLen || (!last && cipherLen != base64Len / 4 * 3)) {
+            LOG_ERROR("Failed to base64 decode, dstlen: {}, srclen: {}.", cipherLen, base64Len);
+            return -1;
+        }
+
+        size_t len = 0;
+        (void)cipher.update((const unsigned char*)cipherBuf, cipherLen, (unsigned char*)output + outputLen, len);
+        outputLen += len;
+    }
+
+    size_t len = 0;
+    if (0 != cipher.final((unsigned char*)output + outputLen, len)) {
+        LOG_ERROR("Failed to sm4 decrypt cbc, len: {}.", inputLen);
+        return -1;
+    }
+    outputLen += len;
+
+    return 0;
+}
+
+static int sm4_dao_decrypt(const sm4_dao_key &key, const std::string &inputEncrypt, std::string &decryptOutput)
+{
+    decryptOutput.resize(SM4_DAO_decrypt_size(inputEncrypt.size()));
+
+    size_t len = 0;
+    int iRet = sm4_dao_decrypt(key, inputEncrypt.data(), inputEncrypt.size(),
+                               &decryptOutput[0], decryptOutput.size(), len);
+    if (0 != iRet) {
+        decryptOutput.clear();
+        return iRet;
+    }
+
+    decryptOutput.resize(len);
+    return 0;
+}
+
+static int sm4_dao_encrypt(const sm4_dao_key &key, const std::string &inputSouce, std::string &encryptOutput)
+{
+    encryptOutput.resize(SM4_DAO_encrypt_size(inputSouce.size()));
+
+    size_t len = 0;
+    int iRet = sm4_dao_encrypt(key, inputSouce.data(), inputSouce.size(),
+                               &encryptOutput[0], encryptOutput.size(), len);
+    if (0 != iRet) {
+        encryptOutput.clear();
+        return iRet;
+    }
+
+    encryptOutput.resize(len);
     return 0;
 }
 
+int SM4_DAO_encrypt(const char *input, size_t inputLen, const std::string &password,
+                    char *output, size_t outputSize, size_t &outputLen)
+{
+    sm4_dao_key key;
+    sm4DaoKeyCache.get(password, key);
+    int iRet = sm4_dao_encrypt(key, input, inputLen, output, outputSize, outputLen);
+    OPENSSL_cleanse(&key, sizeof(key));
+    return iRet;
+}
+
+int SM4_DAO_decrypt(const char *input, size_t inputLen, const std::string &password,
+                    char *output, size_t outputSize, size_t &outputLen)
+{
+    sm4_dao_key key;
+    sm4DaoKeyCache.get(password, key);
+    int iRet = sm4_dao_decrypt(key, input, inputLen, output, outputSize, outputLen);
+    OPENSSL_cleanse(&key, sizeof(key));
+    return iRet;
+}
+
+int SM4_DAO_decrypt(const std::string &inputEncrypt,
+                    const std::string &password,
+                    std::string &decryptOutput)
+{
+    sm4_dao_key key;
+    sm4DaoKeyCache.get(password, key);
+    int iRet = sm4_dao_decrypt(key, inputEncrypt, decryptOutput);
+    OPENSSL_cleanse(&key, sizeof(key));
+    return iRet;
+}
+
 int SM4_DAO_encrypt(const std::string &inputSouce,
                     const std::string &password,
                     std::string &encryptOutput)
 {
-    /**
-     * SM4加密
-     */
-    char output[32] = {0};
-    SM3_KDF(password, output);
+    sm4_dao_key key;
+    sm4DaoKeyCache.get(password, key);
+    int iRet = sm4_dao_encrypt(key, inputSouce, encryptOutput);
+    OPENSSL_cleanse(&key, sizeof(key));
+    return iRet;
+}
 
-    // 前16字节iv
-    char iv[16] = {0};
-    memcpy(iv, output, 16);
+#define SM4_DAO_BATCH_GRAIN         16          // 工作线程每次领取的数据条数
 
-    // 后16字节key
-    char key[16] = {0};
-    memcpy(key, output + 16, 16);
+/**
+ * SM4_DAO批量接口的工作线程池, 多个批量请求共用; 调用线程也处理数据, 池中线程都忙时不用等待
+ */
+class Sm4DaoWorkerPool
+{
+public:
+    Sm4DaoWorkerPool() : m_threadNum(0), m_stop(false) {}
+    ~Sm4DaoWorkerPool() { stop(); }
 
-    (void)SM4EncryptCBC(inputSouce, key, iv, encryptOutput);
+    // 0: CPU核数
+    void setThreadNum(unsigned int threadNum)
+    {
+        stop();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_threadNum = threadNum;
+    }
 
-    /**
-     * 两次base64加密
-     */
-    std::string base64Encrypt1 = Base64Encode(encryptOutput.c_str(), encryptOutput.size());
-    encryptOutput = Base64Encode(base64Encrypt1.c_str(), base64Encrypt1.size());
+    // 返回包括调用线程在内的线程数
+    unsigned int threadNum()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return (0 == m_threadNum) ? std::max(1u, std::thread::hardware_concurrency()) : m_threadNum;
+    }
+
+    // 提交count个相同的任务
+    void submit(const std::function<void()> &task, unsigned int count)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_threads.empty()) {
+            const unsigned int threadNum = (0 == m_threadNum) ? std::max(1u, std::thread::hardware_concurrency()) : m_threadNum;
+            m_stop = false;
+            for (unsigned int i = 1; i < threadNum; ++i) {
+                m_threads.emplace_back(&Sm4DaoWorkerPool::run, this);
+            }
+        }
+
+        for (unsigned int i = 0; i < count; ++i) {
+            m_tasks.push_back(task);
+        }
+        m_cond.notify_all();
+    }
+
+private:
+    void run()
+    {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+                if (m_stop) {
+                    return;
+                }
+                task = m_tasks.front();
+                m_tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    // 未执行的任务直接丢弃, 调用线程会处理完全部数据
+    void stop()
+    {
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            m_tasks.clear();
+            threads.swap(m_threads);
+        }
+        m_cond.notify_all();
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::function<void()> > m_tasks;
+    std::vector<std::thread> m_threads;
+    unsigned int m_threadNum;
+    bool m_stop;
+};
+
+static Sm4DaoWorkerPool sm4DaoWorkerPool;
+
+// 一次批量请求, 由调用线程和池中线程共享, 最后一个任务退出时释放
+struct Sm4DaoBatch
+{
+    bool encrypt;
+    size_t count;                   // 建立时保存, 调用返回后才开始的任务不能访问inputs
+    const std::vector<std::string> *inputs;
+    const std::vector<std::string> *passwords;
+    std::vector<std::string> *outputs;
+    std::vector<int> *status;
+
+    std::atomic<size_t> next;
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t done;
+};
+
+static void SM4_DAO_batch_work(Sm4DaoBatch &batch)
+{
+    const size_t count = batch.count;
+
+    // 线程内缓存上一条数据的密钥, 同一密码的连续数据不访问共享缓存
+    std::string password;
+    sm4_dao_key key;
+    bool hasKey = false;
+
+    size_t begin = 0;
+    while ((begin = batch.next.fetch_add(SM4_DAO_BATCH_GRAIN)) < count) {
+        const size_t end = std::min(begin + SM4_DAO_BATCH_GRAIN, count);
+        for (size_t i = begin; i < end; ++i) {
+            const std::string &itemPassword = (1 == batch.passwords->size()) ? (*batch.passwords)[0] : (*batch.passwords)[i];
+            if (!hasKey || itemPassword != password) {
+                sm4DaoKeyCache.get(itemPassword, key);
+                password = itemPassword;
+                hasKey = true;
+            }
+
+            (*batch.status)[i] = batch.encrypt ? sm4_dao_encrypt(key, (*batch.inputs)[i], (*batch.outputs)[i])
+                                               : sm4_dao_decrypt(key, (*batch.inputs)[i], (*batch.outputs)[i]);
+        }
+
+        std::lock_guard<std::mutex> lock(batch.mutex);
+        batch.done += end - begin;
+        if (count == batch.done) {
+            batch.cond.notify_all();
+        }
+    }
+
+    if (hasKey) {
+        OPENSSL_cleanse(&key, sizeof(key));
+        OPENSSL_cleanse(&password[0], password.size());
+    }
+}
+
+static int SM4_DAO_batch(bool encrypt,
+                         const std::vector<std::string> &inputs,
+                         const std::vector<std::string> &passwords,
+                         std::vector<std::string> &outputs,
+                         std::vector<int> &status)
+{
+    const size_t count = inputs.size();
+    if (passwords.size() != count && passwords.size() != 1) {
+        LOG_ERROR("Password count: {} mismatch input count: {}.", passwords.size(), count);
+        return -1;
+    }
+
+    outputs.clear();
+    outputs.resize(count);
+    status.assign(count, -1);
+    if (0 == count) {
+        return 0;
+    }
+
+    std::shared_ptr<Sm4DaoBatch> batch = std::make_shared<Sm4DaoBatch>();
+    batch->encrypt = encrypt;
+    batch->count = count;
+    batch->inputs = &inputs;
+    batch->passwords = &passwords;
+    batch->outputs = &outputs;
+    batch->status = &status;
+    batch->next = 0;
+    batch->done = 0;
+
+    // 数据少时不使用工作线程
+    const size_t grains = (count + SM4_DAO_BATCH_GRAIN - 1) / SM4_DAO_BATCH_GRAIN;
+    const unsigned int helpers = (unsigned int)std::min<size_t>(sm4DaoWorkerPool.threadNum() - 1, grains - 1);
+    if (helpers > 0) {
+        sm4DaoWorkerPool.submit([batch]() { SM4_DAO_batch_work(*batch); }, helpers);
+    }
+
+    SM4_DAO_batch_work(*batch);
+
+    // 等待其他线程正在处理的数据
+    {
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->cond.wait(lock, [&]() { return count == batch->done; });
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (0 != status[i]) {
+            return -1;
+        }
+    }
 
     return 0;
 }
 
+int SM4_DAO_encrypt_batch(const std::vector<std::string> &inputs,
+                          const std::vector<std::string> &passwords,
+                          std::vector<std::string> &outputs,
+                          std::vector<int> &status)
+{
+    return SM4_DAO_batch(true, inputs, passwords, outputs, status);
+}
+
+int SM4_DAO_decrypt_batch(const std::vector<std::string> &inputs,
+                          const std::vector<std::string> &passwords,
+                          std::vector<std::string> &outputs,
+                          std::vector<int> &status)
+{
+    return SM4_DAO_batch(false, inputs, passwords, outputs, status);
+}
+
+void SM4_DAO_batch_set_threads(unsigned int threadNum)
+{
+    sm4DaoWorkerPool.setThreadNum(threadNum);
+}
+
 ////////////////////////////////////////////////////////////////
 /////////////////////////////X509证书接口////////////////////////
 ////////////////////////////////////////////////////////////////
@@ -676,7 +1698,7 @@ static X509 *LoadX509FromBio(BIO *bio, const char *format)
     return x509;
 }
 
-X509 *LoadX509FromPath(const char *x509Path, const char *format)
+static X509 *parseX509FromPath(const char *x509Path, const char *format)
 {
 
     BIO *bio = NULL;
@@ -701,7 +1723,7 @@ X509 *LoadX509FromPath(const char *x509Path, const char *format)
     return x509;
 }
 
-X509 *LoadX509FromBuf(const char *x509Buf, size_t x509Len, const char *format)
+static X509 *parseX509FromBuf(const char *x509Buf, size_t x509Len, const char *format)
 {
 
     BIO *bio = NULL;
@@ -757,7 +1779,7 @@ static X509_CRL *LoadCRLFromBio(BIO *bio, const char *format)
     return crl;
 }
 
-X509_CRL *LoadCRLFromPath(const char *crlPath, const char *format)
+static X509_CRL *parseCRLFromPath(const char *crlPath, const char *format)
 {
 
     BIO *bio = NULL;
@@ -781,7 +1803,7 @@ X509_CRL *LoadCRLFromPath(const char *crlPath, const char *format)
     return crl;
 }
 
-X509_CRL *LoadCRLFromBuf(const char *crlBuf, size_t crlLen, const char *format)
+static X509_CRL *parseCRLFromBuf(const char *crlBuf, size_t crlLen, const char *format)
 {
 
     BIO *bio = NULL;
@@ -814,99 +1836,1002 @@ void FreeX509CRL(X509_CRL *crl)
     return;
 }
 
-int CRL_Verify(X509 *rootCert,
-               X509_CRL *Crl,
-               X509 *userCert,
-               bool &certValid)
+////////////////////////////////////////////////////////////////
+/////////////////////////证书和CRL解析缓存////////////////////////
+////////////////////////////////////////////////////////////////
+#define X509_CACHE_CAPACITY         256
+
+/**
+ * 证书和crl解析缓存, 保存对象引用和证书的常用信息, 命中时增加引用计数返回
+ */
+class X509ParseCache
 {
-    certValid = false;
-    int iRet = 0;
+public:
+    explicit X509ParseCache(size_t capacity) : m_capacity(capacity), m_hits(0), m_misses(0) {}
+    ~X509ParseCache() { clear(); }
 
-    // 加载根证书, 证书库，存在证书链
-    X509_STORE *rootCertStore = NULL;
-    rootCertStore = X509_STORE_new();
-    X509_STORE_add_cert(rootCertStore, rootCert);
+    /**
+     * stamp为文件修改时间和大小, 与缓存不同时删除旧的缓存项
+     */
+    bool getX509(const std::string &key, const std::string &stamp, X509 *&x509, x509_info *info)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        LruList::iterator it;
+        if (!find(key, stamp, it) || NULL == it->x509) {
+            ++m_misses;
+            return false;
+        }
 
-    // 设置CRL查询标记,添加CRL
-    X509_STORE_set_flags(rootCertStore, X509_V_FLAG_CRL_CHECK);
-    X509_STORE_add_crl(rootCertStore, Crl);
+        X509_up_ref(it->x509);
+        x509 = it->x509;
+        if (NULL != info) {
+            *info = it->info;
+        }
+        ++m_hits;
+        return true;
+    }
 
-    // 加载证书存储上下文
-    X509_STORE_CTX *ctx = NULL;
-    ctx = X509_STORE_CTX_new();
+    bool getCRL(const std::string &key, const std::string &stamp, X509_CRL *&crl)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        LruList::iterator it;
+        if (!find(key, stamp, it) || NULL == it->crl) {
+            ++m_misses;
+            return false;
+        }
 
-    STACK_OF(X509) *caCertStack = NULL;
-    iRet = X509_STORE_CTX_init(ctx, rootCertStore, userCert, caCertStack);
-    if(iRet != 1)
+        X509_CRL_up_ref(it->crl);
+        crl = it->crl;
+        ++m_hits;
+        return true;
+    }
+
+    void put(const std::string &key, const std::string &stamp, X509 *x509, X509_CRL *crl, const x509_info *info)
     {
-        LOG_ERROR("Failed to X509_STORE_CTX_init.");
-        X509_STORE_CTX_cleanup(ctx);
-        X509_STORE_CTX_free(ctx);
-        X509_STORE_free(rootCertStore);
-        return -1;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (0 == m_capacity || m_index.end() != m_index.find(key)) {
+            return;
+        }
+
+        Entry entry;
+        entry.key = key;
+        entry.stamp = stamp;
+        entry.x509 = x509;
+        entry.crl = crl;
+        if (NULL != x509) {
+            X509_up_ref(x509);
+            entry.info = *info;
+        }
+        if (NULL != crl) {
+            X509_CRL_up_ref(crl);
+        }
+        m_lru.push_front(entry);
+        m_index[key] = m_lru.begin();
+        evict(m_capacity);
     }
 
-    iRet = X509_verify_cert(ctx);
-    if(iRet != 1)
+    void setCapacity(size_t capacity)
     {
-        LOG_DEBUG("Failed to verify cert.");
-        certValid = false;
-        X509_STORE_CTX_cleanup(ctx);
-        X509_STORE_CTX_free(ctx);
-        X509_STORE_free(rootCertStore);
-        return 0;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_capacity = capacity;
+        evict(m_capacity);
     }
 
-    certValid = true;
-    X509_STORE_CTX_cleanup(ctx);
-    X509_STORE_CTX_free(ctx);
-    X509_STORE_free(rootCertStore);
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        evict(0);
+    }
 
-    return 0;
-}
+    void stats(x509_cache_stats &stats)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        stats.hits = m_hits;
+        stats.misses = m_misses;
+        stats.size = m_lru.size();
+        stats.capacity = m_capacity;
+    }
 
-int CRL_VerifyFromPath(const char *rootCertPath,
-                       const char *crlPath,
-                       const char *userCertPath,
-                       bool &certValid)
+private:
+    struct Entry
+    {
+        std::string key;
+        std::string stamp;
+        X509 *x509;
+        X509_CRL *crl;
+        x509_info info;
+    };
+    typedef std::list<Entry> LruList;
+
+    bool find(const std::string &key, const std::string &stamp, LruList::iterator &it)
+    {
+        auto indexIt = m_index.find(key);
+        if (indexIt == m_index.end()) {
+            return false;
+        }
+
+        it = indexIt->second;
+        if (it->stamp != stamp) {
+            erase(it);
+            return false;
+        }
+
+        m_lru.splice(m_lru.begin(), m_lru, it);
+        return true;
+    }
+
+    void erase(LruList::iterator it)
+    {
+        X509_free(it->x509);
+        X509_CRL_free(it->crl);
+        m_index.erase(it->key);
+        m_lru.erase(it);
+    }
+
+    void evict(size_t capacity)
+    {
+        while (m_lru.size() > capacity) {
+            erase(--m_lru.end());
+        }
+    }
+
+    std::mutex m_mutex;
+    LruList m_lru;
+    std::unordered_map<std::string, LruList::iterator> m_index;
+    size_t m_capacity;
+    unsigned long long m_hits;
+    unsigned long long m_misses;
+};
+
+static X509ParseCache x509ParseCache(X509_CACHE_CAPACITY);
+
+void X509_cache_stats(x509_cache_stats &stats)
+{
+    x509ParseCache.stats(stats);
+}
+
+void X509_cache_set_capacity(size_t capacity)
+{
+    x509ParseCache.setCapacity(capacity);
+}
+
+void X509_cache_clear()
+{
+    x509ParseCache.clear();
+}
+
+/**
+ * 文件缓存key: 类型、格式、路径; stamp: 修改时间、大小、inode, 文件不存在时返回false
+ */
+static bool x509CachePathKey(const char *type, const char *path, const char *format,
+                             std::string &key, std::string &stamp)
+{
+    struct stat fileInfo;
+    if (NULL == path || NULL == format || 0 != stat(path, &fileInfo)) {
+        return false;
+    }
+
+    key = std::string(type) + '\n' + format + '\n' + path;
+    stamp = std::to_string((long long)fileInfo.st_mtim.tv_sec) + '.'
+            + std::to_string((long long)fileInfo.st_mtim.tv_nsec) + ':'
+            + std::to_string((long long)fileInfo.st_size) + ':'
+            + std::to_string((unsigned long long)fileInfo.st_ino);
+    return true;
+}
+
+/**
+ * 内存数据缓存key: 类型、格式、内容SHA256
+ */
+static std::string x509CacheBufKey(const char *type, const char *buf, size_t len, const char *format)
+{
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256((const unsigned char*)buf, len, digest);
+    return std::string(type) + '\n' + (NULL == format ? "" : format) + '\n'
+           + std::string((const char*)digest, sizeof(digest));
+}
+
+static void x509InfoGet(const X509 *x509, x509_info &info)
+{
+    GetX509NameSubject(x509, info.subject);
+    GetX509NameIssuer(x509, info.issuer);
+    info.startTime = 0;
+    info.endTime = 0;
+    openssl_get_x509_valid_time(x509, info.startTime, info.endTime);
+    info.signatureOID = X509_GetSignatureOIDText(x509);
+}
+
+static X509 *x509CacheLoad(const std::string &key, const std::string &stamp,
+                           const std::function<X509*()> &parse, x509_info *info)
+{
+    X509 *x509 = NULL;
+    if (x509ParseCache.getX509(key, stamp, x509, info)) {
+        return x509;
+    }
+
+    x509 = parse();
+    if (NULL == x509) {
+        return NULL;
+    }
+
+    x509_info x509Info;
+    x509InfoGet(x509, x509Info);
+    if (NULL != info) {
+        *info = x509Info;
+    }
+    x509ParseCache.put(key, stamp, x509, NULL, &x509Info);
+    return x509;
+}
+
+static X509_CRL *crlCacheLoad(const std::string &key, const std::string &stamp,
+                              const std::function<X509_CRL*()> &parse)
+{
+    X509_CRL *crl = NULL;
+    if (x509ParseCache.getCRL(key, stamp, crl)) {
+        return crl;
+    }
+
+    crl = parse();
+    if (NULL == crl) {
+        return NULL;
+    }
+
+    x509ParseCache.put(key, stamp, NULL, crl, NULL);
+    return crl;
+}
+
+X509 *LoadX509FromPath(const char *x509Path, const char *format)
+{
+    std::string key;
+    std::string stamp;
+    if (!x509CachePathKey("X509", x509Path, format, key, stamp)) {
+        return parseX509FromPath(x509Path, format);
+    }
+
+    return x509CacheLoad(key, stamp, [&]() { return parseX509FromPath(x509Path, format); }, NULL);
+}
+
+X509 *LoadX509FromBuf(const char *x509Buf, size_t x509Len, const char *format)
+{
+    return x509CacheLoad(x509CacheBufKey("X509", x509Buf, x509Len, format), "",
+                         [&]() { return parseX509FromBuf(x509Buf, x509Len, format); }, NULL);
+}
+
+X509_CRL *LoadCRLFromPath(const char *crlPath, const char *format)
+{
+    std::string key;
+    std::string stamp;
+    if (!x509CachePathKey("CRL", crlPath, format, key, stamp)) {
+        return parseCRLFromPath(crlPath, format);
+    }
+
+    return crlCacheLoad(key, stamp, [&]() { return parseCRLFromPath(crlPath, format); });
+}
+
+X509_CRL *LoadCRLFromBuf(const char *crlBuf, size_t crlLen, const char *format)
+{
+    return crlCacheLoad(x509CacheBufKey("CRL", crlBuf, crlLen, format), "",
+                        [&]() { return parseCRLFromBuf(crlBuf, crlLen, format); });
+}
+
+int GetX509InfoFromPath(const char *x509Path, x509_info &info, const char *format)
+{
+    std::string key;
+    std::string stamp;
+    X509 *x509 = NULL;
+    if (!x509CachePathKey("X509", x509Path, format, key, stamp)) {
+        x509 = parseX509FromPath(x509Path, format);
+        if (NULL != x509) {
+            x509InfoGet(x509, info);
+        }
+    } else {
+        x509 = x509CacheLoad(key, stamp, [&]() { return parseX509FromPath(x509Path, format); }, &info);
+    }
+
+    if (NULL == x509) {
+        LOG_ERROR("Failed to load x509 from path: {}.", x509Path);
+        return -1;
+    }
+
+    FreeX509(x509);
+    return 0;
+}
+
+int GetX509InfoFromBuf(const char *x509Buf, size_t x509Len, x509_info &info, const char *format)
+{
+    X509 *x509 = x509CacheLoad(x509CacheBufKey("X509", x509Buf, x509Len, format), "",
+                               [&]() { return parseX509FromBuf(x509Buf, x509Len, format); }, &info);
+    if (NULL == x509) {
+        LOG_ERROR("Failed to load x509 from buf size: {}.", x509Len);
+        return -1;
+    }
+
+    FreeX509(x509);
+    return 0;
+}
+
+int CRL_Verify(X509 *rootCert,
+               X509_CRL *Crl,
+               X509 *userCert,
+               bool &certValid)
+{
+    certValid = false;
+    int iRet = 0;
+
+    // 加载根证书, 证书库，存在证书链
+    X509_STORE *rootCertStore = NULL;
+    rootCertStore = X509_STORE_new();
+    X509_STORE_add_cert(rootCertStore, rootCert);
+
+    // 设置CRL查询标记,添加CRL
+    X509_STORE_set_flags(rootCertStore, X509_V_FLAG_CRL_CHECK);
+    X509_STORE_add_crl(rootCertStore, Crl);
+
+    // 加载证书存储上下文
+    X509_STORE_CTX *ctx = NULL;
+    ctx = X509_STORE_CTX_new();
+
+    STACK_OF(X509) *caCertStack = NULL;
+    iRet = X509_STORE_CTX_init(ctx, rootCertStore, userCert, caCertStack);
+    if(iRet != 1)
+    {
+        LOG_ERROR("Failed to X509_STORE_CTX_init.");
+        X509_STORE_CTX_cleanup(ctx);
+        X509_STORE_CTX_free(ctx);
+        X509_STORE_free(rootCertStore);
+        return -1;
+    }
+
+    iRet = X509_verify_cert(ctx);
+    if(iRet != 1)
+    {
+        LOG_DEBUG("Failed to verify cert.");
+        certValid = false;
+        X509_STORE_CTX_cleanup(ctx);
+        X509_STORE_CTX_free(ctx);
+        X509_STORE_free(rootCertStore);
+        return 0;
+    }
+
+    certValid = true;
+    X509_STORE_CTX_cleanup(ctx);
+    X509_STORE_CTX_free(ctx);
+    X509_STORE_free(rootCertStore);
+
+    return 0;
+}
+
+#define CRL_VERIFIER_CACHE_CAPACITY     16
+
+/**
+ * 一次加载的根证书和吊销列表, 加载后只读
+ */
+struct CrlSnapshot
+{
+    CrlSnapshot() : store(NULL), crl(NULL), crlSignOk(false) {}
+    ~CrlSnapshot()
+    {
+        X509_STORE_free(store);
+        X509_CRL_free(crl);
+    }
+
+    X509_STORE *store;                  // 只有根证书, 不设置X509_V_FLAG_CRL_CHECK
+    X509_CRL *crl;
+    bool crlSignOk;                     // crl是否由根证书签名
+    std::vector<std::string> serials;   // 吊销的序列号, 排序
+};
+
+/**
+ * ASN1_INTEGER转换为可比较的key: 符号 + 去掉前导0的大端数值
+ */
+static std::string crlSerialKey(const ASN1_INTEGER *serial)
+{
+    const unsigned char *data = ASN1_STRING_get0_data(serial);
+    int len = ASN1_STRING_length(serial);
+    while (len > 0 && 0 == *data) {
+        ++data;
+        --len;
+    }
+
+    std::string key(1, V_ASN1_NEG_INTEGER == ASN1_STRING_type(serial) ? '-' : '+');
+    key.append((const char*)data, len);
+    return key;
+}
+
+static CrlSnapshot *crlSnapshotNew(X509 *rootCert, X509_CRL *Crl)
+{
+    std::unique_ptr<CrlSnapshot> snapshot(new CrlSnapshot());
+    snapshot->store = X509_STORE_new();
+    if (NULL == snapshot->store || 1 != X509_STORE_add_cert(snapshot->store, rootCert)) {
+        LOG_ERROR("Failed to build x509 store.");
+        return NULL;
+    }
+
+    X509_CRL_up_ref(Crl);
+    snapshot->crl = Crl;
+
+    EVP_PKEY *rootKey = X509_get0_pubkey(rootCert);
+    snapshot->crlSignOk = NULL != rootKey
+                          && 0 == X509_NAME_cmp(X509_get_subject_name(rootCert), X509_CRL_get_issuer(Crl))
+                          && 1 == X509_CRL_verify(Crl, rootKey);
+    if (!snapshot->crlSignOk) {
+        LOG_ERROR("Crl is not signed by root cert, all certs are invalid.");
+    }
+
+    STACK_OF(X509_REVOKED) *revoked = X509_CRL_get_REVOKED(Crl);
+    int count = sk_X509_REVOKED_num(revoked);
+    snapshot->serials.reserve(count > 0 ? count : 0);
+    for (int i = 0; i < count; ++i) {
+        const X509_REVOKED *entry = sk_X509_REVOKED_value(revoked, i);
+        snapshot->serials.push_back(crlSerialKey(X509_REVOKED_get0_serialNumber(entry)));
+    }
+    std::sort(snapshot->serials.begin(), snapshot->serials.end());
+
+    return snapshot.release();
+}
+
+class CrlVerifierPrivate
+{
+public:
+    CrlVerifierPrivate() : current(NULL), epoch(0), lastCheck(0), rootMtime(0), crlMtime(0)
+    {
+        readers[0] = 0;
+        readers[1] = 0;
+    }
+
+    ~CrlVerifierPrivate()
+    {
+        delete current.load();
+    }
+
+    /**
+     * 读取当前数据, 不加锁: 按epoch奇偶计数读者, 替换时等待旧epoch的读者结束再释放
+     */
+    const CrlSnapshot *acquire(unsigned int &slot) const
+    {
+        for (;;) {
+            slot = epoch.load() & 1;
+            readers[slot].fetch_add(1);
+            if ((epoch.load() & 1) == slot) {
+                return current.load();
+            }
+            readers[slot].fetch_sub(1);
+        }
+    }
+
+    void release(unsigned int slot) const
+    {
+        readers[slot].fetch_sub(1);
+    }
+
+    void replace(CrlSnapshot *snapshot)
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        CrlSnapshot *old = current.exchange(snapshot);
+        unsigned int slot = epoch.fetch_add(1) & 1;
+        while (0 != readers[slot].load()) {
+            std::this_thread::yield();
+        }
+        delete old;
+    }
+
+    int loadFromPath(time_t &newRootMtime, time_t &newCrlMtime);
+    void reloadIfChanged();
+
+    std::atomic<CrlSnapshot*> current;
+    std::atomic<unsigned int> epoch;
+    mutable std::atomic<unsigned int> readers[2];
+    std::mutex writeMutex;
+
+    // 从路径加载
+    std::mutex reloadMutex;
+    std::string rootCertPath;
+    std::string crlPath;
+    std::string format;
+    std::atomic<time_t> lastCheck;
+    time_t rootMtime;
+    time_t crlMtime;
+};
+
+static time_t fileMtime(const std::string &path)
+{
+    struct stat fileInfo;
+    if (0 != stat(path.c_str(), &fileInfo)) {
+        return 0;
+    }
+    return fileInfo.st_mtime;
+}
+
+int CrlVerifierPrivate::loadFromPath(time_t &newRootMtime, time_t &newCrlMtime)
 {
-    X509 *rootCert = LoadX509FromPath(rootCertPath);
+    // 先取修改时间, 读取期间再次修改时下一次检查重新加载
+    newRootMtime = fileMtime(rootCertPath);
+    newCrlMtime = fileMtime(crlPath);
+
+    X509 *rootCert = LoadX509FromPath(rootCertPath.c_str(), format.c_str());
     if (NULL == rootCert) {
         LOG_ERROR("Failed to load x509 from path: {}.", rootCertPath);
         return -1;
     }
 
-    X509_CRL *Crl = LoadCRLFromPath(crlPath);
+    X509_CRL *Crl = LoadCRLFromPath(crlPath.c_str(), format.c_str());
     if (NULL == Crl) {
         LOG_ERROR("Failed to load CRL from path: {}.", crlPath);
         FreeX509(rootCert);
         return -1;
     }
 
+    CrlSnapshot *snapshot = crlSnapshotNew(rootCert, Crl);
+    FreeX509(rootCert);
+    FreeX509CRL(Crl);
+    if (NULL == snapshot) {
+        return -1;
+    }
+
+    replace(snapshot);
+    return 0;
+}
+
+void CrlVerifierPrivate::reloadIfChanged()
+{
+    if (crlPath.empty()) {
+        return;
+    }
+
+    time_t now = time(NULL);
+    time_t checked = lastCheck.load();
+    if (checked == now || !lastCheck.compare_exchange_strong(checked, now)) {
+        return;
+    }
+
+    // 其它线程正在重新加载时不等待
+    std::unique_lock<std::mutex> lock(reloadMutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+
+    if (fileMtime(rootCertPath) == rootMtime && fileMtime(crlPath) == crlMtime) {
+        return;
+    }
+
+    time_t newRootMtime = 0;
+    time_t newCrlMtime = 0;
+    if (0 != loadFromPath(newRootMtime, newCrlMtime)) {
+        LOG_ERROR("Failed to reload crl: {}, keep the old one.", crlPath);
+        return;
+    }
+    rootMtime = newRootMtime;
+    crlMtime = newCrlMtime;
+}
+
+CrlVerifier::CrlVerifier() : d(new CrlVerifierPrivate())
+{
+}
+
+CrlVerifier::~CrlVerifier()
+{
+    delete d;
+}
+
+int CrlVerifier::load(X509 *rootCert, X509_CRL *Crl)
+{
+    if (NULL == rootCert || NULL == Crl) {
+        LOG_ERROR("Root cert or crl is null.");
+        return -1;
+    }
+
+    CrlSnapshot *snapshot = crlSnapshotNew(rootCert, Crl);
+    if (NULL == snapshot) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(d->reloadMutex);
+    d->crlPath.clear();
+    d->replace(snapshot);
+    return 0;
+}
+
+int CrlVerifier::loadFromPath(const char *rootCertPath, const char *crlPath, const char *format)
+{
+    std::lock_guard<std::mutex> lock(d->reloadMutex);
+    d->rootCertPath = rootCertPath;
+    d->crlPath = crlPath;
+    d->format = format;
+    d->lastCheck = time(NULL);
+
+    time_t newRootMtime = 0;
+    time_t newCrlMtime = 0;
+    if (0 != d->loadFromPath(newRootMtime, newCrlMtime)) {
+        d->crlPath.clear();
+        return -1;
+    }
+    d->rootMtime = newRootMtime;
+    d->crlMtime = newCrlMtime;
+    return 0;
+}
+
+int CrlVerifier::verify(X509 *userCert, bool &certValid) const
+{
+    certValid = false;
+    d->reloadIfChanged();
+
+    unsigned int slot = 0;
+    const CrlSnapshot *snapshot = d->acquire(slot);
+    if (NULL == snapshot) {
+        d->release(slot);
+        LOG_ERROR("Crl verifier is not loaded.");
+        return -1;
+    }
+
+    X509_STORE_CTX *ctx = X509_STORE_CTX_new();
+    if (NULL == ctx || 1 != X509_STORE_CTX_init(ctx, snapshot->store, userCert, NULL)) {
+        LOG_ERROR("Failed to X509_STORE_CTX_init.");
+        X509_STORE_CTX_free(ctx);
+        d->release(slot);
+        return -1;
+    }
+
+    // 证书链由X509_verify_cert检查, 吊销列表的签名在加载时已检查, 这里检查有效期和序列号
+    int iRet = X509_verify_cert(ctx);
+    X509_STORE_CTX_free(ctx);
+    if (1 != iRet) {
+        LOG_DEBUG("Failed to verify cert.");
+        d->release(slot);
+        return 0;
+    }
+
+    const X509_CRL *Crl = snapshot->crl;
+    const ASN1_TIME *nextUpdate = X509_CRL_get0_nextUpdate(Crl);
+    if (!snapshot->crlSignOk
+        || 0 != X509_NAME_cmp(X509_get_issuer_name(userCert), X509_CRL_get_issuer(Crl))
+        || X509_cmp_time(X509_CRL_get0_lastUpdate(Crl), NULL) >= 0
+        || (NULL != nextUpdate && X509_cmp_time(nextUpdate, NULL) <= 0)) {
+        LOG_DEBUG("Crl is not valid for cert.");
+        d->release(slot);
+        return 0;
+    }
+
+    certValid = !std::binary_search(snapshot->serials.begin(), snapshot->serials.end(),
+                                    crlSerialKey(X509_get0_serialNumber(userCert)));
+    d->release(slot);
+    return 0;
+}
+
+size_t CrlVerifier::revokedCount() const
+{
+    unsigned int slot = 0;
+    const CrlSnapshot *snapshot = d->acquire(slot);
+    size_t count = NULL == snapshot ? 0 : snapshot->serials.size();
+    d->release(slot);
+    return count;
+}
+
+int CRL_VerifyFromPath(const char *rootCertPath,
+                       const char *crlPath,
+                       const char *userCertPath,
+                       bool &certValid)
+{
+    // 相同根证书和crl路径复用常驻的CrlVerifier, 文件修改后自动重新加载
+    static std::mutex verifiersMutex;
+    static std::map<std::string, std::shared_ptr<CrlVerifier> > verifiers;
+
+    certValid = false;
+    std::string key = std::string(rootCertPath) + '\n' + crlPath;
+    std::shared_ptr<CrlVerifier> verifier;
+    {
+        std::lock_guard<std::mutex> lock(verifiersMutex);
+        auto it = verifiers.find(key);
+        if (it != verifiers.end()) {
+            verifier = it->second;
+        }
+    }
+
+    if (!verifier) {
+        verifier = std::make_shared<CrlVerifier>();
+        if (0 != verifier->loadFromPath(rootCertPath, crlPath)) {
+            LOG_ERROR("Failed to load root cert: {} or crl: {}.", rootCertPath, crlPath);
+            return -1;
+        }
+
+        std::lock_guard<std::mutex> lock(verifiersMutex);
+        if (verifiers.size() >= CRL_VERIFIER_CACHE_CAPACITY) {
+            verifiers.clear();
+        }
+        verifiers[key] = verifier;
+    }
+
     X509 *userCert = LoadX509FromPath(userCertPath);
     if (NULL == userCert) {
         LOG_ERROR("Failed to load x509 from path: {}.", userCertPath);
-        FreeX509(rootCert);
-        FreeX509CRL(Crl);
         return -1;
     }
 
-    int iRet = CRL_Verify(rootCert, Crl, userCert, certValid);
+    int iRet = verifier->verify(userCert, certValid);
     if (0 != iRet) {
         LOG_ERROR("Failed to crl verify: root cert path: {}, crl path: {}, user cert paht: {}.",
                   rootCertPath, crlPath, userCertPath);
-        FreeX509(rootCert);
-        FreeX509CRL(Crl);
         FreeX509(userCert);
         return iRet;
     }
 
+    FreeX509(userCert);
+    return 0;
+}
+
+#define CRL_INDEX_MAGIC             "CRLIDX1"
+#define CRL_INDEX_VERSION           1
+#define CRL_INDEX_HASH_LEN          16
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t hashLen;
+    uint64_t count;
+    int64_t lastUpdate;
+    int64_t nextUpdate;                 // 没有nextUpdate时为0
+    char crlNumber[48];                 // 十六进制, 没有crl编号时为空
+    unsigned char issuerHash[SHA256_DIGEST_LENGTH];
+} crl_index_header;
+
+typedef struct
+{
+    unsigned char hash[CRL_INDEX_HASH_LEN];
+    int64_t revokeTime;
+} crl_index_entry;
+
+static int64_t ASN1_TIME_to_utc(const ASN1_TIME *time)
+{
+    struct tm t;
+    if (NULL == time || 1 != ASN1_TIME_to_tm(time, &t)) {
+        return 0;
+    }
+    return (int64_t)timegm(&t);
+}
+
+static void crlIndexSerialHash(const ASN1_INTEGER *serial, unsigned char hash[CRL_INDEX_HASH_LEN])
+{
+    std::string key = crlSerialKey(serial);
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256((const unsigned char*)key.data(), key.size(), digest);
+    memcpy(hash, digest, CRL_INDEX_HASH_LEN);
+}
+
+static void crlIndexIssuerHash(X509_NAME *issuer, unsigned char hash[SHA256_DIGEST_LENGTH])
+{
+    unsigned char *der = NULL;
+    int len = i2d_X509_NAME(issuer, &der);
+    SHA256(der, len > 0 ? len : 0, hash);
+    OPENSSL_free(der);
+}
+
+static bool crlIndexEntryLess(const crl_index_entry &a, const crl_index_entry &b)
+{
+    return memcmp(a.hash, b.hash, CRL_INDEX_HASH_LEN) < 0;
+}
+
+int CRL_BuildIndex(X509_CRL *Crl, const char *indexPath, X509 *rootCert)
+{
+    if (NULL == Crl || NULL == indexPath) {
+        LOG_ERROR("Crl or index path is null.");
+        return -1;
+    }
+
+    if (NULL != rootCert) {
+        EVP_PKEY *rootKey = X509_get0_pubkey(rootCert);
+        if (NULL == rootKey || 1 != X509_CRL_verify(Crl, rootKey)) {
+            LOG_ERROR("Crl is not signed by root cert.");
+            return -1;
+        }
+    }
+
+    crl_index_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CRL_INDEX_MAGIC, sizeof(CRL_INDEX_MAGIC));
+    header.version = CRL_INDEX_VERSION;
+    header.hashLen = CRL_INDEX_HASH_LEN;
+    header.lastUpdate = ASN1_TIME_to_utc(X509_CRL_get0_lastUpdate(Crl));
+    header.nextUpdate = ASN1_TIME_to_utc(X509_CRL_get0_nextUpdate(Crl));
+    crlIndexIssuerHash(X509_CRL_get_issuer(Crl), header.issuerHash);
+
+    ASN1_INTEGER *crlNumber = (ASN1_INTEGER*)X509_CRL_get_ext_d2i(Crl, NID_crl_number, NULL, NULL);
+    if (NULL != crlNumber) {
+        BIGNUM *bn = ASN1_INTEGER_to_BN(crlNumber, NULL);
+        char *hex = NULL == bn ? NULL : BN_bn2hex(bn);
+        if (NULL != hex) {
+            strncpy(header.crlNumber, hex, sizeof(header.crlNumber) - 1);
+        }
+        OPENSSL_free(hex);
+        BN_free(bn);
+        ASN1_INTEGER_free(crlNumber);
+    }
+
+    STACK_OF(X509_REVOKED) *revoked = X509_CRL_get_REVOKED(Crl);
+    int count = sk_X509_REVOKED_num(revoked);
+    std::vector<crl_index_entry> entries(count > 0 ? count : 0);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const X509_REVOKED *entry = sk_X509_REVOKED_value(revoked, (int)i);
+        crlIndexSerialHash(X509_REVOKED_get0_serialNumber(entry), entries[i].hash);
+        entries[i].revokeTime = ASN1_TIME_to_utc(X509_REVOKED_get0_revocationDate(entry));
+    }
+    std::sort(entries.begin(), entries.end(), crlIndexEntryLess);
+    header.count = entries.size();
+
+    // 写临时文件后改名, 正在使用旧索引的进程继续读取原来的文件
+    std::string tmpPath = std::string(indexPath) + ".tmp";
+    std::ofstream ofs(tmpPath.c_str(), std::ios::binary | std::ios::trunc);
+    ofs.write((const char*)&header, sizeof(header));
+    if (!entries.empty()) {
+        ofs.write((const char*)&entries[0], entries.size() * sizeof(crl_index_entry));
+    }
+    ofs.close();
+    if (!ofs) {
+        LOG_ERROR("Failed to write crl index: {}.", tmpPath);
+        unlink(tmpPath.c_str());
+        return -1;
+    }
+
+    if (0 != rename(tmpPath.c_str(), indexPath)) {
+        LOG_ERROR("Failed to rename crl index: {} to {}.", tmpPath, indexPath);
+        unlink(tmpPath.c_str());
+        return -1;
+    }
+
+    return 0;
+}
+
+int CRL_BuildIndexFromPath(const char *crlPath, const char *indexPath, const char *rootCertPath, const char *format)
+{
+    X509 *rootCert = NULL;
+    if (NULL != rootCertPath) {
+        rootCert = LoadX509FromPath(rootCertPath, format);
+        if (NULL == rootCert) {
+            LOG_ERROR("Failed to load x509 from path: {}.", rootCertPath);
+            return -1;
+        }
+    }
+
+    X509_CRL *Crl = LoadCRLFromPath(crlPath, format);
+    if (NULL == Crl) {
+        LOG_ERROR("Failed to load CRL from path: {}.", crlPath);
+        FreeX509(rootCert);
+        return -1;
+    }
+
+    int iRet = CRL_BuildIndex(Crl, indexPath, rootCert);
     FreeX509(rootCert);
     FreeX509CRL(Crl);
-    FreeX509(userCert);
+    return iRet;
+}
+
+CrlIndex::CrlIndex() : m_data(NULL), m_size(0)
+{
+}
+
+CrlIndex::~CrlIndex()
+{
+    close();
+}
+
+int CrlIndex::open(const char *indexPath)
+{
+    close();
+
+    int fd = ::open(indexPath, O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("Failed to open crl index: {}.", indexPath);
+        return -1;
+    }
+
+    struct stat st;
+    if (0 != fstat(fd, &st) || (size_t)st.st_size < sizeof(crl_index_header)) {
+        LOG_ERROR("Crl index too small: {}.", indexPath);
+        ::close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (MAP_FAILED == addr) {
+        LOG_ERROR("Failed to mmap crl index: {}.", indexPath);
+        return -1;
+    }
+
+    const crl_index_header *header = (const crl_index_header*)addr;
+    if (0 != memcmp(header->magic, CRL_INDEX_MAGIC, sizeof(CRL_INDEX_MAGIC))
+        || CRL_INDEX_VERSION != header->version
+        || CRL_INDEX_HASH_LEN != header->hashLen
+        || header->count > (size - sizeof(crl_index_header)) / sizeof(crl_index_entry)
+        || size != sizeof(crl_index_header) + header->count * sizeof(crl_index_entry)) {
+        LOG_ERROR("Invalid crl index: {}.", indexPath);
+        munmap(addr, size);
+        return -1;
+    }
+
+    // 二分查找随机访问, 不需要预读
+    madvise(addr, size, MADV_RANDOM);
+    m_data = (char*)addr;
+    m_size = size;
+    return 0;
+}
+
+void CrlIndex::close()
+{
+    if (NULL != m_data) {
+        munmap(m_data, m_size);
+        m_data = NULL;
+        m_size = 0;
+    }
+}
+
+int CrlIndex::isRevoked(const ASN1_INTEGER *serial, bool &revoked, time_t *revokeTime) const
+{
+    revoked = false;
+    if (NULL == m_data || NULL == serial) {
+        LOG_ERROR("Crl index is not opened.");
+        return -1;
+    }
+
+    const crl_index_header *header = (const crl_index_header*)m_data;
+    const crl_index_entry *begin = (const crl_index_entry*)(m_data + sizeof(crl_index_header));
+    const crl_index_entry *end = begin + header->count;
+
+    crl_index_entry key;
+    crlIndexSerialHash(serial, key.hash);
+    const crl_index_entry *it = std::lower_bound(begin, end, key, crlIndexEntryLess);
+    if (it != end && 0 == memcmp(it->hash, key.hash, CRL_INDEX_HASH_LEN)) {
+        revoked = true;
+        if (NULL != revokeTime) {
+            *revokeTime = (time_t)it->revokeTime;
+        }
+    }
+
     return 0;
 }
 
+int CrlIndex::isRevoked(X509 *userCert, bool &revoked, time_t *revokeTime) const
+{
+    revoked = false;
+    if (NULL == m_data || NULL == userCert) {
+        LOG_ERROR("Crl index is not opened.");
+        return -1;
+    }
+
+    unsigned char issuerHash[SHA256_DIGEST_LENGTH];
+    crlIndexIssuerHash(X509_get_issuer_name(userCert), issuerHash);
+    if (0 != memcmp(issuerHash, ((const crl_index_header*)m_data)->issuerHash, SHA256_DIGEST_LENGTH)) {
+        LOG_ERROR("Cert issuer is not the crl issuer.");
+        return -1;
+    }
+
+    return isRevoked(X509_get0_serialNumber(userCert), revoked, revokeTime);
+}
+
+size_t CrlIndex::count() const
+{
+    return NULL == m_data ? 0 : (size_t)((const crl_index_header*)m_data)->count;
+}
+
+time_t CrlIndex::lastUpdate() const
+{
+    return NULL == m_data ? 0 : (time_t)((const crl_index_header*)m_data)->lastUpdate;
+}
+
+time_t CrlIndex::nextUpdate() const
+{
+    return NULL == m_data ? 0 : (time_t)((const crl_index_header*)m_data)->nextUpdate;
+}
+
+std::string CrlIndex::crlNumber() const
+{
+    if (NULL == m_data) {
+        return "";
+    }
+
+    const crl_index_header *header = (const crl_index_header*)m_data;
+    return std::string(header->crlNumber, strnlen(header->crlNumber, sizeof(header->crlNumber)));
+}
+
 static void opensslPrintX509Name(std::string &x509Name,
                                  X509_NAME *nm,
                                  unsigned long lflags = XN_FLAG_COMPAT)
@@ -981,7 +2906,7 @@ int GetPfxCertNameSubject(const std::string &pfx,
     int iRet = 0;
 
     openssl_x509_pkey pfxPkey = {0};
-    iRet = openssl_read_pfx_from_buf(pfx.c_str(), pfx.size(), pfxPasswd.c_str(), pfxPkey);
+    iRet = openssl_read_pfx_cached(pfx, pfxPasswd, pfxPkey);
     if (0 != iRet) {
         LOG_ERROR("Failed to read pfx.");
         openssl_free_pfx(pfxPkey);
@@ -1088,7 +3013,7 @@ int GetPfxPKeyType(const std::string &pfx,
     int iRet = 0;
 
     openssl_x509_pkey pfxPkey = {0};
-    iRet = openssl_read_pfx_from_buf(pfx.c_str(), pfx.size(), pfxPasswd.c_str(), pfxPkey);
+    iRet = openssl_read_pfx_cached(pfx, pfxPasswd, pfxPkey);
     if (0 != iRet) {
         LOG_ERROR("Failed to read pfx.");
         openssl_free_pfx(pfxPkey);
@@ -1125,7 +3050,7 @@ int GetPfxCertNameIssuer(const std::string &pfx,
     int iRet = 0;
 
     openssl_x509_pkey pfxPkey = {0};
-    iRet = openssl_read_pfx_from_buf(pfx.c_str(), pfx.size(), pfxPasswd.c_str(), pfxPkey);
+    iRet = openssl_read_pfx_cached(pfx, pfxPasswd, pfxPkey);
     if (0 != iRet) {
         LOG_ERROR("Failed to read pfx.");
         openssl_free_pfx(pfxPkey);
@@ -1241,4 +3166,588 @@ int PKCS7_get_info(PKCS7 *pkcs7, std::string &p7Info)
     return 0;
 }
 
+////////////////////////////////////////////////////////////////
+/////////////////////////////PDF签名接口//////////////////////////
+////////////////////////////////////////////////////////////////
+#define PDF_BYTE_RANGE          "/ByteRange"
+#define PDF_MAP_CHUNK           (64 * 1024 * 1024)      // mmap的PDF每处理64M释放已读取的页面
+
+/**
+ * @brief 释放mmap的PDF中[begin, end)已读取的页面, 页面仍在页缓存中, 再次访问不需要读盘
+ */
+static void pdfReleasePages(const char *data, size_t begin, size_t end)
+{
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    begin = (begin + pageSize - 1) / pageSize * pageSize;
+    end = end / pageSize * pageSize;
+    if (begin < end) {
+        madvise((void*)(data + begin), end - begin, MADV_DONTNEED);
+    }
+}
+
+/**
+ * @brief 从from开始查找"/ByteRange", mapped时按块查找并释放已查找的页面
+ */
+static const char *pdfFindByteRange(const char *data, size_t len, size_t from, bool mapped)
+{
+    const size_t keyLen = sizeof(PDF_BYTE_RANGE) - 1;
+    while (from < len) {
+        size_t chunkEnd = std::min(len, from + PDF_MAP_CHUNK);
+        size_t searchEnd = std::min(len, chunkEnd + keyLen - 1);
+        const char *p = (const char*)memmem(data + from, searchEnd - from, PDF_BYTE_RANGE, keyLen);
+        if (NULL != p) {
+            return p;
+        }
+
+        if (mapped) {
+            pdfReleasePages(data, from, chunkEnd);
+        }
+        from = chunkEnd;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief 计算PDF中[offset, offset + len)的摘要, mapped时按块计算并释放已读取的页面
+ */
+static int pdfDigestUpdate(EVP_MD_CTX *mdCtx, const char *data, size_t offset, size_t len, bool mapped)
+{
+    while (len > 0) {
+        size_t n = std::min(len, (size_t)PDF_MAP_CHUNK);
+        if (1 != EVP_DigestUpdate(mdCtx, data + offset, n)) {
+            return -1;
+        }
+
+        if (mapped) {
+            pdfReleasePages(data, offset, offset + n);
+        }
+        offset += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+static bool pdfIsSpace(char c)
+{
+    return ' ' == c || '\n' == c || '\r' == c || '\t' == c || '\f' == c || '\0' == c;
+}
+
+/**
+ * @brief 解析"/ByteRange"之后的[a b c d]
+ * @param [IN] p            "/ByteRange"之后的位置
+ * @param [IN] end          数据结尾
+ * @param [OUT] byteRange   4个数
+ * @return bool
+ */
+static bool pdfParseByteRange(const char *p, const char *end, unsigned long long byteRange[4])
+{
+    while (p < end && pdfIsSpace(*p)) {
+        ++p;
+    }
+    if (p >= end || '[' != *p++) {
+        return false;
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        while (p < end && pdfIsSpace(*p)) {
+            ++p;
+        }
+
+        const char *digits = p;
+        unsigned long long value = 0;
+        while (p < end && *p >= '0' && *p <= '9' && p - digits < 19) {
+            value = value * 10 + (*p++ - '0');
+        }
+        if (p == digits) {
+            return false;
+        }
+        byteRange[i] = value;
+    }
+
+    while (p < end && pdfIsSpace(*p)) {
+        ++p;
+    }
+    return p < end && ']' == *p;
+}
+
+/**
+ * @brief /Contents的十六进制字符串解码, 忽略空白, 结尾补齐的0由d2i忽略
+ */
+static int pdfHexDecode(const char *begin, const char *end, std::string &out)
+{
+    out.clear();
+    out.reserve((end - begin) / 2);
+
+    int high = -1;
+    for (const char *p = begin; p < end; ++p) {
+        int v = 0;
+        if (*p >= '0' && *p <= '9') {
+            v = *p - '0';
+        } else if (*p >= 'a' && *p <= 'f') {
+            v = *p - 'a' + 10;
+        } else if (*p >= 'A' && *p <= 'F') {
+            v = *p - 'A' + 10;
+        } else if (pdfIsSpace(*p)) {
+            continue;
+        } else {
+            return -1;
+        }
+
+        if (high < 0) {
+            high = v;
+        } else {
+            out.push_back((char)(high << 4 | v));
+            high = -1;
+        }
+    }
+
+    return out.empty() ? -1 : 0;
+}
+
+/**
+ * @brief 验证一个签名: 解析/Contents中的CMS, 按ByteRange从PDF数据计算摘要并与messageDigest比较
+ */
+static int pdfVerifySignature(const char *pdfData, size_t pdfLen, bool mapped, pdf_signature_info &info)
+{
+    const unsigned long long *range = info.byteRange;
+    if (0 != range[0] || range[1] >= range[2] || range[2] > pdfLen || range[3] > pdfLen - range[2]
+        || '<' != pdfData[range[1]] || '>' != pdfData[range[2] - 1]) {
+        LOG_ERROR("Invalid byte range: [{} {} {} {}].", range[0], range[1], range[2], range[3]);
+        return -1;
+    }
+    info.coversWholeFile = range[2] + range[3] == pdfLen;
+
+    std::string contents;
+    if (0 != pdfHexDecode(pdfData + range[1] + 1, pdfData + range[2] - 1, contents)) {
+        LOG_ERROR("Invalid signature contents at: {}.", range[1]);
+        return -1;
+    }
+
+    BIO *bioContents = BIO_new_mem_buf(&contents[0], contents.size());
+    if (NULL == bioContents) {
+        LOG_ERROR("Failed to new bio mem buf.");
+        return -1;
+    }
+
+    CMS_SignerInfo *sigInfo = NULL;
+    CMS_ContentInfo *cms = CMS_get_signerinfo(bioContents, sigInfo);
+    BIO_free(bioContents);
+    bioContents = NULL;
+    if (NULL == cms || NULL == sigInfo) {
+        LOG_ERROR("Failed to get signer info.");
+        CMS_ContentInfo_free(cms);
+        return -1;
+    }
+
+    X509_NAME *issuerName = NULL;
+    CMS_SignerInfo_get0_signer_id(sigInfo, NULL, &issuerName, NULL);
+    if (NULL != issuerName) {
+        opensslPrintX509Name(info.signerIssuer, issuerName);
+    }
+
+    X509_ALGOR *digestAlg = NULL;
+    CMS_SignerInfo_get0_algs(sigInfo, NULL, NULL, &digestAlg, NULL);
+    const ASN1_OBJECT *digestObj = NULL;
+    if (NULL != digestAlg) {
+        X509_ALGOR_get0(&digestObj, NULL, NULL, digestAlg);
+    }
+    const EVP_MD *md = NULL == digestObj ? NULL : EVP_get_digestbyobj(digestObj);
+    if (NULL == md) {
+        LOG_ERROR("Unknown signature digest algorithm.");
+        CMS_ContentInfo_free(cms);
+        return -1;
+    }
+    info.digestAlgorithm = OBJ_nid2ln(EVP_MD_type(md));
+
+    // 直接从PDF数据计算两段ByteRange的摘要
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digestLen = 0;
+    EVP_MD_CTX *mdCtx = EVP_MD_CTX_new();
+    if (NULL == mdCtx
+        || 1 != EVP_DigestInit_ex(mdCtx, md, NULL)
+        || 0 != pdfDigestUpdate(mdCtx, pdfData, range[0], range[1], mapped)
+        || 0 != pdfDigestUpdate(mdCtx, pdfData, range[2], range[3], mapped)
+        || 1 != EVP_DigestFinal_ex(mdCtx, digest, &digestLen)) {
+        LOG_ERROR("Failed to digest byte range.");
+        EVP_MD_CTX_free(mdCtx);
+        CMS_ContentInfo_free(cms);
+        return -1;
+    }
+    EVP_MD_CTX_free(mdCtx);
+
+    const ASN1_OCTET_STRING *messageDigest = (const ASN1_OCTET_STRING*)CMS_signed_get0_data_by_OBJ(
+        sigInfo, OBJ_nid2obj(NID_pkcs9_messageDigest), -3, V_ASN1_OCTET_STRING);
+    if (NULL == messageDigest) {
+        LOG_ERROR("Signature has no signed attributes, not supported.");
+    } else {
+        info.digestValid = (int)digestLen == ASN1_STRING_length(messageDigest)
+                           && 0 == memcmp(digest, ASN1_STRING_get0_data(messageDigest), digestLen);
+    }
+
+    // 签名证书从CMS中查找, 只验证签名属性的签名, 不验证证书链
+    if (NULL != messageDigest && 0 < CMS_set1_signers_certs(cms, NULL, 0)) {
+        info.signatureValid = 1 == CMS_SignerInfo_verify(sigInfo);
+    }
+    ERR_clear_error();
+
+    CMS_ContentInfo_free(cms);
+    return 0;
+}
+
+static int pdfVerifySignatures(const char *pdfData, size_t pdfLen, bool mapped, std::vector<pdf_signature_info> &signatures)
+{
+    signatures.clear();
+    if (NULL == pdfData || 0 == pdfLen) {
+        LOG_ERROR("Empty pdf data.");
+        return -1;
+    }
+
+    const size_t keyLen = sizeof(PDF_BYTE_RANGE) - 1;
+    for (const char *p = pdfFindByteRange(pdfData, pdfLen, 0, mapped); NULL != p;
+         p = pdfFindByteRange(pdfData, pdfLen, p - pdfData + keyLen, mapped)) {
+        pdf_signature_info info;
+        memset(info.byteRange, 0, sizeof(info.byteRange));
+        info.coversWholeFile = false;
+        info.digestValid = false;
+        info.signatureValid = false;
+        if (!pdfParseByteRange(p + keyLen, pdfData + pdfLen, info.byteRange)) {
+            continue;
+        }
+
+        if (0 != pdfVerifySignature(pdfData, pdfLen, mapped, info)) {
+            LOG_ERROR("Failed to verify pdf signature at: {}.", p - pdfData);
+            return -1;
+        }
+        signatures.push_back(info);
+    }
+
+    if (signatures.empty()) {
+        LOG_ERROR("No signature in pdf.");
+        return -1;
+    }
+
+    return 0;
+}
+
+int PDF_VerifySignaturesFromBuf(const char *pdfData, size_t pdfLen, std::vector<pdf_signature_info> &signatures)
+{
+    return pdfVerifySignatures(pdfData, pdfLen, false, signatures);
+}
+
+int PDF_VerifySignatures(const char *pdfPath, std::vector<pdf_signature_info> &signatures)
+{
+    signatures.clear();
+    int fd = ::open(pdfPath, O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("Failed to open pdf: {}.", pdfPath);
+        return -1;
+    }
+
+    struct stat st;
+    if (0 != fstat(fd, &st) || 0 == st.st_size) {
+        LOG_ERROR("Failed to stat pdf or empty pdf: {}.", pdfPath);
+        ::close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (MAP_FAILED == addr) {
+        LOG_ERROR("Failed to mmap pdf: {}.", pdfPath);
+        return -1;
+    }
+
+    // 查找签名和计算摘要都是顺序读取
+    madvise(addr, size, MADV_SEQUENTIAL);
+    int iRet = pdfVerifySignatures((const char*)addr, size, true, signatures);
+    munmap(addr, size);
+    return iRet;
+}
+
+////////////////////////////////////////////////////////////////
+/////////////////////////////签名验证接口/////////////////////////
+////////////////////////////////////////////////////////////////
+#define SIGN_VERIFY_THREAD_CACHE        64          // 每个线程最多保存的模板副本数
+
+/**
+ * 一个公钥的验签模板: 已完成EVP_DigestVerifyInit和SM2的Z值计算, 只用于复制
+ */
+struct SignVerifyKey
+{
+    SignVerifyKey() : id(0), tmpl(NULL), pctx(NULL), pkey(NULL) {}
+    ~SignVerifyKey()
+    {
+        EVP_MD_CTX_free(tmpl);
+        EVP_PKEY_CTX_free(pctx);
+        EVP_PKEY_free(pkey);
+    }
+
+    unsigned long long id;          // 每次添加唯一, 线程副本按id查找
+    EVP_MD_CTX *tmpl;
+    EVP_PKEY_CTX *pctx;             // SM2: EVP_MD_CTX_set_pkey_ctx设置, 不归tmpl所有
+    EVP_PKEY *pkey;
+    std::mutex mutex;               // 复制模板
+};
+
+/**
+ * 每个线程的模板副本和验签上下文
+ */
+struct SignVerifyThreadCtx
+{
+    SignVerifyThreadCtx() : work(EVP_MD_CTX_new()) {}
+    ~SignVerifyThreadCtx()
+    {
+        clear();
+        EVP_MD_CTX_free(work);
+    }
+
+    void clear()
+    {
+        for (auto &it : templates) {
+            EVP_MD_CTX_free(it.second);
+        }
+        templates.clear();
+    }
+
+    EVP_MD_CTX *work;
+    std::unordered_map<unsigned long long, EVP_MD_CTX*> templates;
+};
+
+static thread_local SignVerifyThreadCtx signVerifyThreadCtx;
+static std::atomic<unsigned long long> signVerifyKeyId(0);
+
+class SignVerifierPrivate
+{
+public:
+    std::shared_ptr<SignVerifyKey> find(const std::string &certDigest) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = keys.find(certDigest);
+        return it == keys.end() ? std::shared_ptr<SignVerifyKey>() : it->second;
+    }
+
+    int verify(const std::string &certDigest, const char *data, size_t dataLen,
+               const unsigned char *sig, size_t sigLen, bool &valid) const;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<SignVerifyKey> > keys;
+};
+
+static bool signVerifyIsSM2(EVP_PKEY *pkey)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    return 1 == EVP_PKEY_is_a(pkey, "SM2");
+#else
+    if (EVP_PKEY_EC != EVP_PKEY_base_id(pkey)) {
+        return false;
+    }
+    const EC_KEY *ecKey = EVP_PKEY_get0_EC_KEY(pkey);
+    return NULL != ecKey && NID_sm2 == EC_GROUP_get_curve_name(EC_KEY_get0_group(ecKey));
+#endif
+}
+
+/**
+ * 验签使用的公钥: 1.1.1中EC公钥复制一份并预计算基点倍点表, SM2设置为SM2类型, 不修改证书的公钥
+ */
+static EVP_PKEY *signVerifyKeyNew(EVP_PKEY *pkey, bool sm2)
+{
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+    if (EVP_PKEY_EC == EVP_PKEY_base_id(pkey)) {
+        EC_KEY *ecKey = EC_KEY_dup(EVP_PKEY_get0_EC_KEY(pkey));
+        EVP_PKEY *ecPkey = EVP_PKEY_new();
+        if (NULL == ecKey || NULL == ecPkey || 1 != EVP_PKEY_assign_EC_KEY(ecPkey, ecKey)) {
+            EC_KEY_free(ecKey);
+            EVP_PKEY_free(ecPkey);
+            return NULL;
+        }
+
+        (void)EC_KEY_precompute_mult(ecKey, NULL);
+        if (sm2 && 1 != EVP_PKEY_set_alias_type(ecPkey, EVP_PKEY_SM2)) {
+            EVP_PKEY_free(ecPkey);
+            return NULL;
+        }
+        return ecPkey;
+    }
+#else
+    (void)sm2;
+#endif
+
+    EVP_PKEY_up_ref(pkey);
+    return pkey;
+}
+
+SignVerifier::SignVerifier() : d(new SignVerifierPrivate())
+{
+}
+
+SignVerifier::~SignVerifier()
+{
+    delete d;
+}
+
+int SignVerifier::addCert(X509 *cert, std::string &certDigest, const char *mdName, const std::string &sm2Id)
+{
+    EVP_PKEY *certKey = NULL == cert ? NULL : X509_get0_pubkey(cert);
+    if (NULL == certKey) {
+        LOG_ERROR("Failed to get cert public key.");
+        return -1;
+    }
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digestLen = 0;
+    if (1 != X509_digest(cert, EVP_sha256(), digest, &digestLen)) {
+        LOG_ERROR("Failed to digest cert.");
+        return -1;
+    }
+
+    static const char hex[] = "0123456789abcdef";
+    certDigest.clear();
+    for (unsigned int i = 0; i < digestLen; ++i) {
+        certDigest.push_back(hex[digest[i] >> 4]);
+        certDigest.push_back(hex[digest[i] & 0x0F]);
+    }
+
+    bool sm2 = signVerifyIsSM2(certKey);
+    const EVP_MD *md = NULL != mdName ? EVP_get_digestbyname(mdName) : (sm2 ? EVP_sm3() : EVP_sha256());
+    if (NULL == md) {
+        LOG_ERROR("Unknown digest: {}.", mdName);
+        return -1;
+    }
+
+    std::shared_ptr<SignVerifyKey> key = std::make_shared<SignVerifyKey>();
+    key->id = ++signVerifyKeyId;
+    key->pkey = signVerifyKeyNew(certKey, sm2);
+    key->tmpl = EVP_MD_CTX_new();
+    if (NULL == key->pkey || NULL == key->tmpl) {
+        LOG_ERROR("Failed to new verify context.");
+        return -1;
+    }
+
+    if (sm2) {
+        key->pctx = EVP_PKEY_CTX_new(key->pkey, NULL);
+        if (NULL == key->pctx
+            || 1 != EVP_PKEY_CTX_set1_id(key->pctx, sm2Id.data(), sm2Id.size())) {
+            LOG_ERROR("Failed to set sm2 id.");
+            return -1;
+        }
+        EVP_MD_CTX_set_pkey_ctx(key->tmpl, key->pctx);
+    }
+
+    // 空数据update完成SM2的Z值计算, 复制的上下文不再重复计算
+    if (1 != EVP_DigestVerifyInit(key->tmpl, NULL, md, NULL, key->pkey)
+        || 1 != EVP_DigestVerifyUpdate(key->tmpl, "", 0)) {
+        LOG_ERROR("Failed to init digest verify.");
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->keys[certDigest] = key;
+    return 0;
+}
+
+void SignVerifier::removeCert(const std::string &certDigest)
+{
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->keys.erase(certDigest);
+}
+
+int SignVerifierPrivate::verify(const std::string &certDigest, const char *data, size_t dataLen,
+                                const unsigned char *sig, size_t sigLen, bool &valid) const
+{
+    valid = false;
+    std::shared_ptr<SignVerifyKey> key = find(certDigest);
+    if (!key) {
+        LOG_ERROR("Cert not added: {}.", certDigest);
+        return -1;
+    }
+
+    SignVerifyThreadCtx &threadCtx = signVerifyThreadCtx;
+    EVP_MD_CTX *tmpl = NULL;
+    auto it = threadCtx.templates.find(key->id);
+    if (it != threadCtx.templates.end()) {
+        tmpl = it->second;
+    } else {
+        if (threadCtx.templates.size() >= SIGN_VERIFY_THREAD_CACHE) {
+            threadCtx.clear();
+        }
+
+        tmpl = EVP_MD_CTX_new();
+        int iRet = 0;
+        {
+            std::lock_guard<std::mutex> lock(key->mutex);
+            iRet = NULL == tmpl ? 0 : EVP_MD_CTX_copy_ex(tmpl, key->tmpl);
+        }
+        if (1 != iRet) {
+            LOG_ERROR("Failed to copy verify context.");
+            EVP_MD_CTX_free(tmpl);
+            return -1;
+        }
+        threadCtx.templates[key->id] = tmpl;
+    }
+
+    if (NULL == threadCtx.work || 1 != EVP_MD_CTX_copy_ex(threadCtx.work, tmpl)) {
+        LOG_ERROR("Failed to copy verify context.");
+        return -1;
+    }
+
+    if (1 != EVP_DigestVerifyUpdate(threadCtx.work, data, dataLen)) {
+        LOG_ERROR("Failed to digest verify update.");
+        return -1;
+    }
+
+    // 签名格式错误也作为验证失败
+    valid = 1 == EVP_DigestVerifyFinal(threadCtx.work, sig, sigLen);
+    ERR_clear_error();
+    return 0;
+}
+
+int SignVerifier::verify(const std::string &certDigest, const char *data, size_t dataLen,
+                         const unsigned char *sig, size_t sigLen, bool &valid) const
+{
+    return d->verify(certDigest, data, dataLen, sig, sigLen, valid);
+}
+
+int SignVerifier::verify(const std::string &certDigest, const std::string &data, const std::string &sig, bool &valid) const
+{
+    return d->verify(certDigest, data.data(), data.size(), (const unsigned char*)sig.data(), sig.size(), valid);
+}
+
+int SignVerifier::verifyBatch(const std::vector<sign_verify_item> &items, std::vector<int> &results,
+                              unsigned int threadNum) const
+{
+    results.assign(items.size(), -1);
+    if (0 == threadNum) {
+        threadNum = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threadNum = (unsigned int)std::min<size_t>(threadNum, items.size());
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    auto worker = [&]() {
+        for (size_t i = next++; i < items.size(); i = next++) {
+            const sign_verify_item &item = items[i];
+            bool valid = false;
+            if (0 != d->verify(item.certDigest, item.data, item.dataLen, item.sig, item.sigLen, valid)) {
+                failed = true;
+                continue;
+            }
+            results[i] = valid ? 1 : 0;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < threadNum; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    return failed ? -1 : 0;
+}
+
 } /* namespace encryptUtil */
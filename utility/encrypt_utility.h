@@ -1,6 +1,7 @@
 #ifndef __ENCRYPT_UTILITY_H__
 #define __ENCRYPT_UTILITY_H__
 
+#include <iosfwd>
 #include <string>
 #include <vector>
 
@@ -92,6 +93,64 @@ X509_CRL *LoadCRLFromBuf(const char *crlBuf, size_t crlLen, const char *format =
  */
 void FreeX509CRL(X509_CRL *crl);
 
+/**
+ * 证书和crl解析缓存: LoadX509FromPath、LoadX509FromBuf、LoadCRLFromPath、LoadCRLFromBuf使用
+ * 路径按(路径, 修改时间, 大小)缓存, 内存数据按内容SHA256缓存; 返回增加引用计数的共享对象,
+ * 调用方仍用FreeX509、FreeX509CRL释放, 不能修改返回的对象
+ */
+typedef struct
+{
+    std::string subject;            // 同GetX509NameSubject
+    std::string issuer;             // 同GetX509NameIssuer
+    time_t startTime;               // 同openssl_get_x509_valid_time
+    time_t endTime;
+    std::string signatureOID;       // 同X509_GetSignatureOIDText
+} x509_info;
+
+/**
+ * @brief 读取证书的常用信息, 解析结果和信息一起缓存
+ * @param [IN] x509Path         证书路径
+ * @param [OUT] info            主题、颁发者、有效期、签名算法OID
+ * @param [IN] format           证书格式: PEM、ASN1
+ * @return int
+ * 成功: 0
+ * 失败: -1
+ * @note
+ */
+int GetX509InfoFromPath(const char *x509Path, x509_info &info, const char *format = "PEM");
+int GetX509InfoFromBuf(const char *x509Buf, size_t x509Len, x509_info &info, const char *format = "PEM");
+
+typedef struct
+{
+    unsigned long long hits;        // 命中次数
+    unsigned long long misses;      // 未命中次数(解析证书或crl)
+    size_t size;                    // 当前缓存的证书和crl数
+    size_t capacity;                // 最多缓存数
+} x509_cache_stats;
+
+/**
+ * @brief 读取证书和crl解析缓存统计
+ * @param [OUT] stats       命中/未命中次数和缓存大小
+ * @return void
+ * @note
+ */
+void X509_cache_stats(x509_cache_stats &stats);
+
+/**
+ * @brief 设置证书和crl解析缓存大小, 超出的缓存项按LRU淘汰
+ * @param [IN] capacity     最多缓存的证书和crl数, 0: 不缓存
+ * @return void
+ * @note
+ */
+void X509_cache_set_capacity(size_t capacity);
+
+/**
+ * @brief 清空证书和crl解析缓存, 已返回的对象不受影响
+ * @return void
+ * @note
+ */
+void X509_cache_clear();
+
 /**
  * @brief 判断用户证书是否被吊销
  * @param [IN] rootCert             根证书
@@ -118,6 +177,158 @@ int CRL_Verify(X509 *rootCert, X509_CRL *Crl, X509 *userCert, bool &certValid);
  */
 int CRL_VerifyFromPath(const char *rootCertPath, const char *crlPath, const char *userCertPath, bool &certValid);
 
+class CrlVerifierPrivate;
+
+/**
+ * 常驻的吊销检查对象: 预先建立根证书的X509_STORE, 吊销列表建立排序的序列号索引,
+ * verify不再为每次调用建立证书库和遍历吊销列表; 结果与CRL_Verify相同
+ * @note
+ * verify可以多线程并发调用, 读取路径不加锁; 从路径加载时每秒最多检查一次文件修改时间,
+ * 根证书或crl文件改变后重新加载, 加载失败时继续使用原来的数据
+ */
+class CrlVerifier
+{
+public:
+    CrlVerifier();
+    ~CrlVerifier();
+
+    /**
+     * @brief 加载根证书和吊销列表, 增加引用计数, 调用方仍需释放
+     * @param [IN] rootCert             根证书
+     * @param [IN] Crl                  吊销列表
+     * @return int
+     * 成功: 0
+     * 失败: -1
+     * @note
+     */
+    int load(X509 *rootCert, X509_CRL *Crl);
+
+    /**
+     * @brief 从路径加载根证书和吊销列表, 文件修改后verify时自动重新加载
+     * @param [IN] rootCertPath         根证书路径
+     * @param [IN] crlPath              crl路径
+     * @param [IN] format               证书和crl格式: PEM、ASN1
+     * @return int
+     * 成功: 0
+     * 失败: -1
+     * @note
+     */
+    int loadFromPath(const char *rootCertPath, const char *crlPath, const char *format = "PEM");
+
+    /**
+     * @brief 判断用户证书是否被吊销
+     * @param [IN] userCert             用户证书
+     * @param [OUT] certValid           同CRL_Verify
+     * @return int
+     * 成功: 0
+     * 失败: -1, 没有加载
+     * @note
+     */
+    int verify(X509 *userCert, bool &certValid) const;
+
+    /**
+     * @brief 吊销列表中的证书数
+     * @return size_t
+     */
+    size_t revokedCount() const;
+
+    CrlVerifier(const CrlVerifier &) = delete;
+    CrlVerifier &operator=(const CrlVerifier &) = delete;
+
+private:
+    CrlVerifierPrivate *d;
+};
+
+/**
+ * 吊销索引: 把crl编译成磁盘文件, 多个进程mmap同一文件共享页缓存, 不需要解析X509_CRL
+ * 文件格式(本机字节序):
+ * 文件头: magic "CRLIDX1", 版本, 条目数, crl的lastUpdate、nextUpdate(UTC秒), crl编号(十六进制), 颁发者名称的SHA256
+ * 条目: 序列号SHA256的前16字节 + 吊销时间(UTC秒), 按hash排序, 查询时二分查找
+ */
+
+/**
+ * @brief 从crl生成吊销索引文件
+ * @param [IN] Crl                  吊销列表
+ * @param [IN] indexPath            索引文件路径, 先写临时文件再改名, 已打开的索引不受影响
+ * @param [IN] rootCert             根证书, 不为NULL时检查crl签名
+ * @return int
+ * 成功: 0
+ * 失败: -1
+ * @note
+ */
+int CRL_BuildIndex(X509_CRL *Crl, const char *indexPath, X509 *rootCert = NULL);
+
+/**
+ * @brief 从crl文件生成吊销索引文件
+ * @param [IN] crlPath              crl路径
+ * @param [IN] indexPath            索引文件路径
+ * @param [IN] rootCertPath         根证书路径, 不为NULL时检查crl签名
+ * @param [IN] format               crl和证书格式: PEM、ASN1
+ * @return int
+ * 成功: 0
+ * 失败: -1
+ * @note
+ */
+int CRL_BuildIndexFromPath(const char *crlPath, const char *indexPath, const char *rootCertPath = NULL, const char *format = "PEM");
+
+/**
+ * mmap打开的吊销索引, 只读, 可以多线程并发查询
+ */
+class CrlIndex
+{
+public:
+    CrlIndex();
+    ~CrlIndex();
+
+    /**
+     * @brief 打开索引文件
+     * @param [IN] indexPath            索引文件路径
+     * @return int
+     * 成功: 0
+     * 失败: -1, 文件不存在或者格式错误
+     * @note
+     */
+    int open(const char *indexPath);
+    void close();
+
+    /**
+     * @brief 查询序列号是否被吊销
+     * @param [IN] serial               证书序列号
+     * @param [OUT] revoked             true: 被吊销，false: 没有被吊销
+     * @param [OUT] revokeTime          吊销时间(UTC秒), 不需要时传NULL
+     * @return int
+     * 成功: 0
+     * 失败: -1, 没有打开
+     * @note
+     */
+    int isRevoked(const ASN1_INTEGER *serial, bool &revoked, time_t *revokeTime = NULL) const;
+
+    /**
+     * @brief 查询证书是否被吊销
+     * @param [IN] userCert             用户证书
+     * @param [OUT] revoked             true: 被吊销，false: 没有被吊销
+     * @param [OUT] revokeTime          吊销时间(UTC秒), 不需要时传NULL
+     * @return int
+     * 成功: 0
+     * 失败: -1, 没有打开或者证书颁发者与crl不同
+     * @note
+     * 不检查证书签名和有效期
+     */
+    int isRevoked(X509 *userCert, bool &revoked, time_t *revokeTime = NULL) const;
+
+    size_t count() const;
+    time_t lastUpdate() const;
+    time_t nextUpdate() const;
+    std::string crlNumber() const;
+
+    CrlIndex(const CrlIndex &) = delete;
+    CrlIndex &operator=(const CrlIndex &) = delete;
+
+private:
+    char *m_data;
+    size_t m_size;
+};
+
 /**
  * PFX接口
  */
@@ -167,6 +378,45 @@ int openssl_read_pfx(const std::string &pfxInfo, const char *pw, openssl_x509_pk
  */
 void openssl_free_pfx(const openssl_x509_pkey &pfx);
 
+/**
+ * PFX解析缓存: (PFX数据SHA256, 密码SHA256) -> 证书、私钥(引用计数)
+ * CheckPfxCertValid、GetPfxCertNameSubject、GetPfxCertNameIssuer、GetPfxPKeyType使用,
+ * 同一PFX不再重复PKCS#12 MAC校验和密钥派生
+ */
+typedef struct
+{
+    unsigned long long hits;        // 命中次数
+    unsigned long long misses;      // 未命中次数(解析PFX)
+    size_t size;                    // 当前缓存的PFX数
+    size_t capacity;                // 最多缓存的PFX数
+    time_t ttl;                     // 缓存有效时间(秒)
+} pfx_cache_stats;
+
+/**
+ * @brief 读取PFX解析缓存统计
+ * @param [OUT] stats       命中/未命中次数和缓存大小
+ * @return void
+ * @note
+ */
+void PFX_cache_stats(pfx_cache_stats &stats);
+
+/**
+ * @brief 设置PFX解析缓存大小和有效时间
+ * @param [IN] capacity     最多缓存的PFX数, 0: 不缓存
+ * @param [IN] ttl          缓存有效时间(秒), 超时后重新解析
+ * @return void
+ * @note
+ * 超出的缓存项按LRU淘汰
+ */
+void PFX_cache_set_limits(size_t capacity, time_t ttl);
+
+/**
+ * @brief 清空PFX解析缓存, 已返回的证书、私钥不受影响
+ * @return void
+ * @note
+ */
+void PFX_cache_clear();
+
 /**
  * @brief 检查pfx中x509证书有效性, 包括有效期和是否吊销
  * @param [IN] pfxData          pfx证书缓存
@@ -212,6 +462,85 @@ std::string Base64Encode(const char *src, size_t srcLen);
  */
 int Base64Decode(const char *src, size_t srcLen, std::string &base64Decode);
 
+/**
+ * @brief base64流式编码, 输入可以按任意长度分块, 结果与一次编码相同
+ */
+class Base64Encoder
+{
+public:
+    Base64Encoder() : m_bufLen(0) {}
+
+    /**
+     * @brief 编码一块数据, 不足3字节的部分留到下次
+     * @param [IN] src          数据缓存
+     * @param [IN] srcLen       数据长度
+     * @param [OUT] dst         输出缓存, 不小于(srcLen + 2) / 3 * 4
+     * @return size_t 输出长度
+     * @note
+     */
+    size_t update(const char *src, size_t srcLen, char *dst);
+
+    /**
+     * @brief 结束编码, 输出剩余数据和'='
+     * @param [OUT] dst         输出缓存, 不小于4
+     * @return size_t 输出长度
+     * @note
+     */
+    size_t final(char *dst);
+
+private:
+    unsigned char m_buf[3];
+    size_t m_bufLen;
+};
+
+/**
+ * @brief base64流式解码, 输入可以按任意长度分块; 严格校验: 只接受标准字符, '='只能在数据末尾
+ */
+class Base64Decoder
+{
+public:
+    Base64Decoder() : m_bufLen(0), m_finished(false) {}
+
+    /**
+     * @brief 解码一块数据, 不足4字符的部分留到下次
+     * @param [IN] src          base64数据缓存
+     * @param [IN] srcLen       base64数据长度
+     * @param [OUT] dst         输出缓存, 不小于(srcLen + 3) / 4 * 3
+     * @param [OUT] dstLen      输出长度
+     * @return int
+     * 成功: 0
+     * 失败: -1, 非法字符或'='之后还有数据
+     * @note
+     */
+    int update(const char *src, size_t srcLen, char *dst, size_t &dstLen);
+
+    /**
+     * @brief 结束解码
+     * @return int
+     * 成功: 0
+     * 失败: -1, 剩余不完整的4字符组
+     * @note
+     */
+    int final();
+
+private:
+    unsigned char m_buf[4];
+    size_t m_bufLen;
+    bool m_finished;
+};
+
+/**
+ * @brief 流式base64编码/解码, 分块读取输入, 内存占用与数据大小无关
+ * @param [IN] is           输入流
+ * @param [OUT] os          输出流
+ * @return int
+ * 成功: 0
+ * 失败: -1
+ * @note
+ */
+int Base64Encode(std::istream &is, std::ostream &os);
+int Base64Decode(std::istream &is, std::ostream &os);
+
 /**
  * SM4加解密
  */
@@ -239,6 +568,129 @@ int SM4_DAO_encrypt(const std::string &inputSouce, const std::string &password,
  */
 int SM4_DAO_decrypt(const std::string &inputEncrypt, const std::string &password, std::string &decryptOutput);
 
+/**
+ * @brief SM4_DAO_encrypt输出长度(精确值)
+ * @param [IN] inputLen                 待加密数据长度
+ * @return size_t
+ * @note
+ */
+size_t SM4_DAO_encrypt_size(size_t inputLen);
+
+/**
+ * @brief SM4_DAO_decrypt输出长度上限, 实际长度在解密后确定(去掉padding)
+ * @param [IN] inputLen                 sm4加密过的数据长度
+ * @return size_t
+ * @note
+ */
+size_t SM4_DAO_decrypt_size(size_t inputLen);
+
+/**
+ * @brief 原数据加密到调用方提供的缓存，SM4_CBC加密和两次base64分块一次完成，没有中间结果
+ * @param [IN] input                    待加密数据缓存
+ * @param [IN] inputLen                 待加密数据缓存长度
+ * @param [IN] password                 加密密码，同SM4_DAO_encrypt
+ * @param [OUT] output                  输出缓存
+ * @param [IN] outputSize               输出缓存长度，不小于SM4_DAO_encrypt_size(inputLen)
+ * @param [OUT] outputLen               加密后的数据长度
+ * @return int
+ * 成功: 0
+ * 失败: -1
+ * @note
+ * 输出与SM4_DAO_encrypt相同, 不添加'\0'
+ */
+int SM4_DAO_encrypt(const char *input, size_t inputLen, const std::string &password,
+                    char *output, size_t outputSize, size_t &outputLen);
+
+/**
+ * @brief sm4加密后的数据解密到调用方提供的缓存，两次base64解码和SM4_CBC解密分块一次完成
+ * @param [IN] input                    sm4加密过的数据缓存
+ * @param [IN] inputLen                 sm4加密过的数据缓存长度
+ * @param [IN] password                 解密密码，同SM4_DAO_decrypt
+ * @param [OUT] output                  输出缓存
+ * @param [IN] outputSize               输出缓存长度，不小于SM4_DAO_decrypt_size(inputLen)
+ * @param [OUT] outputLen               解密后的数据长度
+ * @return int
+ * 成功: 0
+ * 失败: -1
+ * @note
+ * 失败时output中可能有部分数据
+ */
+int SM4_DAO_decrypt(const char *input, size_t inputLen, const std::string &password,
+                    char *output, size_t outputSize, size_t &outputLen);
+
+/**
+ * @brief 批量加密，多线程处理，结果与逐条调用SM4_DAO_encrypt相同
+ * @param [IN] inputs                   待加密数据
+ * @param [IN] passwords                每条数据的加密密码，只有一个时所有数据使用同一密码
+ * @param [OUT] outputs                 加密后的数据，与inputs一一对应
+ * @param [OUT] status                  每条数据的结果: 0成功, -1失败
+ * @return int
+ * 成功: 0, 全部成功
+ * 失败: -1, 参数错误或有数据失败
+ * @note
+ * 使用SM4_DAO_batch_set_threads设置的线程池，调用线程也参与处理
+ */
+int SM4_DAO_encrypt_batch(const std::vector<std::string> &inputs,
+                          const std::vector<std::string> &passwords,
+                          std::vector<std::string> &outputs,
+                          std::vector<int> &status);
+
+/**
+ * @brief 批量解密，参数同SM4_DAO_encrypt_batch
+ * @return int
+ * 成功: 0, 全部成功
+ * 失败: -1, 参数错误或有数据失败
+ * @note
+ */
+int SM4_DAO_decrypt_batch(const std::vector<std::string> &inputs,
+                          const std::vector<std::string> &passwords,
+                          std::vector<std::string> &outputs,
+                          std::vector<int> &status);
+
+/**
+ * @brief 设置批量接口的线程数
+ * @param [IN] threadNum                包括调用线程在内的线程数, 0: CPU核数(默认)
+ * @return void
+ * @note
+ * 重建线程池, 正在执行的批量请求由调用线程处理完
+ */
+void SM4_DAO_batch_set_threads(unsigned int threadNum);
+
+/**
+ * SM4_DAO密钥缓存: 密码的HMAC-SHA256(进程随机密钥) -> SM3_KDF派生的iv和SM4加解密子密钥, LRU淘汰
+ */
+typedef struct
+{
+    unsigned long long hits;        // 命中次数
+    unsigned long long misses;      // 未命中次数(执行SM3_KDF和密钥扩展)
+    size_t size;                    // 当前缓存的密码数
+    size_t capacity;                // 最多缓存的密码数
+} sm4_dao_cache_stats;
+
+/**
+ * @brief 读取SM4_DAO密钥缓存统计
+ * @param [OUT] stats       命中/未命中次数和缓存大小
+ * @return void
+ * @note
+ */
+void SM4_DAO_cache_stats(sm4_dao_cache_stats &stats);
+
+/**
+ * @brief 设置SM4_DAO密钥缓存大小
+ * @param [IN] capacity     最多缓存的密码数, 0: 不缓存
+ * @return void
+ * @note
+ * 超出的缓存项按LRU淘汰, 淘汰时清零缓存key和密钥
+ */
+void SM4_DAO_cache_set_capacity(size_t capacity);
+
+/**
+ * @brief 清空SM4_DAO密钥缓存并清零密钥, 统计计数不变
+ * @return void
+ * @note
+ */
+void SM4_DAO_cache_clear();
+
 /**
  * 证书解析
  */
@@ -339,6 +791,130 @@ int PKCS7_get_info(PKCS7 *pkcs7, std::string &p7Info);
  */
 int PKCS7_get_signatureinfo_issuer(const std::string &pkcs7, std::string &issuer);
 
+/**
+ * PDF签名接口
+ */
+
+typedef struct
+{
+    unsigned long long byteRange[4];    // /ByteRange: 签名覆盖[0]开始[1]字节和[2]开始[3]字节
+    bool coversWholeFile;               // 签名覆盖到文件结尾(之后没有增量更新)
+    std::string digestAlgorithm;        // 摘要算法名称, 如sm3、sha256
+    std::string signerIssuer;           // 签名者颁发机构, 同PKCS7_get_signatureinfo_issuer
+    bool digestValid;                   // ByteRange摘要与签名属性messageDigest一致
+    bool signatureValid;                // 签名属性的签名正确(需要CMS中包含签名证书)
+} pdf_signature_info;
+
+/**
+ * @brief 流式验证PDF中的签名, 不读取整个PDF到内存
+ * @param [IN] pdfPath          PDF路径, mmap只读映射
+ * @param [OUT] signatures      每个签名的验证结果, 按在文件中的顺序
+ * @return int
+ * 成功: 0, 所有签名都已解析(验证结果见digestValid、signatureValid)
+ * 失败: -1, 文件无法读取、没有签名或者签名格式错误
+ * @note
+ * 按/ByteRange直接从映射的文件计算摘要, 只解码/Contents中的CMS数据;
+ * 只支持带签名属性的detached签名(adbe.pkcs7.detached、ETSI.CAdES.detached)
+ */
+int PDF_VerifySignatures(const char *pdfPath, std::vector<pdf_signature_info> &signatures);
+
+/**
+ * @brief 同PDF_VerifySignatures, PDF数据已经在内存中(如调用方mmap)
+ * @param [IN] pdfData          PDF数据
+ * @param [IN] pdfLen           PDF数据长度
+ * @param [OUT] signatures      每个签名的验证结果
+ * @return int
+ */
+int PDF_VerifySignaturesFromBuf(const char *pdfData, size_t pdfLen, std::vector<pdf_signature_info> &signatures);
+
+/**
+ * 签名验证接口
+ */
+
+#define SIGN_VERIFY_SM2_ID      "1234567812345678"      // GM/T 0009默认用户ID
+
+typedef struct
+{
+    std::string certDigest;         // SignVerifier::addCert返回的证书摘要
+    const char *data;               // 签名原文
+    size_t dataLen;
+    const unsigned char *sig;       // DER编码签名
+    size_t sigLen;
+} sign_verify_item;
+
+class SignVerifierPrivate;
+
+/**
+ * 重复签名证书的验签服务: 每个公钥预先完成密钥导入、摘要算法和SM2的Z值计算, 保存为模板上下文,
+ * 每个线程持有模板副本和可复用的EVP_MD_CTX, 验签时只复制上下文、计算原文摘要和验证签名
+ * @note
+ * 支持SM2(SM3)、ECDSA、RSA; 可以多线程并发调用verify
+ */
+class SignVerifier
+{
+public:
+    SignVerifier();
+    ~SignVerifier();
+
+    /**
+     * @brief 添加签名证书
+     * @param [IN] cert             签名证书, 只使用公钥, 调用方仍需释放
+     * @param [OUT] certDigest      证书DER的SHA256(十六进制), verify时指定证书
+     * @param [IN] mdName           摘要算法, NULL: SM2使用sm3, 其它使用sha256
+     * @param [IN] sm2Id            SM2用户ID
+     * @return int
+     * 成功: 0
+     * 失败: -1
+     * @note
+     * 已经添加的证书重新添加时替换原来的上下文
+     */
+    int addCert(X509 *cert, std::string &certDigest, const char *mdName = NULL,
+                const std::string &sm2Id = SIGN_VERIFY_SM2_ID);
+
+    /**
+     * @brief 删除签名证书
+     * @param [IN] certDigest       addCert返回的证书摘要
+     * @return void
+     */
+    void removeCert(const std::string &certDigest);
+
+    /**
+     * @brief 验证签名
+     * @param [IN] certDigest       addCert返回的证书摘要
+     * @param [IN] data             签名原文
+     * @param [IN] dataLen          签名原文长度
+     * @param [IN] sig              DER编码签名
+     * @param [IN] sigLen           签名长度
+     * @param [OUT] valid           true: 签名正确, false: 签名错误
+     * @return int
+     * 成功: 0
+     * 失败: -1, 证书没有添加
+     * @note
+     */
+    int verify(const std::string &certDigest, const char *data, size_t dataLen,
+               const unsigned char *sig, size_t sigLen, bool &valid) const;
+    int verify(const std::string &certDigest, const std::string &data, const std::string &sig, bool &valid) const;
+
+    /**
+     * @brief 批量验证签名
+     * @param [IN] items            待验证的签名
+     * @param [OUT] results         与items对应: 1: 签名正确, 0: 签名错误, -1: 证书没有添加
+     * @param [IN] threadNum        验签线程数, 0: 使用CPU核数
+     * @return int
+     * 成功: 0, 全部完成验证(不表示签名都正确)
+     * 失败: -1, 存在没有添加的证书
+     * @note
+     */
+    int verifyBatch(const std::vector<sign_verify_item> &items, std::vector<int> &results,
+                    unsigned int threadNum = 1) const;
+
+    SignVerifier(const SignVerifier &) = delete;
+    SignVerifier &operator=(const SignVerifier &) = delete;
+
+private:
+    SignVerifierPrivate *d;
+};
+
 } /* namespace encryptUtil */
 
 #endif /* __ENCRYPT_UTILITY_H__ */
@@ -8,27 +8,32 @@
  * 2.SM3_init //init the SM3 state
  * 3.SM3_process //compress the the first len/64 blocks of the message
  * 4.SM3_done //compress the rest message and output the hash value
- * 5.SM3_compress //called by SM3_process and SM3_done, compress a single block of message
- * 6.BiToW //called by SM3_compress,to calculate W from Bi
- * 7.WToW1 //called by SM3_compress, calculate W1 from W
- * 8.CF //called by SM3_compress, to calculate CF function.
- * 9.BigEndian //called by SM3_compress and SM3_done.GM/T 0004-2012 requires to use big-endian.
- * //if CPU uses little-endian, BigEndian function is a necessary call to change the
- * //little-endian format into big-endian format.
- * 10.SM3_SelfTest //test whether the SM3 calculation is correct by comparing the hash result with the standard result
+ * 5.SM3_compress //called by SM3_process and SM3_done, compress whole blocks of message
+ * //directly from the input, message expansion is done inside the unrolled rounds
+ * 6.SM3_256_batch //calculate hash values of many independent messages, 8 messages in
+ * //parallel in AVX2 lanes when the CPU supports it
  * History:
  * 1. Date: Sep 18,2016
  * Author: Mao Yingying, Huo Lili
  * Modification: 1)add notes to all the functions
  * 2)add SM3_SelfTest function
+ * 2. Modification: 1)64-bit message length, messages over 512MB hash correctly
+ * 2)compress blocks directly from the input buffer, fused message expansion
  **************************************************************************/
+#include <stdint.h>
 #include <string.h>
 
+#include <algorithm>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SM3_AVX2 1
+#include <immintrin.h>
+#endif
+
 #include "sm3.h"
 
 #define SM3_len 256
-#define SM3_T1  0x79CC4519
-#define SM3_T2  0x7A879D8A
 #define SM3_IVA 0x7380166f
 #define SM3_IVB 0x4914b2b9
 #define SM3_IVC 0x172442d7
@@ -42,183 +47,93 @@
 #define SM3_p1( x )     (x ^ SM3_rotl32( x, 15 ) ^ SM3_rotl32( x, 23 ) )
 #define SM3_p0( x )     (x ^ SM3_rotl32( x, 9 ) ^ SM3_rotl32( x, 17 ) )
 #define SM3_ff0( a, b, c )  (a ^ b ^ c)
-#define SM3_ff1( a, b, c )  ( (a & b) | (a & c) | (b & c) )
+#define SM3_ff1( a, b, c )  ( (a & b) | ( (a | b) & c) )
 #define SM3_gg0( e, f, g )  (e ^ f ^ g)
-#define SM3_gg1( e, f, g )  ( (e & f) | ( (~e) & g) )
-#define SM3_rotl32( x, n )  ( ( ( (unsigned int) x) << n) | ( ( (unsigned int) x) >> (32 - n) ) )
-#define SM3_rotr32( x, n )  ( ( ( (unsigned int) x) >> n) | ( ( (unsigned int) x) << (32 - n) ) )
-
-/****************************************************************
-* Function: BiToW
-* Description: calculate W from Bi
-* Calls:
-* Called By: SM3_compress
-* Input: Bi[16] //a block of a message
-* Output: W[64]
-* Return: null
-* Others:
-****************************************************************/
-void BiToW( unsigned int Bi[], unsigned int W[] )
-{
-    int     i;
-    unsigned int    tmp;
-    for ( i = 0; i <= 15; i++ )
-    {
-        W[i] = Bi[i];
-    }
-    for ( i = 16; i <= 67; i++ )
-    {
-        tmp = W[i - 16]
-              ^ W[i - 9]
-              ^ SM3_rotl32( W[i - 3], 15 );
-        W[i] = SM3_p1( tmp )
-               ^ (SM3_rotl32( W[i - 13], 7 ) )
-               ^ W[i - 6];
-    }
-}
+#define SM3_gg1( e, f, g )  ( ( (f ^ g) & e) ^ g)
+#define SM3_rotl32( x, n )  ( ( ( (uint32_t) x) << n) | ( ( (uint32_t) x) >> (32 - n) ) )
+#define SM3_rotr32( x, n )  ( ( ( (uint32_t) x) >> n) | ( ( (uint32_t) x) << (32 - n) ) )
+
+/* big-endian load/store, GM/T 0004-2012 requires to use big-endian */
+#if defined(__GNUC__)
+#define SM3_bswap32( x )    __builtin_bswap32( x )
+#elif defined(_MSC_VER)
+#include <stdlib.h>
+#define SM3_bswap32( x )    _byteswap_ulong( x )
+#else
+#define SM3_bswap32( x )    ( (SM3_rotl32( x, 8 ) & 0x00ff00ff) | (SM3_rotl32( x, 24 ) & 0xff00ff00) )
+#endif
 
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define SM3_be32( x )       (x)
+#else
+#define SM3_be32( x )       SM3_bswap32( x )
+#endif
 
-/*****************************************************************
-*  Function: WToW1
-*  Description: calculate W1 from W
-*  Calls:
-*  Called By: SM3_compress
-*  Input: W[64]
-*  Output: W1[64]
-*  Return: null
-*  Others:
-*****************************************************************/
-void WToW1( unsigned int W[], unsigned int W1[] )
+static inline uint32_t SM3_load32( const unsigned char *p )
 {
-    int i;
-    for ( i = 0; i <= 63; i++ )
-    {
-        W1[i] = W[i] ^ W[i + 4];
-    }
+    uint32_t    v;
+    memcpy( &v, p, 4 );
+    return(SM3_be32( v ) );
 }
 
 
-/******************************************************************
- * Function: CF
- * Description: calculate the CF compress function and update V
- * Calls:
- * Called By: SM3_compress
- * Input: W[64]
- * W1[64]
- * V[8]
- * Output: V[8]
- * Return: null
- * Others:
- ********************************************************************/
-void CF( unsigned int W[], unsigned int W1[], unsigned int V[] )
+static inline void SM3_store32( unsigned char *p, uint32_t v )
 {
-    unsigned int    SS1;
-    unsigned int    SS2;
-    unsigned int    TT1;
-    unsigned int    TT2;
-    unsigned int    A, B, C, D, E, F, G, H;
-    unsigned int    T = SM3_T1;
-    unsigned int    FF;
-    unsigned int    GG;
-    int     j;
-/* reg init,set ABCDEFGH=V0 */
-    A   = V[0];
-    B   = V[1];
-    C   = V[2];
-    D   = V[3];
-    E   = V[4];
-    F   = V[5];
-    G   = V[6];
-    H   = V[7];
-    for ( j = 0; j <= 63; j++ )
-    {
-/* SS1 */
-        if ( j == 0 )
-        {
-            T = SM3_T1;
-        }else if ( j == 16 )
-        {
-            T = SM3_rotl32( SM3_T2, 16 );
-        }else  {
-            T = SM3_rotl32( T, 1 );
-        }
-        SS1 = SM3_rotl32( (SM3_rotl32( A, 12 ) + E + T), 7 );
-/* SS2 */
-        SS2 = SS1 ^ SM3_rotl32( A, 12 );
-/* TT1 */
-        if ( j <= 15 )
-        {
-            FF = SM3_ff0( A, B, C );
-        }else  {
-            FF = SM3_ff1( A, B, C );
-        }
-        TT1 = FF + D + SS2 + *W1;
-        W1++;
-/* TT2 */
-        if ( j <= 15 )
-        {
-            GG = SM3_gg0( E, F, G );
-        }else  {
-            GG = SM3_gg1( E, F, G );
-        }
-        TT2 = GG + H + SS1 + *W;
-        W++;
-/* D */
-        D = C;
-/* C */
-        C = SM3_rotl32( B, 9 );
-/* B */
-        B = A;
-/* A */
-        A = TT1;
-/* H */
-        H = G;
-/* G */
-        G = SM3_rotl32( F, 19 );
-/* F */
-        F = E;
-/* E */
-        E = SM3_p0( TT2 );
-    }
-/* update V */
-    V[0]    = A ^ V[0];
-    V[1]    = B ^ V[1];
-    V[2]    = C ^ V[2];
-    V[3]    = D ^ V[3];
-    V[4]    = E ^ V[4];
-    V[5]    = F ^ V[5];
-    V[6]    = G ^ V[6];
-    V[7]    = H ^ V[7];
+    v = SM3_be32( v );
+    memcpy( p, &v, 4 );
 }
 
 
-/******************************************************************************
- * Function: BigEndian
- * Description: U32 endian converse.GM/T 0004-2012 requires to use big-endian.
- * if CPU uses little-endian, BigEndian function is a necessary
- * call to change the little-endian format into big-endian format.
- * Calls:
- * Called By: SM3_compress, SM3_done
- * Input: src[bytelen]
- * bytelen
- * Output: des[bytelen]
- * Return: null
- * Others: src and des could implies the same address
- *******************************************************************************/
-void BigEndian( unsigned char src[], unsigned int bytelen, unsigned char des[] )
-{
-    unsigned char   tmp = 0;
-    unsigned int    i   = 0;
-    for ( i = 0; i < bytelen / 4; i++ )
-    {
-        tmp     = des[4 * i];
-        des[4 * i]  = src[4 * i + 3];
-        src[4 * i + 3]  = tmp;
-        tmp     = des[4 * i + 1];
-        des[4 * i + 1]  = src[4 * i + 2];
-        des[4 * i + 2]  = tmp;
-    }
-}
+/* Tj <<< (j mod 32) */
+static const uint32_t SM3_K[64] = {
+    0x79cc4519, 0xf3988a32, 0xe7311465, 0xce6228cb,
+    0x9cc45197, 0x3988a32f, 0x7311465e, 0xe6228cbc,
+    0xcc451979, 0x988a32f3, 0x311465e7, 0x6228cbce,
+    0xc451979c, 0x88a32f39, 0x11465e73, 0x228cbce6,
+    0x9d8a7a87, 0x3b14f50f, 0x7629ea1e, 0xec53d43c,
+    0xd8a7a879, 0xb14f50f3, 0x629ea1e7, 0xc53d43ce,
+    0x8a7a879d, 0x14f50f3b, 0x29ea1e76, 0x53d43cec,
+    0xa7a879d8, 0x4f50f3b1, 0x9ea1e762, 0x3d43cec5,
+    0x7a879d8a, 0xf50f3b14, 0xea1e7629, 0xd43cec53,
+    0xa879d8a7, 0x50f3b14f, 0xa1e7629e, 0x43cec53d,
+    0x879d8a7a, 0x0f3b14f5, 0x1e7629ea, 0x3cec53d4,
+    0x79d8a7a8, 0xf3b14f50, 0xe7629ea1, 0xcec53d43,
+    0x9d8a7a87, 0x3b14f50f, 0x7629ea1e, 0xec53d43c,
+    0xd8a7a879, 0xb14f50f3, 0x629ea1e7, 0xc53d43ce,
+    0x8a7a879d, 0x14f50f3b, 0x29ea1e76, 0x53d43cec,
+    0xa7a879d8, 0x4f50f3b1, 0x9ea1e762, 0x3d43cec5,
+};
+
+/* W[j] for j >= 16 */
+#define SM3_EXPAND( W, j ) \
+    ( W[j] = SM3_p1( W[j - 16] ^ W[j - 9] ^ SM3_rotl32( W[j - 3], 15 ) ) \
+             ^ SM3_rotl32( W[j - 13], 7 ) ^ W[j - 6] )
+
+/*
+ * one round of CF, W1[j] = W[j] ^ W[j + 4] is computed in place.
+ * instead of moving the registers, the caller rotates the arguments:
+ * A' = TT1 (stored in D), C' = B <<< 9, E' = P0(TT2) (stored in H), G' = F <<< 19
+ */
+#define SM3_ROUND( A, B, C, D, E, F, G, H, FF, GG, j ) \
+    do { \
+        uint32_t    A12 = SM3_rotl32( A, 12 ); \
+        uint32_t    SS1 = SM3_rotl32( A12 + E + SM3_K[j], 7 ); \
+        uint32_t    SS2 = SS1 ^ A12; \
+        uint32_t    TT1 = FF( A, B, C ) + D + SS2 + (W[j] ^ W[j + 4]); \
+        uint32_t    TT2 = GG( E, F, G ) + H + SS1 + W[j]; \
+        B   = SM3_rotl32( B, 9 ); \
+        F   = SM3_rotl32( F, 19 ); \
+        D   = TT1; \
+        H   = SM3_p0( TT2 ); \
+    } while ( 0 )
+
+#define SM3_ROUND4( FF, GG, j ) \
+    do { \
+        SM3_ROUND( A, B, C, D, E, F, G, H, FF, GG, j ); \
+        SM3_ROUND( D, A, B, C, H, E, F, G, FF, GG, j + 1 ); \
+        SM3_ROUND( C, D, A, B, G, H, E, F, FF, GG, j + 2 ); \
+        SM3_ROUND( B, C, D, A, F, G, H, E, FF, GG, j + 3 ); \
+    } while ( 0 )
 
 
 /******************************************************************************
@@ -235,7 +150,8 @@ void SM3_init( SM3_STATE *md )
 {
     memset(md, 0, sizeof(SM3_STATE));
 
-    md->curlen  = md->length = 0;
+    md->curlen  = 0;
+    md->length  = 0;
     md->state[0]    = SM3_IVA;
     md->state[1]    = SM3_IVB;
     md->state[2]    = SM3_IVC;
@@ -249,26 +165,70 @@ void SM3_init( SM3_STATE *md )
 
 /******************************************************************************
  * Function: SM3_compress
- * Description: compress a single block of message
- * Calls: BigEndian
- * BiToW
- * WToW1
- * CF
- * Called By: SM3_256
- * Input: SM3_STATE *md
- * Output: SM3_STATE *md
+ * Description: compress blocks of message, read big-endian words directly
+ * from the input, W[j + 4] is expanded just before round j needs it
+ * Calls:
+ * Called By: SM3_process, SM3_done
+ * Input: unsigned int V[8]
+ * unsigned char p[blocks * 64]
+ * size_t blocks
+ * Output: unsigned int V[8]
  * Return: null
  * Others:
  *******************************************************************************/
-void SM3_compress( SM3_STATE * md )
+static void SM3_compress( unsigned int V[8], const unsigned char *p, size_t blocks )
 {
-    unsigned int    W[68];
-    unsigned int    W1[64];
-/* if CPU uses little-endian, BigEndian function is a necessary call */
-    BigEndian( md->buf, 64, md->buf );
-    BiToW( (unsigned int *) md->buf, W );
-    WToW1( W, W1 );
-    CF( W, W1, md->state );
+    uint32_t    W[68];
+    uint32_t    A, B, C, D, E, F, G, H;
+    int     j;
+
+    while ( blocks-- )
+    {
+        for ( j = 0; j < 16; j++ )
+        {
+            W[j] = SM3_load32( p + 4 * j );
+        }
+
+/* reg init,set ABCDEFGH=V0 */
+        A   = V[0];
+        B   = V[1];
+        C   = V[2];
+        D   = V[3];
+        E   = V[4];
+        F   = V[5];
+        G   = V[6];
+        H   = V[7];
+
+        for ( j = 0; j < 12; j += 4 )
+        {
+            SM3_ROUND4( SM3_ff0, SM3_gg0, j );
+        }
+        SM3_EXPAND( W, 16 );
+        SM3_EXPAND( W, 17 );
+        SM3_EXPAND( W, 18 );
+        SM3_EXPAND( W, 19 );
+        SM3_ROUND4( SM3_ff0, SM3_gg0, 12 );
+        for ( j = 16; j < 64; j += 4 )
+        {
+            SM3_EXPAND( W, j + 4 );
+            SM3_EXPAND( W, j + 5 );
+            SM3_EXPAND( W, j + 6 );
+            SM3_EXPAND( W, j + 7 );
+            SM3_ROUND4( SM3_ff1, SM3_gg1, j );
+        }
+
+/* update V */
+        V[0]    ^= A;
+        V[1]    ^= B;
+        V[2]    ^= C;
+        V[3]    ^= D;
+        V[4]    ^= E;
+        V[5]    ^= F;
+        V[6]    ^= G;
+        V[7]    ^= H;
+
+        p += 64;
+    }
 }
 
 
@@ -282,23 +242,50 @@ void SM3_compress( SM3_STATE * md )
  * int len //bytelen of message
  * Output: SM3_STATE *md
  * Return: null
- * Others:
+ * Others: whole blocks are compressed from buf without copying
  *******************************************************************************/
 void SM3_process( SM3_STATE * md, unsigned char *buf, int len )
 {
-    while ( len-- )
+    size_t  n;
+    size_t  blocks;
+
+    if ( len <= 0 )
+    {
+        return;
+    }
+
+/* fill up the pending block first */
+    if ( md->curlen > 0 )
     {
-/* copy byte */
-        md->buf[md->curlen] = *buf++;
-        md->curlen++;
-/* is 64 bytes full? */
-        if ( md->curlen == 64 )
+        n = 64 - md->curlen;
+        if ( (size_t) len < n )
         {
-            SM3_compress( md );
-            md->length  += 512;
-            md->curlen  = 0;
+            n = len;
         }
+        memcpy( md->buf + md->curlen, buf, n );
+        md->curlen  += n;
+        buf     += n;
+        len     -= (int) n;
+        if ( md->curlen < 64 )
+        {
+            return;
+        }
+        SM3_compress( md->state, md->buf, 1 );
+        md->length  += 512;
+        md->curlen  = 0;
+    }
+
+    blocks = (size_t) len / 64;
+    if ( blocks > 0 )
+    {
+        SM3_compress( md->state, buf, blocks );
+        md->length  += (unsigned long long) blocks * 512;
+        buf     += blocks * 64;
+        len     -= (int) (blocks * 64);
     }
+
+    memcpy( md->buf, buf, len );
+    md->curlen = len;
 }
 
 
@@ -316,7 +303,7 @@ void SM3_done( SM3_STATE *md, unsigned char hash[32] )
 {
     int     i;
 /* increase the bit length of the message */
-    md->length += md->curlen << 3;
+    md->length += (unsigned long long) md->curlen << 3;
 /* append the '1' bit */
     md->buf[md->curlen] = 0x80;
     md->curlen++;
@@ -328,34 +315,20 @@ void SM3_done( SM3_STATE *md, unsigned char hash[32] )
  */
     if ( md->curlen > 56 )
     {
-        for (; md->curlen < 64; )
-        {
-            md->buf[md->curlen] = 0;
-            md->curlen++;
-        }
-        SM3_compress( md );
+        memset( md->buf + md->curlen, 0, 64 - md->curlen );
+        SM3_compress( md->state, md->buf, 1 );
         md->curlen = 0;
     }
-/* if the length is less than 56 bytes, pad upto 56 bytes of zeroes */
-    for (; md->curlen < 56; )
-    {
-        md->buf[md->curlen] = 0;
-        md->curlen++;
-    }
-/* since all messages are under 2^32 bits we mark the top bits zero */
-    for ( i = 56; i < 60; i++ )
+/* pad upto 56 bytes of zeroes, append 64-bit length */
+    memset( md->buf + md->curlen, 0, 56 - md->curlen );
+    SM3_store32( md->buf + 56, (uint32_t) (md->length >> 32) );
+    SM3_store32( md->buf + 60, (uint32_t) md->length );
+    SM3_compress( md->state, md->buf, 1 );
+/* copy output */
+    for ( i = 0; i < SM3_len / 32; i++ )
     {
-        md->buf[i] = 0;
+        SM3_store32( hash + 4 * i, md->state[i] );
     }
-/* append length */
-    md->buf[63] = md->length & 0xff;
-    md->buf[62] = (md->length >> 8) & 0xff;
-    md->buf[61] = (md->length >> 16) & 0xff;
-    md->buf[60] = (md->length >> 24) & 0xff;
-    SM3_compress( md );
-/* copy output */
-    memcpy( hash, md->state, SM3_len / 8 );
-    BigEndian( hash, SM3_len / 8, hash ); /* if CPU uses little-endian, BigEndian function is a necessary call */
 }
 
 
@@ -379,3 +352,340 @@ void SM3_256( unsigned char buf[], int len, unsigned char hash[32] )
     SM3_process( &md, buf, len );
     SM3_done( &md, hash );
 }
+
+
+/*
+ * one message of a batch: whole blocks are read from the message, the last
+ * one or two blocks (rest of the message, padding and length) from tail
+ */
+typedef struct {
+    const unsigned char *data;
+    size_t  full;               /* number of whole blocks in data */
+    size_t  blocks;             /* total number of blocks after padding */
+    unsigned char   tail[128];
+} SM3_LANE;
+
+static void SM3_lane_init( SM3_LANE *lane, const unsigned char *data, size_t len )
+{
+    size_t  rest = len % 64;
+
+    lane->data  = data;
+    lane->full  = len / 64;
+    memset( lane->tail, 0, sizeof(lane->tail) );
+    memcpy( lane->tail, data + lane->full * 64, rest );
+    lane->tail[rest] = 0x80;
+    lane->blocks = lane->full + (rest + 9 > 64 ? 2 : 1);
+
+    unsigned char *end = lane->tail + (lane->blocks - lane->full) * 64;
+    unsigned long long bits = (unsigned long long) len << 3;
+    SM3_store32( end - 8, (uint32_t) (bits >> 32) );
+    SM3_store32( end - 4, (uint32_t) bits );
+}
+
+static inline const unsigned char *SM3_lane_block( const SM3_LANE *lane, size_t k )
+{
+    return(k < lane->full ? lane->data + 64 * k : lane->tail + 64 * (k - lane->full) );
+}
+
+/* finish a lane from block k with the scalar core */
+static void SM3_lane_finish( const SM3_LANE *lane, unsigned int V[8], size_t k, unsigned char hash[32] )
+{
+    int i;
+
+    if ( k < lane->full )
+    {
+        SM3_compress( V, lane->data + 64 * k, lane->full - k );
+        k = lane->full;
+    }
+    SM3_compress( V, lane->tail + 64 * (k - lane->full), lane->blocks - k );
+    for ( i = 0; i < 8; i++ )
+    {
+        SM3_store32( hash + 4 * i, V[i] );
+    }
+}
+
+
+#ifdef SM3_AVX2
+/*
+ * 8-lane SM3: each 256-bit register holds the same word of 8 independent states,
+ * the round function is the scalar one with every operation done on 8 lanes.
+ */
+#define SM3_AVX2_TARGET __attribute__((target("avx2")))
+
+#define SM3_V_ROTL( x, n )      _mm256_or_si256( _mm256_slli_epi32( x, n ), _mm256_srli_epi32( x, 32 - (n) ) )
+#define SM3_V_XOR3( a, b, c )   _mm256_xor_si256( _mm256_xor_si256( a, b ), c )
+#define SM3_V_P0( x )           SM3_V_XOR3( x, SM3_V_ROTL( x, 9 ), SM3_V_ROTL( x, 17 ) )
+#define SM3_V_P1( x )           SM3_V_XOR3( x, SM3_V_ROTL( x, 15 ), SM3_V_ROTL( x, 23 ) )
+#define SM3_V_FF0( a, b, c )    SM3_V_XOR3( a, b, c )
+#define SM3_V_FF1( a, b, c )    _mm256_or_si256( _mm256_and_si256( a, b ), _mm256_and_si256( _mm256_or_si256( a, b ), c ) )
+#define SM3_V_GG0( e, f, g )    SM3_V_XOR3( e, f, g )
+#define SM3_V_GG1( e, f, g )    _mm256_xor_si256( _mm256_and_si256( _mm256_xor_si256( f, g ), e ), g )
+
+#define SM3_V_EXPAND( W, j ) \
+    ( W[j] = SM3_V_XOR3( SM3_V_P1( SM3_V_XOR3( W[j - 16], W[j - 9], SM3_V_ROTL( W[j - 3], 15 ) ) ), \
+                         SM3_V_ROTL( W[j - 13], 7 ), W[j - 6] ) )
+
+#define SM3_V_ROUND( A, B, C, D, E, F, G, H, FF, GG, j ) \
+    do { \
+        __m256i A12 = SM3_V_ROTL( A, 12 ); \
+        __m256i SS1 = _mm256_add_epi32( _mm256_add_epi32( A12, E ), _mm256_set1_epi32( (int) SM3_K[j] ) ); \
+        SS1 = SM3_V_ROTL( SS1, 7 ); \
+        __m256i SS2 = _mm256_xor_si256( SS1, A12 ); \
+        __m256i TT1 = _mm256_add_epi32( _mm256_add_epi32( FF( A, B, C ), D ), \
+                                        _mm256_add_epi32( SS2, _mm256_xor_si256( W[j], W[j + 4] ) ) ); \
+        __m256i TT2 = _mm256_add_epi32( _mm256_add_epi32( GG( E, F, G ), H ), \
+                                        _mm256_add_epi32( SS1, W[j] ) ); \
+        B   = SM3_V_ROTL( B, 9 ); \
+        F   = SM3_V_ROTL( F, 19 ); \
+        D   = TT1; \
+        H   = SM3_V_P0( TT2 ); \
+    } while ( 0 )
+
+#define SM3_V_ROUND4( FF, GG, j ) \
+    do { \
+        SM3_V_ROUND( A, B, C, D, E, F, G, H, FF, GG, j ); \
+        SM3_V_ROUND( D, A, B, C, H, E, F, G, FF, GG, j + 1 ); \
+        SM3_V_ROUND( C, D, A, B, G, H, E, F, FF, GG, j + 2 ); \
+        SM3_V_ROUND( B, C, D, A, F, G, H, E, FF, GG, j + 3 ); \
+    } while ( 0 )
+
+/* 8x8 transpose of 32-bit words: r[i] word j <-> r[j] word i */
+SM3_AVX2_TARGET static inline void SM3_v_transpose( __m256i r[8] )
+{
+    __m256i t0 = _mm256_unpacklo_epi32( r[0], r[1] );
+    __m256i t1 = _mm256_unpackhi_epi32( r[0], r[1] );
+    __m256i t2 = _mm256_unpacklo_epi32( r[2], r[3] );
+    __m256i t3 = _mm256_unpackhi_epi32( r[2], r[3] );
+    __m256i t4 = _mm256_unpacklo_epi32( r[4], r[5] );
+    __m256i t5 = _mm256_unpackhi_epi32( r[4], r[5] );
+    __m256i t6 = _mm256_unpacklo_epi32( r[6], r[7] );
+    __m256i t7 = _mm256_unpackhi_epi32( r[6], r[7] );
+
+    __m256i u0 = _mm256_unpacklo_epi64( t0, t2 );
+    __m256i u1 = _mm256_unpackhi_epi64( t0, t2 );
+    __m256i u2 = _mm256_unpacklo_epi64( t1, t3 );
+    __m256i u3 = _mm256_unpackhi_epi64( t1, t3 );
+    __m256i u4 = _mm256_unpacklo_epi64( t4, t6 );
+    __m256i u5 = _mm256_unpackhi_epi64( t4, t6 );
+    __m256i u6 = _mm256_unpacklo_epi64( t5, t7 );
+    __m256i u7 = _mm256_unpackhi_epi64( t5, t7 );
+
+    r[0] = _mm256_permute2x128_si256( u0, u4, 0x20 );
+    r[1] = _mm256_permute2x128_si256( u1, u5, 0x20 );
+    r[2] = _mm256_permute2x128_si256( u2, u6, 0x20 );
+    r[3] = _mm256_permute2x128_si256( u3, u7, 0x20 );
+    r[4] = _mm256_permute2x128_si256( u0, u4, 0x31 );
+    r[5] = _mm256_permute2x128_si256( u1, u5, 0x31 );
+    r[6] = _mm256_permute2x128_si256( u2, u6, 0x31 );
+    r[7] = _mm256_permute2x128_si256( u3, u7, 0x31 );
+}
+
+/* words [off, off + 8) of the 8 blocks, big-endian to native */
+SM3_AVX2_TARGET static inline void SM3_v_load( __m256i W[8], const unsigned char *p[8], int off )
+{
+    const __m256i bswap = _mm256_setr_epi8( 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+    int i;
+
+    for ( i = 0; i < 8; i++ )
+    {
+        W[i] = _mm256_loadu_si256( (const __m256i *) (p[i] + 4 * off) );
+    }
+    SM3_v_transpose( W );
+    for ( i = 0; i < 8; i++ )
+    {
+        W[i] = _mm256_shuffle_epi8( W[i], bswap );
+    }
+}
+
+/* V[i]: word i of the 8 states */
+SM3_AVX2_TARGET static void SM3_v_compress( __m256i V[8], const unsigned char *p[8] )
+{
+    __m256i W[68];
+    __m256i A, B, C, D, E, F, G, H;
+    int     j;
+
+    SM3_v_load( W, p, 0 );
+    SM3_v_load( W + 8, p, 8 );
+
+    A   = V[0];
+    B   = V[1];
+    C   = V[2];
+    D   = V[3];
+    E   = V[4];
+    F   = V[5];
+    G   = V[6];
+    H   = V[7];
+
+    for ( j = 0; j < 12; j += 4 )
+    {
+        SM3_V_ROUND4( SM3_V_FF0, SM3_V_GG0, j );
+    }
+    SM3_V_EXPAND( W, 16 );
+    SM3_V_EXPAND( W, 17 );
+    SM3_V_EXPAND( W, 18 );
+    SM3_V_EXPAND( W, 19 );
+    SM3_V_ROUND4( SM3_V_FF0, SM3_V_GG0, 12 );
+    for ( j = 16; j < 64; j += 4 )
+    {
+        SM3_V_EXPAND( W, j + 4 );
+        SM3_V_EXPAND( W, j + 5 );
+        SM3_V_EXPAND( W, j + 6 );
+        SM3_V_EXPAND( W, j + 7 );
+        SM3_V_ROUND4( SM3_V_FF1, SM3_V_GG1, j );
+    }
+
+    V[0]    = _mm256_xor_si256( V[0], A );
+    V[1]    = _mm256_xor_si256( V[1], B );
+    V[2]    = _mm256_xor_si256( V[2], C );
+    V[3]    = _mm256_xor_si256( V[3], D );
+    V[4]    = _mm256_xor_si256( V[4], E );
+    V[5]    = _mm256_xor_si256( V[5], F );
+    V[6]    = _mm256_xor_si256( V[6], G );
+    V[7]    = _mm256_xor_si256( V[7], H );
+}
+
+/*
+ * hash 8 messages, lanes run in parallel while at least 4 of them still have blocks,
+ * a lane that runs out of blocks is fed its own last block again and its state
+ * is taken when it finishes; the remaining lanes finish with the scalar core
+ */
+SM3_AVX2_TARGET static void SM3_batch8_avx2( SM3_LANE *lanes[8], unsigned char *hash[8] )
+{
+    const unsigned char *p[8];
+    __m256i     V[8];
+    unsigned int    S[8][8];
+    size_t      steps[8];
+    size_t      k;
+    size_t      parallel;
+    int         i;
+
+    for ( i = 0; i < 8; i++ )
+    {
+        steps[i] = lanes[i]->blocks;
+    }
+    std::sort( steps, steps + 8 );
+    parallel = steps[4];            /* blocks while at least 4 lanes are active */
+
+    V[0]    = _mm256_set1_epi32( (int) SM3_IVA );
+    V[1]    = _mm256_set1_epi32( (int) SM3_IVB );
+    V[2]    = _mm256_set1_epi32( (int) SM3_IVC );
+    V[3]    = _mm256_set1_epi32( (int) SM3_IVD );
+    V[4]    = _mm256_set1_epi32( (int) SM3_IVE );
+    V[5]    = _mm256_set1_epi32( (int) SM3_IVF );
+    V[6]    = _mm256_set1_epi32( (int) SM3_IVG );
+    V[7]    = _mm256_set1_epi32( (int) SM3_IVH );
+
+    for ( k = 0; k < parallel; k++ )
+    {
+        for ( i = 0; i < 8; i++ )
+        {
+            size_t b = k < lanes[i]->blocks ? k : lanes[i]->blocks - 1;
+            p[i] = SM3_lane_block( lanes[i], b );
+        }
+        SM3_v_compress( V, p );
+
+        /* take the states of the lanes that have just finished */
+        for ( i = 0; i < 8; i++ )
+        {
+            if ( lanes[i]->blocks == k + 1 )
+            {
+                break;
+            }
+        }
+        if ( i < 8 )
+        {
+            __m256i T[8];
+            memcpy( T, V, sizeof(T) );
+            SM3_v_transpose( T );
+            for ( i = 0; i < 8; i++ )
+            {
+                if ( lanes[i]->blocks == k + 1 )
+                {
+                    _mm256_storeu_si256( (__m256i *) S[i], T[i] );
+                }
+            }
+        }
+    }
+
+    {
+        __m256i T[8];
+        memcpy( T, V, sizeof(T) );
+        SM3_v_transpose( T );
+        for ( i = 0; i < 8; i++ )
+        {
+            if ( lanes[i]->blocks > parallel )
+            {
+                _mm256_storeu_si256( (__m256i *) S[i], T[i] );
+            }
+        }
+    }
+
+    for ( i = 0; i < 8; i++ )
+    {
+        SM3_lane_finish( lanes[i], S[i], lanes[i]->blocks > parallel ? parallel : lanes[i]->blocks, hash[i] );
+    }
+}
+
+
+static bool SM3_cpu_avx2()
+{
+    __builtin_cpu_init();
+    return(__builtin_cpu_supports( "avx2" ) != 0);
+}
+#endif
+
+
+/******************************************************************************
+ * Function: SM3_256_batch
+ * Description: calculate hash values of n independent messages
+ * Calls: SM3_compress
+ * Called By:
+ * Input: const unsigned char *bufs[n] //the input messages
+ * const size_t lens[n] //bytelen of the messages
+ * size_t n //number of messages
+ * Output: unsigned char hash[n][32]
+ * Return: null
+ * Others: messages are sorted by length and hashed 8 at a time in AVX2 lanes,
+ * the leftover messages and CPUs without AVX2 use the scalar core
+ *******************************************************************************/
+void SM3_256_batch( const unsigned char *bufs[], const size_t lens[], size_t n, unsigned char hash[][32] )
+{
+    std::vector<SM3_LANE>   lanes( n );
+    std::vector<size_t>     order( n );
+    size_t  i = 0;
+
+    for ( i = 0; i < n; i++ )
+    {
+        SM3_lane_init( &lanes[i], bufs[i], lens[i] );
+        order[i] = i;
+    }
+
+    i = 0;
+#ifdef SM3_AVX2
+    static const bool avx2 = SM3_cpu_avx2();
+    if ( avx2 && n >= 8 )
+    {
+        /* messages of similar length share a group, fewer lanes wait */
+        std::sort( order.begin(), order.end(),
+                   [&lanes](size_t a, size_t b) { return lanes[a].blocks < lanes[b].blocks; } );
+        for (; i + 8 <= n; i += 8 )
+        {
+            SM3_LANE        *group[8];
+            unsigned char   *out[8];
+            for ( int j = 0; j < 8; j++ )
+            {
+                group[j]    = &lanes[order[i + j]];
+                out[j]      = hash[order[i + j]];
+            }
+            SM3_batch8_avx2( group, out );
+        }
+    }
+#endif
+
+    for (; i < n; i++ )
+    {
+        unsigned int V[8] = { SM3_IVA, SM3_IVB, SM3_IVC, SM3_IVD, SM3_IVE, SM3_IVF, SM3_IVG, SM3_IVH };
+        SM3_lane_finish( &lanes[order[i]], V, 0, hash[order[i]] );
+    }
+}
@@ -9,6 +9,16 @@
 #include <string.h>
 #include <stdio.h>
 
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SM4_AESNI 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 #include "MyLog.h"
 
 #define SM4_ENCRYPT     1
@@ -17,18 +27,18 @@
 /*
  * 32-bit integer manipulation macros (big endian)
  */
-#ifndef GET_ULONG_BE
-#define GET_ULONG_BE(n,b,i)                             \
+#ifndef GET_UINT32_BE
+#define GET_UINT32_BE(n,b,i)                            \
 {                                                       \
-    (n) = ( (unsigned long) (b)[(i)    ] << 24 )        \
-        | ( (unsigned long) (b)[(i) + 1] << 16 )        \
-        | ( (unsigned long) (b)[(i) + 2] <<  8 )        \
-        | ( (unsigned long) (b)[(i) + 3]       );       \
+    (n) = ( (uint32_t) (b)[(i)    ] << 24 )             \
+        | ( (uint32_t) (b)[(i) + 1] << 16 )             \
+        | ( (uint32_t) (b)[(i) + 2] <<  8 )             \
+        | ( (uint32_t) (b)[(i) + 3]       );            \
 }
 #endif
 
-#ifndef PUT_ULONG_BE
-#define PUT_ULONG_BE(n,b,i)                             \
+#ifndef PUT_UINT32_BE
+#define PUT_UINT32_BE(n,b,i)                            \
 {                                                       \
     (b)[(i)    ] = (unsigned char) ( (n) >> 24 );       \
     (b)[(i) + 1] = (unsigned char) ( (n) >> 16 );       \
@@ -44,7 +54,7 @@
 #define  SHL(x,n) (((x) & 0xFFFFFFFF) << n)
 #define ROTL(x,n) (SHL((x),n) | ((x) >> (32 - n)))
 
-#define SWAP(a,b) { unsigned long t = a; a = b; b = t; t = 0; }
+#define SWAP(a,b) { uint32_t t = a; a = b; b = t; t = 0; }
 
 /*
  * Expanded SM4 S-boxes
@@ -72,10 +82,10 @@ static const unsigned char SboxTable[16][16] =
 };
 
 /* System parameter */
-static const unsigned long FK[4] = {0xa3b1bac6, 0x56aa3350, 0x677d9197, 0xb27022dc};
+static const uint32_t FK[4] = {0xa3b1bac6, 0x56aa3350, 0x677d9197, 0xb27022dc};
 
 /* fixed parameter */
-static const unsigned long CK[32] =
+static const uint32_t CK[32] =
 {
     0x00070e15, 0x1c232a31, 0x383f464d, 0x545b6269,
     0x70777e85, 0x8c939aa1, 0xa8afb6bd, 0xc4cbd2d9,
@@ -87,6 +97,154 @@ static const unsigned long CK[32] =
     0x10171e25, 0x2c333a41, 0x484f565d, 0x646b7279
 };
 
+/*
+ * T tables: S-box fused with the linear transform L of the round function,
+ * SM4_Tn[x] = L(Sbox(x) << (24 - 8n)), so T(a) = T0[a0] ^ T1[a1] ^ T2[a2] ^ T3[a3]
+ */
+static const uint32_t SM4_T0[256] =
+{
+    0x8ed55b5b, 0xd0924242, 0x4deaa7a7, 0x06fdfbfb, 0xfccf3333, 0x65e28787, 0xc93df4f4, 0x6bb5dede,
+    0x4e165858, 0x6eb4dada, 0x44145050, 0xcac10b0b, 0x8828a0a0, 0x17f8efef, 0x9c2cb0b0, 0x11051414,
+    0x872bacac, 0xfb669d9d, 0xf2986a6a, 0xae77d9d9, 0x822aa8a8, 0x46bcfafa, 0x14041010, 0xcfc00f0f,
+    0x02a8aaaa, 0x54451111, 0x5f134c4c, 0xbe269898, 0x6d482525, 0x9e841a1a, 0x1e061818, 0xfd9b6666,
+    0xec9e7272, 0x4a430909, 0x10514141, 0x24f7d3d3, 0xd5934646, 0x53ecbfbf, 0xf89a6262, 0x927be9e9,
+    0xff33cccc, 0x04555151, 0x270b2c2c, 0x4f420d0d, 0x59eeb7b7, 0xf3cc3f3f, 0x1caeb2b2, 0xea638989,
+    0x74e79393, 0x7fb1cece, 0x6c1c7070, 0x0daba6a6, 0xedca2727, 0x28082020, 0x48eba3a3, 0xc1975656,
+    0x80820202, 0xa3dc7f7f, 0xc4965252, 0x12f9ebeb, 0xa174d5d5, 0xb38d3e3e, 0xc33ffcfc, 0x3ea49a9a,
+    0x5b461d1d, 0x1b071c1c, 0x3ba59e9e, 0x0cfff3f3, 0x3ff0cfcf, 0xbf72cdcd, 0x4b175c5c, 0x52b8eaea,
+    0x8f810e0e, 0x3d586565, 0xcc3cf0f0, 0x7d196464, 0x7ee59b9b, 0x91871616, 0x734e3d3d, 0x08aaa2a2,
+    0xc869a1a1, 0xc76aadad, 0x85830606, 0x7ab0caca, 0xb570c5c5, 0xf4659191, 0xb2d96b6b, 0xa7892e2e,
+    0x18fbe3e3, 0x47e8afaf, 0x330f3c3c, 0x674a2d2d, 0xb071c1c1, 0x0e575959, 0xe99f7676, 0xe135d4d4,
+    0x661e7878, 0xb4249090, 0x360e3838, 0x265f7979, 0xef628d8d, 0x38596161, 0x95d24747, 0x2aa08a8a,
+    0xb1259494, 0xaa228888, 0x8c7df1f1, 0xd73becec, 0x05010404, 0xa5218484, 0x9879e1e1, 0x9b851e1e,
+    0x84d75353, 0x00000000, 0x5e471919, 0x0b565d5d, 0xe39d7e7e, 0x9fd04f4f, 0xbb279c9c, 0x1a534949,
+    0x7c4d3131, 0xee36d8d8, 0x0a020808, 0x7be49f9f, 0x20a28282, 0xd4c71313, 0xe8cb2323, 0xe69c7a7a,
+    0x42e9abab, 0x43bdfefe, 0xa2882a2a, 0x9ad14b4b, 0x40410101, 0xdbc41f1f, 0xd838e0e0, 0x61b7d6d6,
+    0x2fa18e8e, 0x2bf4dfdf, 0x3af1cbcb, 0xf6cd3b3b, 0x1dfae7e7, 0xe5608585, 0x41155454, 0x25a38686,
+    0x60e38383, 0x16acbaba, 0x295c7575, 0x34a69292, 0xf7996e6e, 0xe434d0d0, 0x721a6868, 0x01545555,
+    0x19afb6b6, 0xdf914e4e, 0xfa32c8c8, 0xf030c0c0, 0x21f6d7d7, 0xbc8e3232, 0x75b3c6c6, 0x6fe08f8f,
+    0x691d7474, 0x2ef5dbdb, 0x6ae18b8b, 0x962eb8b8, 0x8a800a0a, 0xfe679999, 0xe2c92b2b, 0xe0618181,
+    0xc0c30303, 0x8d29a4a4, 0xaf238c8c, 0x07a9aeae, 0x390d3434, 0x1f524d4d, 0x764f3939, 0xd36ebdbd,
+    0x81d65757, 0xb7d86f6f, 0xeb37dcdc, 0x51441515, 0xa6dd7b7b, 0x09fef7f7, 0xb68c3a3a, 0x932fbcbc,
+    0x0f030c0c, 0x03fcffff, 0xc26ba9a9, 0xba73c9c9, 0xd96cb5b5, 0xdc6db1b1, 0x375a6d6d, 0x15504545,
+    0xb98f3636, 0x771b6c6c, 0x13adbebe, 0xda904a4a, 0x57b9eeee, 0xa9de7777, 0x4cbef2f2, 0x837efdfd,
+    0x55114444, 0xbdda6767, 0x2c5d7171, 0x45400505, 0x631f7c7c, 0x50104040, 0x325b6969, 0xb8db6363,
+    0x220a2828, 0xc5c20707, 0xf531c4c4, 0xa88a2222, 0x31a79696, 0xf9ce3737, 0x977aeded, 0x49bff6f6,
+    0x992db4b4, 0xa475d1d1, 0x90d34343, 0x5a124848, 0x58bae2e2, 0x71e69797, 0x64b6d2d2, 0x70b2c2c2,
+    0xad8b2626, 0xcd68a5a5, 0xcb955e5e, 0x624b2929, 0x3c0c3030, 0xce945a5a, 0xab76dddd, 0x867ff9f9,
+    0xf1649595, 0x5dbbe6e6, 0x35f2c7c7, 0x2d092424, 0xd1c61717, 0xd66fb9b9, 0xdec51b1b, 0x94861212,
+    0x78186060, 0x30f3c3c3, 0x897cf5f5, 0x5cefb3b3, 0xd23ae8e8, 0xacdf7373, 0x794c3535, 0xa0208080,
+    0x9d78e5e5, 0x56edbbbb, 0x235e7d7d, 0xc63ef8f8, 0x8bd45f5f, 0xe7c82f2f, 0xdd39e4e4, 0x68492121
+};
+
+static const uint32_t SM4_T1[256] =
+{
+    0x5b8ed55b, 0x42d09242, 0xa74deaa7, 0xfb06fdfb, 0x33fccf33, 0x8765e287, 0xf4c93df4, 0xde6bb5de,
+    0x584e1658, 0xda6eb4da, 0x50441450, 0x0bcac10b, 0xa08828a0, 0xef17f8ef, 0xb09c2cb0, 0x14110514,
+    0xac872bac, 0x9dfb669d, 0x6af2986a, 0xd9ae77d9, 0xa8822aa8, 0xfa46bcfa, 0x10140410, 0x0fcfc00f,
+    0xaa02a8aa, 0x11544511, 0x4c5f134c, 0x98be2698, 0x256d4825, 0x1a9e841a, 0x181e0618, 0x66fd9b66,
+    0x72ec9e72, 0x094a4309, 0x41105141, 0xd324f7d3, 0x46d59346, 0xbf53ecbf, 0x62f89a62, 0xe9927be9,
+    0xccff33cc, 0x51045551, 0x2c270b2c, 0x0d4f420d, 0xb759eeb7, 0x3ff3cc3f, 0xb21caeb2, 0x89ea6389,
+    0x9374e793, 0xce7fb1ce, 0x706c1c70, 0xa60daba6, 0x27edca27, 0x20280820, 0xa348eba3, 0x56c19756,
+    0x02808202, 0x7fa3dc7f, 0x52c49652, 0xeb12f9eb, 0xd5a174d5, 0x3eb38d3e, 0xfcc33ffc, 0x9a3ea49a,
+    0x1d5b461d, 0x1c1b071c, 0x9e3ba59e, 0xf30cfff3, 0xcf3ff0cf, 0xcdbf72cd, 0x5c4b175c, 0xea52b8ea,
+    0x0e8f810e, 0x653d5865, 0xf0cc3cf0, 0x647d1964, 0x9b7ee59b, 0x16918716, 0x3d734e3d, 0xa208aaa2,
+    0xa1c869a1, 0xadc76aad, 0x06858306, 0xca7ab0ca, 0xc5b570c5, 0x91f46591, 0x6bb2d96b, 0x2ea7892e,
+    0xe318fbe3, 0xaf47e8af, 0x3c330f3c, 0x2d674a2d, 0xc1b071c1, 0x590e5759, 0x76e99f76, 0xd4e135d4,
+    0x78661e78, 0x90b42490, 0x38360e38, 0x79265f79, 0x8def628d, 0x61385961, 0x4795d247, 0x8a2aa08a,
+    0x94b12594, 0x88aa2288, 0xf18c7df1, 0xecd73bec, 0x04050104, 0x84a52184, 0xe19879e1, 0x1e9b851e,
+    0x5384d753, 0x00000000, 0x195e4719, 0x5d0b565d, 0x7ee39d7e, 0x4f9fd04f, 0x9cbb279c, 0x491a5349,
+    0x317c4d31, 0xd8ee36d8, 0x080a0208, 0x9f7be49f, 0x8220a282, 0x13d4c713, 0x23e8cb23, 0x7ae69c7a,
+    0xab42e9ab, 0xfe43bdfe, 0x2aa2882a, 0x4b9ad14b, 0x01404101, 0x1fdbc41f, 0xe0d838e0, 0xd661b7d6,
+    0x8e2fa18e, 0xdf2bf4df, 0xcb3af1cb, 0x3bf6cd3b, 0xe71dfae7, 0x85e56085, 0x54411554, 0x8625a386,
+    0x8360e383, 0xba16acba, 0x75295c75, 0x9234a692, 0x6ef7996e, 0xd0e434d0, 0x68721a68, 0x55015455,
+    0xb619afb6, 0x4edf914e, 0xc8fa32c8, 0xc0f030c0, 0xd721f6d7, 0x32bc8e32, 0xc675b3c6, 0x8f6fe08f,
+    0x74691d74, 0xdb2ef5db, 0x8b6ae18b, 0xb8962eb8, 0x0a8a800a, 0x99fe6799, 0x2be2c92b, 0x81e06181,
+    0x03c0c303, 0xa48d29a4, 0x8caf238c, 0xae07a9ae, 0x34390d34, 0x4d1f524d, 0x39764f39, 0xbdd36ebd,
+    0x5781d657, 0x6fb7d86f, 0xdceb37dc, 0x15514415, 0x7ba6dd7b, 0xf709fef7, 0x3ab68c3a, 0xbc932fbc,
+    0x0c0f030c, 0xff03fcff, 0xa9c26ba9, 0xc9ba73c9, 0xb5d96cb5, 0xb1dc6db1, 0x6d375a6d, 0x45155045,
+    0x36b98f36, 0x6c771b6c, 0xbe13adbe, 0x4ada904a, 0xee57b9ee, 0x77a9de77, 0xf24cbef2, 0xfd837efd,
+    0x44551144, 0x67bdda67, 0x712c5d71, 0x05454005, 0x7c631f7c, 0x40501040, 0x69325b69, 0x63b8db63,
+    0x28220a28, 0x07c5c207, 0xc4f531c4, 0x22a88a22, 0x9631a796, 0x37f9ce37, 0xed977aed, 0xf649bff6,
+    0xb4992db4, 0xd1a475d1, 0x4390d343, 0x485a1248, 0xe258bae2, 0x9771e697, 0xd264b6d2, 0xc270b2c2,
+    0x26ad8b26, 0xa5cd68a5, 0x5ecb955e, 0x29624b29, 0x303c0c30, 0x5ace945a, 0xddab76dd, 0xf9867ff9,
+    0x95f16495, 0xe65dbbe6, 0xc735f2c7, 0x242d0924, 0x17d1c617, 0xb9d66fb9, 0x1bdec51b, 0x12948612,
+    0x60781860, 0xc330f3c3, 0xf5897cf5, 0xb35cefb3, 0xe8d23ae8, 0x73acdf73, 0x35794c35, 0x80a02080,
+    0xe59d78e5, 0xbb56edbb, 0x7d235e7d, 0xf8c63ef8, 0x5f8bd45f, 0x2fe7c82f, 0xe4dd39e4, 0x21684921
+};
+
+static const uint32_t SM4_T2[256] =
+{
+    0x5b5b8ed5, 0x4242d092, 0xa7a74dea, 0xfbfb06fd, 0x3333fccf, 0x878765e2, 0xf4f4c93d, 0xdede6bb5,
+    0x58584e16, 0xdada6eb4, 0x50504414, 0x0b0bcac1, 0xa0a08828, 0xefef17f8, 0xb0b09c2c, 0x14141105,
+    0xacac872b, 0x9d9dfb66, 0x6a6af298, 0xd9d9ae77, 0xa8a8822a, 0xfafa46bc, 0x10101404, 0x0f0fcfc0,
+    0xaaaa02a8, 0x11115445, 0x4c4c5f13, 0x9898be26, 0x25256d48, 0x1a1a9e84, 0x18181e06, 0x6666fd9b,
+    0x7272ec9e, 0x09094a43, 0x41411051, 0xd3d324f7, 0x4646d593, 0xbfbf53ec, 0x6262f89a, 0xe9e9927b,
+    0xccccff33, 0x51510455, 0x2c2c270b, 0x0d0d4f42, 0xb7b759ee, 0x3f3ff3cc, 0xb2b21cae, 0x8989ea63,
+    0x939374e7, 0xcece7fb1, 0x70706c1c, 0xa6a60dab, 0x2727edca, 0x20202808, 0xa3a348eb, 0x5656c197,
+    0x02028082, 0x7f7fa3dc, 0x5252c496, 0xebeb12f9, 0xd5d5a174, 0x3e3eb38d, 0xfcfcc33f, 0x9a9a3ea4,
+    0x1d1d5b46, 0x1c1c1b07, 0x9e9e3ba5, 0xf3f30cff, 0xcfcf3ff0, 0xcdcdbf72, 0x5c5c4b17, 0xeaea52b8,
+    0x0e0e8f81, 0x65653d58, 0xf0f0cc3c, 0x64647d19, 0x9b9b7ee5, 0x16169187, 0x3d3d734e, 0xa2a208aa,
+    0xa1a1c869, 0xadadc76a, 0x06068583, 0xcaca7ab0, 0xc5c5b570, 0x9191f465, 0x6b6bb2d9, 0x2e2ea789,
+    0xe3e318fb, 0xafaf47e8, 0x3c3c330f, 0x2d2d674a, 0xc1c1b071, 0x59590e57, 0x7676e99f, 0xd4d4e135,
+    0x7878661e, 0x9090b424, 0x3838360e, 0x7979265f, 0x8d8def62, 0x61613859, 0x474795d2, 0x8a8a2aa0,
+    0x9494b125, 0x8888aa22, 0xf1f18c7d, 0xececd73b, 0x04040501, 0x8484a521, 0xe1e19879, 0x1e1e9b85,
+    0x535384d7, 0x00000000, 0x19195e47, 0x5d5d0b56, 0x7e7ee39d, 0x4f4f9fd0, 0x9c9cbb27, 0x49491a53,
+    0x31317c4d, 0xd8d8ee36, 0x08080a02, 0x9f9f7be4, 0x828220a2, 0x1313d4c7, 0x2323e8cb, 0x7a7ae69c,
+    0xabab42e9, 0xfefe43bd, 0x2a2aa288, 0x4b4b9ad1, 0x01014041, 0x1f1fdbc4, 0xe0e0d838, 0xd6d661b7,
+    0x8e8e2fa1, 0xdfdf2bf4, 0xcbcb3af1, 0x3b3bf6cd, 0xe7e71dfa, 0x8585e560, 0x54544115, 0x868625a3,
+    0x838360e3, 0xbaba16ac, 0x7575295c, 0x929234a6, 0x6e6ef799, 0xd0d0e434, 0x6868721a, 0x55550154,
+    0xb6b619af, 0x4e4edf91, 0xc8c8fa32, 0xc0c0f030, 0xd7d721f6, 0x3232bc8e, 0xc6c675b3, 0x8f8f6fe0,
+    0x7474691d, 0xdbdb2ef5, 0x8b8b6ae1, 0xb8b8962e, 0x0a0a8a80, 0x9999fe67, 0x2b2be2c9, 0x8181e061,
+    0x0303c0c3, 0xa4a48d29, 0x8c8caf23, 0xaeae07a9, 0x3434390d, 0x4d4d1f52, 0x3939764f, 0xbdbdd36e,
+    0x575781d6, 0x6f6fb7d8, 0xdcdceb37, 0x15155144, 0x7b7ba6dd, 0xf7f709fe, 0x3a3ab68c, 0xbcbc932f,
+    0x0c0c0f03, 0xffff03fc, 0xa9a9c26b, 0xc9c9ba73, 0xb5b5d96c, 0xb1b1dc6d, 0x6d6d375a, 0x45451550,
+    0x3636b98f, 0x6c6c771b, 0xbebe13ad, 0x4a4ada90, 0xeeee57b9, 0x7777a9de, 0xf2f24cbe, 0xfdfd837e,
+    0x44445511, 0x6767bdda, 0x71712c5d, 0x05054540, 0x7c7c631f, 0x40405010, 0x6969325b, 0x6363b8db,
+    0x2828220a, 0x0707c5c2, 0xc4c4f531, 0x2222a88a, 0x969631a7, 0x3737f9ce, 0xeded977a, 0xf6f649bf,
+    0xb4b4992d, 0xd1d1a475, 0x434390d3, 0x48485a12, 0xe2e258ba, 0x979771e6, 0xd2d264b6, 0xc2c270b2,
+    0x2626ad8b, 0xa5a5cd68, 0x5e5ecb95, 0x2929624b, 0x30303c0c, 0x5a5ace94, 0xddddab76, 0xf9f9867f,
+    0x9595f164, 0xe6e65dbb, 0xc7c735f2, 0x24242d09, 0x1717d1c6, 0xb9b9d66f, 0x1b1bdec5, 0x12129486,
+    0x60607818, 0xc3c330f3, 0xf5f5897c, 0xb3b35cef, 0xe8e8d23a, 0x7373acdf, 0x3535794c, 0x8080a020,
+    0xe5e59d78, 0xbbbb56ed, 0x7d7d235e, 0xf8f8c63e, 0x5f5f8bd4, 0x2f2fe7c8, 0xe4e4dd39, 0x21216849
+};
+
+static const uint32_t SM4_T3[256] =
+{
+    0xd55b5b8e, 0x924242d0, 0xeaa7a74d, 0xfdfbfb06, 0xcf3333fc, 0xe2878765, 0x3df4f4c9, 0xb5dede6b,
+    0x1658584e, 0xb4dada6e, 0x14505044, 0xc10b0bca, 0x28a0a088, 0xf8efef17, 0x2cb0b09c, 0x05141411,
+    0x2bacac87, 0x669d9dfb, 0x986a6af2, 0x77d9d9ae, 0x2aa8a882, 0xbcfafa46, 0x04101014, 0xc00f0fcf,
+    0xa8aaaa02, 0x45111154, 0x134c4c5f, 0x269898be, 0x4825256d, 0x841a1a9e, 0x0618181e, 0x9b6666fd,
+    0x9e7272ec, 0x4309094a, 0x51414110, 0xf7d3d324, 0x934646d5, 0xecbfbf53, 0x9a6262f8, 0x7be9e992,
+    0x33ccccff, 0x55515104, 0x0b2c2c27, 0x420d0d4f, 0xeeb7b759, 0xcc3f3ff3, 0xaeb2b21c, 0x638989ea,
+    0xe7939374, 0xb1cece7f, 0x1c70706c, 0xaba6a60d, 0xca2727ed, 0x08202028, 0xeba3a348, 0x975656c1,
+    0x82020280, 0xdc7f7fa3, 0x965252c4, 0xf9ebeb12, 0x74d5d5a1, 0x8d3e3eb3, 0x3ffcfcc3, 0xa49a9a3e,
+    0x461d1d5b, 0x071c1c1b, 0xa59e9e3b, 0xfff3f30c, 0xf0cfcf3f, 0x72cdcdbf, 0x175c5c4b, 0xb8eaea52,
+    0x810e0e8f, 0x5865653d, 0x3cf0f0cc, 0x1964647d, 0xe59b9b7e, 0x87161691, 0x4e3d3d73, 0xaaa2a208,
+    0x69a1a1c8, 0x6aadadc7, 0x83060685, 0xb0caca7a, 0x70c5c5b5, 0x659191f4, 0xd96b6bb2, 0x892e2ea7,
+    0xfbe3e318, 0xe8afaf47, 0x0f3c3c33, 0x4a2d2d67, 0x71c1c1b0, 0x5759590e, 0x9f7676e9, 0x35d4d4e1,
+    0x1e787866, 0x249090b4, 0x0e383836, 0x5f797926, 0x628d8def, 0x59616138, 0xd2474795, 0xa08a8a2a,
+    0x259494b1, 0x228888aa, 0x7df1f18c, 0x3bececd7, 0x01040405, 0x218484a5, 0x79e1e198, 0x851e1e9b,
+    0xd7535384, 0x00000000, 0x4719195e, 0x565d5d0b, 0x9d7e7ee3, 0xd04f4f9f, 0x279c9cbb, 0x5349491a,
+    0x4d31317c, 0x36d8d8ee, 0x0208080a, 0xe49f9f7b, 0xa2828220, 0xc71313d4, 0xcb2323e8, 0x9c7a7ae6,
+    0xe9abab42, 0xbdfefe43, 0x882a2aa2, 0xd14b4b9a, 0x41010140, 0xc41f1fdb, 0x38e0e0d8, 0xb7d6d661,
+    0xa18e8e2f, 0xf4dfdf2b, 0xf1cbcb3a, 0xcd3b3bf6, 0xfae7e71d, 0x608585e5, 0x15545441, 0xa3868625,
+    0xe3838360, 0xacbaba16, 0x5c757529, 0xa6929234, 0x996e6ef7, 0x34d0d0e4, 0x1a686872, 0x54555501,
+    0xafb6b619, 0x914e4edf, 0x32c8c8fa, 0x30c0c0f0, 0xf6d7d721, 0x8e3232bc, 0xb3c6c675, 0xe08f8f6f,
+    0x1d747469, 0xf5dbdb2e, 0xe18b8b6a, 0x2eb8b896, 0x800a0a8a, 0x679999fe, 0xc92b2be2, 0x618181e0,
+    0xc30303c0, 0x29a4a48d, 0x238c8caf, 0xa9aeae07, 0x0d343439, 0x524d4d1f, 0x4f393976, 0x6ebdbdd3,
+    0xd6575781, 0xd86f6fb7, 0x37dcdceb, 0x44151551, 0xdd7b7ba6, 0xfef7f709, 0x8c3a3ab6, 0x2fbcbc93,
+    0x030c0c0f, 0xfcffff03, 0x6ba9a9c2, 0x73c9c9ba, 0x6cb5b5d9, 0x6db1b1dc, 0x5a6d6d37, 0x50454515,
+    0x8f3636b9, 0x1b6c6c77, 0xadbebe13, 0x904a4ada, 0xb9eeee57, 0xde7777a9, 0xbef2f24c, 0x7efdfd83,
+    0x11444455, 0xda6767bd, 0x5d71712c, 0x40050545, 0x1f7c7c63, 0x10404050, 0x5b696932, 0xdb6363b8,
+    0x0a282822, 0xc20707c5, 0x31c4c4f5, 0x8a2222a8, 0xa7969631, 0xce3737f9, 0x7aeded97, 0xbff6f649,
+    0x2db4b499, 0x75d1d1a4, 0xd3434390, 0x1248485a, 0xbae2e258, 0xe6979771, 0xb6d2d264, 0xb2c2c270,
+    0x8b2626ad, 0x68a5a5cd, 0x955e5ecb, 0x4b292962, 0x0c30303c, 0x945a5ace, 0x76ddddab, 0x7ff9f986,
+    0x649595f1, 0xbbe6e65d, 0xf2c7c735, 0x0924242d, 0xc61717d1, 0x6fb9b9d6, 0xc51b1bde, 0x86121294,
+    0x18606078, 0xf3c3c330, 0x7cf5f589, 0xefb3b35c, 0x3ae8e8d2, 0xdf7373ac, 0x4c353579, 0x208080a0,
+    0x78e5e59d, 0xedbbbb56, 0x5e7d7d23, 0x3ef8f8c6, 0xd45f5f8b, 0xc82f2fe7, 0x39e4e4dd, 0x49212168
+};
+
 
 /*
  * private function:
@@ -101,74 +259,43 @@ static unsigned char sm4Sbox(unsigned char inch)
 }
 
 /*
- * private F(Lt) function:
- * "T algorithm" == "L algorithm" + "t algorithm".
- * args:    [in] a: a is a 32 bits unsigned value;
- * return: c: c is calculated with line algorithm "L" and nonline algorithm "t"
+ * private T function:
+ * "T algorithm" == "L algorithm" + "t algorithm", four table lookups.
  */
-static unsigned long sm4Lt(unsigned long ka)
-{
-    unsigned long bb = 0;
-    unsigned long c = 0;
-    unsigned char a[4];
-    unsigned char b[4];
-    PUT_ULONG_BE(ka, a, 0)
-    b[0] = sm4Sbox(a[0]);
-    b[1] = sm4Sbox(a[1]);
-    b[2] = sm4Sbox(a[2]);
-    b[3] = sm4Sbox(a[3]);
-    GET_ULONG_BE(bb, b, 0)
-    c = bb ^ (ROTL(bb, 2)) ^ (ROTL(bb, 10)) ^ (ROTL(bb, 18)) ^ (ROTL(bb, 24));
-    return c;
-}
-
-/*
- * private F function:
- * Calculating and getting encryption/decryption contents.
- * args:    [in] x0: original contents;
- * args:    [in] x1: original contents;
- * args:    [in] x2: original contents;
- * args:    [in] x3: original contents;
- * args:    [in] rk: encryption/decryption key;
- * return the contents of encryption/decryption contents.
- */
-static unsigned long sm4F(unsigned long x0, unsigned long x1, unsigned long x2, unsigned long x3, unsigned long rk)
-{
-    return (x0 ^ sm4Lt(x1 ^ x2 ^ x3 ^ rk));
-}
-
+#define SM4_T(x) ( SM4_T0[ (x) >> 24 ] ^ SM4_T1[ ((x) >> 16) & 0xFF ] ^ \
+                   SM4_T2[ ((x) >> 8) & 0xFF ] ^ SM4_T3[ (x) & 0xFF ] )
 
 /* private function:
  * Calculating round encryption key.
  * args:    [in] a: a is a 32 bits unsigned value;
  * return: sk[i]: i{0,1,2,3,...31}.
  */
-static unsigned long sm4CalciRK(unsigned long ka)
+static uint32_t sm4CalciRK(uint32_t ka)
 {
-    unsigned long bb = 0;
-    unsigned long rk = 0;
+    uint32_t bb = 0;
+    uint32_t rk = 0;
     unsigned char a[4];
     unsigned char b[4];
-    PUT_ULONG_BE(ka, a, 0)
+    PUT_UINT32_BE(ka, a, 0)
     b[0] = sm4Sbox(a[0]);
     b[1] = sm4Sbox(a[1]);
     b[2] = sm4Sbox(a[2]);
     b[3] = sm4Sbox(a[3]);
-    GET_ULONG_BE(bb, b, 0)
+    GET_UINT32_BE(bb, b, 0)
     rk = bb ^ (ROTL(bb, 13)) ^ (ROTL(bb, 23));
     return rk;
 }
 
-static void sm4_setkey( unsigned long SK[32], unsigned char key[16] )
+static void sm4_setkey( uint32_t SK[32], unsigned char key[16] )
 {
-    unsigned long MK[4];
-    unsigned long k[36];
-    unsigned long i = 0;
-
-    GET_ULONG_BE( MK[0], key, 0 );
-    GET_ULONG_BE( MK[1], key, 4 );
-    GET_ULONG_BE( MK[2], key, 8 );
-    GET_ULONG_BE( MK[3], key, 12 );
+    uint32_t MK[4];
+    uint32_t k[36];
+    uint32_t i = 0;
+
+    GET_UINT32_BE( MK[0], key, 0 );
+    GET_UINT32_BE( MK[1], key, 4 );
+    GET_UINT32_BE( MK[2], key, 8 );
+    GET_UINT32_BE( MK[3], key, 12 );
     k[0] = MK[0] ^ FK[0];
     k[1] = MK[1] ^ FK[1];
     k[2] = MK[2] ^ FK[2];
@@ -183,32 +310,203 @@ static void sm4_setkey( unsigned long SK[32], unsigned char key[16] )
 
 /*
  * SM4 standard one round processing
- *
+ * 32 rounds unrolled by 4, the state words rotate through x0..x3
  */
-static void sm4_one_round( unsigned long sk[32],
-                           unsigned char input[16],
+static void sm4_one_round( const uint32_t sk[32],
+                           const unsigned char input[16],
                            unsigned char output[16] )
 {
-    unsigned long i = 0;
-    unsigned long ulbuf[36];
+    uint32_t x0, x1, x2, x3;
+    GET_UINT32_BE( x0, input, 0 )
+    GET_UINT32_BE( x1, input, 4 )
+    GET_UINT32_BE( x2, input, 8 )
+    GET_UINT32_BE( x3, input, 12 )
+    for (int i = 0; i < 32; i += 4)
+    {
+        uint32_t t;
+        t = x1 ^ x2 ^ x3 ^ sk[i    ];  x0 ^= SM4_T(t);
+        t = x2 ^ x3 ^ x0 ^ sk[i + 1];  x1 ^= SM4_T(t);
+        t = x3 ^ x0 ^ x1 ^ sk[i + 2];  x2 ^= SM4_T(t);
+        t = x0 ^ x1 ^ x2 ^ sk[i + 3];  x3 ^= SM4_T(t);
+    }
+    PUT_UINT32_BE(x3, output, 0);
+    PUT_UINT32_BE(x2, output, 4);
+    PUT_UINT32_BE(x1, output, 8);
+    PUT_UINT32_BE(x0, output, 12);
+}
 
-    memset(ulbuf, 0, sizeof(ulbuf));
-    GET_ULONG_BE( ulbuf[0], input, 0 )
-    GET_ULONG_BE( ulbuf[1], input, 4 )
-    GET_ULONG_BE( ulbuf[2], input, 8 )
-    GET_ULONG_BE( ulbuf[3], input, 12 )
-    while (i < 32)
+/*
+ * SM4 multi-block processing, blocks are independent (ECB, CTR, CBC decryption)
+ */
+#define SM4_PARALLEL_BLOCKS     16
+
+typedef void (*sm4_blocks_func)( const uint32_t sk[32], const unsigned char *input, unsigned char *output, size_t blocks );
+
+static void sm4_crypt_blocks_scalar( const uint32_t sk[32],
+                                     const unsigned char *input,
+                                     unsigned char *output,
+                                     size_t blocks )
+{
+    for (size_t i = 0; i < blocks; ++i)
     {
-        ulbuf[i + 4] = sm4F(ulbuf[i], ulbuf[i + 1], ulbuf[i + 2], ulbuf[i + 3], sk[i]);
-// #ifdef _DEBUG
-//          printf("rk(%02d) = 0x%08x,  X(%02d) = 0x%08x \n",i,sk[i], i, ulbuf[i+4] );
-// #endif
-        i++;
+        sm4_one_round( sk, input + 16 * i, output + 16 * i );
     }
-    PUT_ULONG_BE(ulbuf[35], output, 0);
-    PUT_ULONG_BE(ulbuf[34], output, 4);
-    PUT_ULONG_BE(ulbuf[33], output, 8);
-    PUT_ULONG_BE(ulbuf[32], output, 12);
+}
+
+#ifdef SM4_AESNI
+/*
+ * SM4 S-box computed with the AES S-box: SM4 and AES S-boxes are both inversion in GF(2^8)
+ * with different affine maps, so Sbox(x) = post(AES_Sbox(pre(x))), the affine maps pre/post
+ * are two 4-bit table lookups each (pshufb), AES_Sbox is aesenclast.
+ * Four blocks are transposed so that each register holds the same word of four blocks.
+ */
+#define SM4_AESNI_TARGET __attribute__((target("aes,ssse3")))
+
+struct sm4_aesni_const
+{
+    __m128i pre_lo, pre_hi, post_lo, post_hi;
+    __m128i mask4bit;
+    __m128i inv_shift_row, rol_8, rol_16, rol_24;
+    __m128i bswap32;
+};
+
+SM4_AESNI_TARGET static inline void sm4_aesni_init( sm4_aesni_const &c )
+{
+    c.pre_lo        = _mm_set_epi64x( 0xC7C1B4B222245157LL, (long long)0x9197E2E474720701ULL );
+    c.pre_hi        = _mm_set_epi64x( (long long)0xF052B91BF95BB012ULL, (long long)0xE240AB09EB49A200ULL );
+    c.post_lo       = _mm_set_epi64x( (long long)0xEDD14478172BBE82ULL, 0x5B67F2CEA19D0834LL );
+    c.post_hi       = _mm_set_epi64x( 0x11CDBE62CC1063BFLL, (long long)0xAE7201DD73AFDC00ULL );
+    c.mask4bit      = _mm_set1_epi32( 0x0f0f0f0f );
+    c.inv_shift_row = _mm_setr_epi8( 0x00, 0x0d, 0x0a, 0x07, 0x04, 0x01, 0x0e, 0x0b, 0x08, 0x05, 0x02, 0x0f, 0x0c, 0x09, 0x06, 0x03 );
+    c.rol_8         = _mm_setr_epi8( 0x07, 0x00, 0x0d, 0x0a, 0x0b, 0x04, 0x01, 0x0e, 0x0f, 0x08, 0x05, 0x02, 0x03, 0x0c, 0x09, 0x06 );
+    c.rol_16        = _mm_setr_epi8( 0x0a, 0x07, 0x00, 0x0d, 0x0e, 0x0b, 0x04, 0x01, 0x02, 0x0f, 0x08, 0x05, 0x06, 0x03, 0x0c, 0x09 );
+    c.rol_24        = _mm_setr_epi8( 0x0d, 0x0a, 0x07, 0x00, 0x01, 0x0e, 0x0b, 0x04, 0x05, 0x02, 0x0f, 0x08, 0x09, 0x06, 0x03, 0x0c );
+    c.bswap32       = _mm_setr_epi8( 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+}
+
+SM4_AESNI_TARGET static inline __m128i sm4_aesni_affine( __m128i x, __m128i lo, __m128i hi, __m128i mask4bit )
+{
+    __m128i low = _mm_and_si128( x, mask4bit );
+    __m128i high = _mm_srli_epi32( _mm_andnot_si128( mask4bit, x ), 4 );
+    return _mm_xor_si128( _mm_shuffle_epi8( lo, low ), _mm_shuffle_epi8( hi, high ) );
+}
+
+/* s0 ^= T(s1 ^ s2 ^ s3 ^ rk), the inverse ShiftRows of aesenclast is folded into the rotations */
+SM4_AESNI_TARGET static inline __m128i sm4_aesni_round( const sm4_aesni_const &c, __m128i rk,
+                                                        __m128i s0, __m128i s1, __m128i s2, __m128i s3 )
+{
+    __m128i x = _mm_xor_si128( _mm_xor_si128( s1, s2 ), _mm_xor_si128( s3, rk ) );
+    x = sm4_aesni_affine( x, c.pre_lo, c.pre_hi, c.mask4bit );
+    x = _mm_aesenclast_si128( x, _mm_setzero_si128() );
+    x = sm4_aesni_affine( x, c.post_lo, c.post_hi, c.mask4bit );
+
+    __m128i t0 = _mm_shuffle_epi8( x, c.inv_shift_row );
+    s0 = _mm_xor_si128( s0, t0 );
+    t0 = _mm_xor_si128( t0, _mm_shuffle_epi8( x, c.rol_8 ) );
+    t0 = _mm_xor_si128( t0, _mm_shuffle_epi8( x, c.rol_16 ) );
+    s0 = _mm_xor_si128( s0, _mm_shuffle_epi8( x, c.rol_24 ) );
+    s0 = _mm_xor_si128( s0, _mm_or_si128( _mm_slli_epi32( t0, 2 ), _mm_srli_epi32( t0, 30 ) ) );
+    return s0;
+}
+
+SM4_AESNI_TARGET static inline void sm4_aesni_transpose( __m128i &x0, __m128i &x1, __m128i &x2, __m128i &x3 )
+{
+    __m128i t0 = _mm_unpacklo_epi32( x0, x1 );
+    __m128i t1 = _mm_unpacklo_epi32( x2, x3 );
+    __m128i t2 = _mm_unpackhi_epi32( x0, x1 );
+    __m128i t3 = _mm_unpackhi_epi32( x2, x3 );
+    x0 = _mm_unpacklo_epi64( t0, t1 );
+    x1 = _mm_unpackhi_epi64( t0, t1 );
+    x2 = _mm_unpacklo_epi64( t2, t3 );
+    x3 = _mm_unpackhi_epi64( t2, t3 );
+}
+
+SM4_AESNI_TARGET static inline void sm4_aesni_load( const sm4_aesni_const &c, const unsigned char *input, __m128i s[4] )
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        s[i] = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)(input + 16 * i) ), c.bswap32 );
+    }
+    sm4_aesni_transpose( s[0], s[1], s[2], s[3] );
+}
+
+SM4_AESNI_TARGET static inline void sm4_aesni_store( const sm4_aesni_const &c, __m128i s[4], unsigned char *output )
+{
+    // 输出顺序为x35, x34, x33, x32
+    sm4_aesni_transpose( s[3], s[2], s[1], s[0] );
+    for (int i = 0; i < 4; ++i)
+    {
+        _mm_storeu_si128( (__m128i *)(output + 16 * i), _mm_shuffle_epi8( s[3 - i], c.bswap32 ) );
+    }
+}
+
+/* 每次处理8个分组(两组交错, 隐藏aesenclast和pshufb延迟), 剩余4个分组一次, 不足4个用查表实现 */
+SM4_AESNI_TARGET static void sm4_crypt_blocks_aesni( const uint32_t sk[32],
+                                                     const unsigned char *input,
+                                                     unsigned char *output,
+                                                     size_t blocks )
+{
+    sm4_aesni_const c;
+    sm4_aesni_init( c );
+
+    for (; blocks >= 8; blocks -= 8, input += 128, output += 128)
+    {
+        __m128i a[4], b[4];
+        sm4_aesni_load( c, input, a );
+        sm4_aesni_load( c, input + 64, b );
+        for (int i = 0; i < 32; ++i)
+        {
+            __m128i rk = _mm_set1_epi32( (int)sk[i] );
+            int j = i & 3;
+            a[j] = sm4_aesni_round( c, rk, a[j], a[(j + 1) & 3], a[(j + 2) & 3], a[(j + 3) & 3] );
+            b[j] = sm4_aesni_round( c, rk, b[j], b[(j + 1) & 3], b[(j + 2) & 3], b[(j + 3) & 3] );
+        }
+        sm4_aesni_store( c, a, output );
+        sm4_aesni_store( c, b, output + 64 );
+    }
+
+    if (blocks >= 4)
+    {
+        __m128i a[4];
+        sm4_aesni_load( c, input, a );
+        for (int i = 0; i < 32; ++i)
+        {
+            int j = i & 3;
+            a[j] = sm4_aesni_round( c, _mm_set1_epi32( (int)sk[i] ), a[j], a[(j + 1) & 3], a[(j + 2) & 3], a[(j + 3) & 3] );
+        }
+        sm4_aesni_store( c, a, output );
+        blocks -= 4;
+        input += 64;
+        output += 64;
+    }
+
+    sm4_crypt_blocks_scalar( sk, input, output, blocks );
+}
+
+static bool sm4_cpu_aesni()
+{
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid( 1, &eax, &ebx, &ecx, &edx )) {
+        return false;
+    }
+    return (ecx & bit_AES) && (ecx & bit_SSSE3);
+}
+#endif
+
+/*
+ * 按CPU选择多分组实现, 只在第一次调用时检测
+ */
+static void sm4_crypt_blocks( const uint32_t sk[32],
+                              const unsigned char *input,
+                              unsigned char *output,
+                              size_t blocks )
+{
+#ifdef SM4_AESNI
+    static const sm4_blocks_func func = sm4_cpu_aesni() ? sm4_crypt_blocks_aesni : sm4_crypt_blocks_scalar;
+#else
+    static const sm4_blocks_func func = sm4_crypt_blocks_scalar;
+#endif
+    func( sk, input, output, blocks );
 }
 
 /*
@@ -244,14 +542,48 @@ void sm4_crypt_ecb( sm4_context *ctx,
                     unsigned char *input,
                     unsigned char *output)
 {
-    while ( length > 0 )
+    if ( length > 0 )
     {
-        sm4_one_round( ctx->sk, input, output );
-        input  += 16;
-        output += 16;
-        length -= 16;
+        sm4_crypt_blocks( ctx->sk, input, output, ((size_t)length + 15) / 16 );
     }
+}
 
+/*
+ * SM4-CTR buffer encryption/decryption
+ */
+void sm4_crypt_ctr( sm4_context *ctx,
+                    size_t length,
+                    unsigned char counter[16],
+                    const unsigned char *input,
+                    unsigned char *output )
+{
+    unsigned char stream[16 * SM4_PARALLEL_BLOCKS];
+    while ( length > 0 )
+    {
+        size_t blocks = (length + 15) / 16;
+        if ( blocks > SM4_PARALLEL_BLOCKS )
+        {
+            blocks = SM4_PARALLEL_BLOCKS;
+        }
+
+        // 计数器按128位大端整数递增
+        for (size_t i = 0; i < blocks; ++i)
+        {
+            memcpy( stream + 16 * i, counter, 16 );
+            for (int j = 15; j >= 0 && 0 == ++counter[j]; --j) {}
+        }
+        sm4_crypt_blocks( ctx->sk, stream, stream, blocks );
+
+        size_t n = length < 16 * blocks ? length : 16 * blocks;
+        for (size_t i = 0; i < n; ++i)
+        {
+            output[i] = (unsigned char)( input[i] ^ stream[i] );
+        }
+
+        input  += n;
+        output += n;
+        length -= n;
+    }
 }
 
 /*
@@ -263,10 +595,7 @@ void sm4_crypt_cbc( sm4_context *ctx,
                     unsigned char *input,
                     unsigned char *output )
 {
-    memset(output, 0, length);
-
     int i = 0;
-    unsigned char temp[16] = {0};
     if ( ctx->mode == SM4_ENCRYPT )
     {
         while ( length > 0 )
@@ -285,73 +614,303 @@ void sm4_crypt_cbc( sm4_context *ctx,
     }
     else /* SM4_DECRYPT */
     {
+        // 各分组解密互不依赖, 多分组并行解密后再与前一个密文分组异或
+        unsigned char cipher[16 * SM4_PARALLEL_BLOCKS];
         while ( length > 0 )
         {
-            memcpy( temp, input, 16 );
-            sm4_one_round( ctx->sk, input, output );
+            size_t blocks = ((size_t)length + 15) / 16;
+            if ( blocks > SM4_PARALLEL_BLOCKS )
+            {
+                blocks = SM4_PARALLEL_BLOCKS;
+            }
+
+            memcpy( cipher, input, 16 * blocks );
+            sm4_crypt_blocks( ctx->sk, cipher, output, blocks );
 
             for (i = 0; i < 16; i++ ) {
                 output[i] = (unsigned char)( output[i] ^ iv[i] );
             }
+            for (size_t k = 16; k < 16 * blocks; ++k) {
+                output[k] = (unsigned char)( output[k] ^ cipher[k - 16] );
+            }
 
-            memcpy( iv, temp, 16 );
+            memcpy( iv, cipher + 16 * (blocks - 1), 16 );
 
-            input  += 16;
-            output += 16;
-            length -= 16;
+            input  += 16 * blocks;
+            output += 16 * blocks;
+            length -= (int)(16 * blocks);
         }
     }
 }
 
-inline static int RemovePKCS5Padding(std::string &plainText)
+#define SM4_STREAM_CHUNK        (64 * 1024)
+
+/*
+ * 清零密钥相关数据, 避免被编译器优化掉
+ */
+static void sm4_zeroize( void *v, size_t n )
 {
-    if (plainText.empty()) {
-        LOG_ERROR("Text is empty.");
+    volatile unsigned char *p = (volatile unsigned char *)v;
+    while ( n-- )
+    {
+        *p++ = 0;
+    }
+}
+
+Sm4Cipher::Sm4Cipher(bool encrypt, const unsigned char key[16], const unsigned char iv[16], Mode mode)
+    : m_mode(mode), m_encrypt(encrypt), m_finished(false), m_bufLen(0)
+{
+    // CTR模式加解密都使用加密密钥
+    if ( encrypt || SM4_CTR == mode )
+    {
+        sm4_setkey_enc( &m_ctx, (unsigned char *)key );
+    }
+    else
+    {
+        sm4_setkey_dec( &m_ctx, (unsigned char *)key );
+    }
+    memcpy( m_iv, iv, 16 );
+    memset( m_buf, 0, 16 );
+}
+
+Sm4Cipher::Sm4Cipher(const sm4_context &ctx, const unsigned char iv[16], Mode mode)
+    : m_ctx(ctx), m_mode(mode), m_encrypt(SM4_ENCRYPT == ctx.mode), m_finished(false), m_bufLen(0)
+{
+    memcpy( m_iv, iv, 16 );
+    memset( m_buf, 0, 16 );
+}
+
+Sm4Cipher::~Sm4Cipher()
+{
+    sm4_zeroize( &m_ctx, sizeof(m_ctx) );
+    sm4_zeroize( m_iv, sizeof(m_iv) );
+    sm4_zeroize( m_buf, sizeof(m_buf) );
+}
+
+void Sm4Cipher::cryptBlocks(unsigned char *input, unsigned char *output, size_t length)
+{
+    // sm4_crypt_cbc长度为int, 超大缓冲区分段处理
+    const size_t maxLength = 1 << 30;
+    while ( length > 0 )
+    {
+        size_t n = length < maxLength ? length : maxLength;
+        sm4_crypt_cbc( &m_ctx, (int)n, m_iv, input, output );
+        input  += n;
+        output += n;
+        length -= n;
+    }
+}
+
+int Sm4Cipher::update(const unsigned char *input, size_t len, unsigned char *output, size_t &outLen)
+{
+    outLen = 0;
+    if ( m_finished )
+    {
+        LOG_ERROR("Cipher is already finished.");
         return -1;
     }
 
-    const size_t plainTextSize = plainText.size();
-    const int paddValue = plainText[plainTextSize - 1];
-    if (paddValue < 1 || paddValue > 16) {
-        LOG_ERROR("Error padd value: {}.", paddValue);
+    if ( SM4_CTR == m_mode )
+    {
+        // 先用完上次剩余的密钥流, m_buf末尾m_bufLen字节未使用
+        size_t n = 0;
+        for (; n < len && m_bufLen > 0; ++n, --m_bufLen)
+        {
+            output[n] = (unsigned char)( input[n] ^ m_buf[16 - m_bufLen] );
+        }
+
+        size_t blocks = (len - n) & ~(size_t)15;
+        sm4_crypt_ctr( &m_ctx, blocks, m_iv, input + n, output + n );
+        n += blocks;
+
+        if ( n < len )
+        {
+            memset( m_buf, 0, 16 );
+            sm4_crypt_ctr( &m_ctx, 16, m_iv, m_buf, m_buf );
+            for (m_bufLen = 16; n < len; ++n, --m_bufLen)
+            {
+                output[n] = (unsigned char)( input[n] ^ m_buf[16 - m_bufLen] );
+            }
+        }
+
+        outLen = len;
+        return 0;
+    }
+
+    // CBC: 解密时保留最后一个完整分组, 由final()去掉padding
+    const size_t total = m_bufLen + len;
+    size_t process = total & ~(size_t)15;
+    if ( !m_encrypt && process == total && process > 0 )
+    {
+        process -= 16;
+    }
+
+    if ( 0 == process )
+    {
+        memcpy( m_buf + m_bufLen, input, len );
+        m_bufLen += len;
+        return 0;
+    }
+
+    // 缓存的数据与输入开头拼成第一个分组
+    unsigned char first[16];
+    const bool hasFirst = m_bufLen > 0;
+    size_t head = 0;
+    if ( hasFirst )
+    {
+        head = 16 - m_bufLen;
+        memcpy( m_buf + m_bufLen, input, head );
+        cryptBlocks( m_buf, first, 16 );
+        process -= 16;
+    }
+
+    // 写输出前先缓存剩余数据, 原地操作时这部分输入可能被覆盖
+    const size_t rest = len - head - process;
+    memcpy( m_buf, input + head + process, rest );
+    m_bufLen = rest;
+
+    unsigned char *dst = output + (hasFirst ? 16 : 0);
+    if ( hasFirst && input == output )
+    {
+        // 原地操作: 输出比输入靠后, 先在原位置处理再整体后移
+        cryptBlocks( output + head, output + head, process );
+        memmove( dst, output + head, process );
+    }
+    else
+    {
+        cryptBlocks( (unsigned char *)input + head, dst, process );
+    }
+
+    if ( hasFirst )
+    {
+        memcpy( output, first, 16 );
+        sm4_zeroize( first, 16 );
+    }
+
+    outLen = process + (hasFirst ? 16 : 0);
+    return 0;
+}
+
+int Sm4Cipher::final(unsigned char *output, size_t &outLen)
+{
+    outLen = 0;
+    if ( m_finished )
+    {
+        LOG_ERROR("Cipher is already finished.");
         return -1;
     }
+    m_finished = true;
 
-    const size_t paddNum = paddValue;
-    if (plainTextSize < paddNum) {
-        LOG_ERROR("Text size: {} is not smaller than paddNum: {}.", plainTextSize, paddNum);
+    if ( SM4_CTR == m_mode )
+    {
+        return 0;
+    }
+
+    // 加密: 添加P#5 Padding
+    if ( m_encrypt )
+    {
+        const unsigned char paddNum = (unsigned char)(16 - m_bufLen);
+        memset( m_buf + m_bufLen, paddNum, paddNum );
+        cryptBlocks( m_buf, output, 16 );
+        outLen = 16;
+        return 0;
+    }
+
+    if ( 16 != m_bufLen )
+    {
+        LOG_ERROR("Error cipher text length, last block size: {}.", m_bufLen);
         return -1;
     }
-    LOG_DEBUG("paddnum: {}, paddvalue: {}.", paddNum, paddValue);
 
-    // 检查所有的padding值是否相同
-    char *startPos = &plainText[plainTextSize - paddNum];
-    for (size_t i = 0; i < paddNum; ++i) {
-        if (*(startPos + i) != paddValue) {
-            LOG_ERROR("Error paddvalue, pos: {}, value: {}.", i, *(startPos + i));
+    // 解密: 检查并删除P#5 Padding
+    unsigned char block[16];
+    cryptBlocks( m_buf, block, 16 );
+
+    const int paddValue = block[15];
+    if ( paddValue < 1 || paddValue > 16 )
+    {
+        LOG_ERROR("Error padd value: {}.", paddValue);
+        sm4_zeroize( block, 16 );
+        return -1;
+    }
+
+    for (int i = 16 - paddValue; i < 16; ++i)
+    {
+        if ( block[i] != paddValue )
+        {
+            LOG_ERROR("Error paddvalue, pos: {}, value: {}.", i, block[i]);
+            sm4_zeroize( block, 16 );
             return -1;
         }
     }
 
-    *startPos = '\0';
-    plainText.resize(plainTextSize - paddNum);
-    plainText.shrink_to_fit();
-
+    memcpy( output, block, 16 - paddValue );
+    outLen = 16 - paddValue;
+    sm4_zeroize( block, 16 );
     return 0;
 }
 
-inline static int addPKCS5Padding(std::string &plainText, size_t padding = 16)
+int Sm4Cipher::crypt(std::istream &is, std::ostream &os)
 {
-    if (plainText.empty()) {
-        LOG_ERROR("Text is empty.");
+    // 输入输出共用一个缓冲区原地处理, 内存占用与数据大小无关
+    std::vector<unsigned char> buf(SM4_STREAM_CHUNK + 16);
+    size_t outLen = 0;
+
+    while ( is )
+    {
+        is.read( (char *)&buf[0], SM4_STREAM_CHUNK );
+        const size_t n = (size_t)is.gcount();
+        if ( 0 == n )
+        {
+            break;
+        }
+
+        if ( 0 != update( &buf[0], n, &buf[0], outLen ) )
+        {
+            return -1;
+        }
+        if ( !os.write( (const char *)&buf[0], outLen ) )
+        {
+            LOG_ERROR("Failed to write output stream.");
+            return -1;
+        }
+    }
+
+    if ( is.bad() )
+    {
+        LOG_ERROR("Failed to read input stream.");
         return -1;
     }
 
-    const int paddNum = padding - (plainText.size() % padding);
-    for (int i = 0; i < paddNum; ++i) {
-        plainText += (char)paddNum;
+    if ( 0 != final( &buf[0], outLen ) )
+    {
+        return -1;
+    }
+    if ( !os.write( (const char *)&buf[0], outLen ) )
+    {
+        LOG_ERROR("Failed to write output stream.");
+        return -1;
     }
 
+    sm4_zeroize( &buf[0], buf.size() );
+    return 0;
+}
+
+int Sm4Cipher::crypt(const std::string &input, std::string &output)
+{
+    output.clear();
+    output.resize(input.size() + 16);
+
+    size_t updateLen = 0;
+    size_t finalLen = 0;
+    if ( 0 != update( (const unsigned char*)input.data(), input.size(), (unsigned char*)&output[0], updateLen )
+         || 0 != final( (unsigned char*)&output[updateLen], finalLen ) )
+    {
+        output.clear();
+        return -1;
+    }
+
+    output.resize(updateLen + finalLen);
     return 0;
 }
 
@@ -360,19 +919,9 @@ int SM4DecryptCBC(const std::string &encryptInput,
                   const char iv[16],
                   std::string &decryptOutput)
 {
-    decryptOutput.clear();
-    decryptOutput.resize(encryptInput.size());
-
-    sm4_context ctx;
-    sm4_setkey_dec(&ctx, (unsigned char*)key);
-    sm4_crypt_cbc(&ctx,
-                  encryptInput.size(),
-                  (unsigned char*)iv,
-                  (unsigned char*)&encryptInput[0],
-                  (unsigned char*)&decryptOutput[0]);
-
     // 删除P#5 Padding
-    int iRet = RemovePKCS5Padding(decryptOutput);
+    Sm4Cipher cipher(false, (const unsigned char*)key, (const unsigned char*)iv);
+    int iRet = cipher.crypt(encryptInput, decryptOutput);
     if (0 != iRet)
     {
         LOG_ERROR("Failed to remove pkcs5 padding.");
@@ -387,18 +936,12 @@ int SM4EncryptCBC(const std::string &sourceInput,
                   const char iv[16],
                   std::string &encryptOutput)
 {
-    std::string input = sourceInput;
-    addPKCS5Padding(input);
     encryptOutput.clear();
-    encryptOutput.resize(input.size());
-
-    sm4_context ctx;
-    sm4_setkey_enc(&ctx, (unsigned char*)key);
-    sm4_crypt_cbc(&ctx,
-                  input.size(),
-                  (unsigned char*)iv,
-                  (unsigned char*)&input[0],
-                  (unsigned char*)&encryptOutput[0]);
+    if (sourceInput.empty()) {
+        LOG_ERROR("Text is empty.");
+        return 0;
+    }
 
-    return 0;
+    Sm4Cipher cipher(true, (const unsigned char*)key, (const unsigned char*)iv);
+    return cipher.crypt(sourceInput, encryptOutput);
 }
@@ -7,6 +7,9 @@
 #ifndef XYSSL_SM4_H
 #define XYSSL_SM4_H
 
+#include <stdint.h>
+
+#include <iosfwd>
 #include <string>
 
 /**
@@ -15,7 +18,7 @@
 typedef struct
 {
     int mode;                   /*!<  encrypt/decrypt   */
-    unsigned long sk[32];       /*!<  SM4 subkeys       */
+    uint32_t sk[32];            /*!<  SM4 subkeys       */
 } sm4_context;
 
 
@@ -52,6 +55,23 @@ void sm4_crypt_ecb( sm4_context *ctx,
                     unsigned char *input,
                     unsigned char *output);
 
+/**
+ * \brief          SM4-CTR buffer encryption/decryption
+ *
+ * \param ctx      SM4 context, always set with sm4_setkey_enc
+ * \param length   length of the input data, any length; when the data is
+ *                 processed in several calls all but the last call must
+ *                 pass a multiple of 16 bytes
+ * \param counter  128-bit big endian counter block (updated after use)
+ * \param input    buffer holding the input data
+ * \param output   buffer holding the output data, may equal input
+ */
+void sm4_crypt_ctr( sm4_context *ctx,
+                    size_t length,
+                    unsigned char counter[16],
+                    const unsigned char *input,
+                    unsigned char *output );
+
 /**
  * \brief          SM4-CBC buffer encryption/decryption
  * \param ctx      SM4 context
@@ -80,4 +100,77 @@ int SM4EncryptCBC(const std::string &sourceInput,
 }
 #endif
 
+/**
+ * \brief          SM4 streaming cipher, keeps key schedule, IV/counter and
+ *                 the unfinished block between calls
+ *
+ *                 CBC mode uses PKCS#5 padding, CTR mode has no padding.
+ *                 update() output buffer must hold len + 16 bytes, input and
+ *                 output may be the same buffer (in-place); when every update
+ *                 passes a multiple of 16 bytes the output never exceeds the
+ *                 input length.
+ */
+class Sm4Cipher
+{
+public:
+    enum Mode { SM4_CBC = 0, SM4_CTR = 1 };
+
+    /**
+     * \param encrypt  true: encrypt, false: decrypt
+     * \param key      16-byte secret key
+     * \param iv       16-byte IV (CBC) or initial counter block (CTR)
+     * \param mode     SM4_CBC or SM4_CTR
+     */
+    Sm4Cipher(bool encrypt, const unsigned char key[16], const unsigned char iv[16], Mode mode = SM4_CBC);
+
+    /**
+     * \brief          use an expanded key schedule, e.g. a cached one
+     * \param ctx      set with sm4_setkey_enc (encrypt, CTR) or sm4_setkey_dec
+     */
+    Sm4Cipher(const sm4_context &ctx, const unsigned char iv[16], Mode mode = SM4_CBC);
+    ~Sm4Cipher();
+
+    /**
+     * \brief          process len bytes
+     * \param outLen   bytes written to output
+     * \return         0 on success, -1 after final()
+     */
+    int update(const unsigned char *input, size_t len, unsigned char *output, size_t &outLen);
+
+    /**
+     * \brief          finish: add (encrypt) or check and remove (decrypt) padding
+     * \param output   at least 16 bytes
+     * \param outLen   bytes written to output
+     * \return         0 on success, -1 bad length or padding
+     */
+    int final(unsigned char *output, size_t &outLen);
+
+    /**
+     * \brief          process the whole input stream and finish, reading in
+     *                 fixed-size chunks
+     * \return         0 on success, -1 read/write error, bad length or padding
+     */
+    int crypt(std::istream &is, std::ostream &os);
+
+    /**
+     * \brief          process the whole input string and finish
+     * \return         0 on success, -1 bad length or padding
+     */
+    int crypt(const std::string &input, std::string &output);
+
+    Sm4Cipher(const Sm4Cipher &) = delete;
+    Sm4Cipher &operator=(const Sm4Cipher &) = delete;
+
+private:
+    void cryptBlocks(unsigned char *input, unsigned char *output, size_t length);
+
+    sm4_context m_ctx;
+    Mode m_mode;
+    bool m_encrypt;
+    bool m_finished;
+    unsigned char m_iv[16];         // CBC: last cipher block, CTR: next counter
+    unsigned char m_buf[16];        // CBC: unfinished block, CTR: unused key stream
+    size_t m_bufLen;
+};
+
 #endif /* sm4.h */